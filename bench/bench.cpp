@@ -0,0 +1,493 @@
+/*
+ * Created by Brett on 19/10/26.
+ * Licensed under GNU General Public License V3.0
+ * See LICENSE file for license detail
+ */
+#include <world/chunk/generator.h>
+#include <render/occlusion.h>
+#include <world/lod_rings.h>
+#include <blt/std/time.h>
+#include <atomic>
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <new>
+#include <string>
+#include <vector>
+
+/*
+ * Headless generation and meshing benchmark. Links none of the GL / GLFW code so it can run on machines without a display.
+ *
+ * Generates a fixed box of chunks (x and z in [-radius, radius), y in [0, height)), meshes every chunk of it
+ * and writes the results as JSON to stdout, or to the file given with --output.
+ * The occlusion culling is then run from the middle of the box, looking along each horizontal axis and straight down.
+ * Before any of that a few known cull decisions are checked (checkOcclusion()), the bench fails if the occlusion buffer gets one wrong.
+ * It also fails if the LOD rings stop nesting while the camera moves around (checkRings()).
+ *
+ * The chunk size is fixed at compile time (FP_CHUNK_SHIFT), CMake builds FinalProjectBench16 / 64 next to the default 32^3 bench.
+ * The radius and height count chunks, scale them with the chunk size to compare the same world: --radius 8 --height 8 at 16^3,
+ * 4 and 4 at 32^3 and 2 and 2 at 64^3. The per million block numbers are comparable across sizes.
+ * The block storage order (FP_BLOCK_LAYOUT) is fixed the same way, FinalProjectBenchXZY / YZX / Morton are built at 32^3 next to
+ * the default ZYX bench and produce the same world and meshes, only the timings should differ.
+ *
+ * usage: FinalProjectBench [--radius r] [--height h] [--face-records] [--huge-pages] [--output file]
+ */
+
+// indexed by FP_BLOCK_LAYOUT
+static const char* BLOCK_LAYOUT_NAMES[] = {"zyx", "xzy", "yzx", "morton"};
+
+// every allocation made by the program is counted, the phases below read the difference across their own work
+static std::atomic<size_t> allocation_count{0};
+static std::atomic<size_t> allocated_bytes{0};
+
+void* operator new(size_t size) {
+    allocation_count.fetch_add(1, std::memory_order_relaxed);
+    allocated_bytes.fetch_add(size, std::memory_order_relaxed);
+    if (auto* mem = std::malloc(size == 0 ? 1 : size))
+        return mem;
+    throw std::bad_alloc();
+}
+
+void operator delete(void* mem) noexcept {
+    std::free(mem);
+}
+
+void operator delete(void* mem, size_t) noexcept {
+    std::free(mem);
+}
+
+struct phase_stats {
+    // nanoseconds spent on each chunk
+    std::vector<long> latencies;
+    long total = 0;
+    size_t allocations = 0;
+    size_t bytes = 0;
+    
+    size_t start_allocations = 0;
+    size_t start_bytes = 0;
+    
+    void begin() {
+        start_allocations = allocation_count.load();
+        start_bytes = allocated_bytes.load();
+    }
+    
+    void end() {
+        allocations = allocation_count.load() - start_allocations;
+        bytes = allocated_bytes.load() - start_bytes;
+        for (auto latency : latencies)
+            total += latency;
+        std::sort(latencies.begin(), latencies.end());
+    }
+    
+    [[nodiscard]] double percentile(double p) const {
+        if (latencies.empty())
+            return 0;
+        auto index = std::min(latencies.size() - 1, (size_t) (p * (double) (latencies.size() - 1) + 0.5));
+        return (double) latencies[index] / 1000.0;
+    }
+    
+    void write(std::ostream& out) const {
+        const auto chunks = (double) std::max((size_t) 1, latencies.size());
+        out << "\t\t\"total_ms\": " << (double) total / 1000000.0 << ",\n";
+        out << "\t\t\"chunks_per_second\": " << (total > 0 ? (double) latencies.size() / ((double) total / 1000000000.0) : 0.0) << ",\n";
+        out << "\t\t\"latency_us\": {\"p50\": " << percentile(0.5) << ", \"p99\": " << percentile(0.99) << ", \"max\": "
+            << (latencies.empty() ? 0.0 : (double) latencies.back() / 1000.0) << "},\n";
+        out << "\t\t\"allocations\": " << allocations << ",\n";
+        out << "\t\t\"allocated_bytes\": " << bytes << ",\n";
+        out << "\t\t\"allocations_per_chunk\": " << (double) allocations / chunks;
+    }
+};
+
+/**
+ * The projection view matrix of a 90 degree camera at eye, matching the 2:1 occlusion buffer
+ * @param right the camera's right direction, up its up direction. Forward is up x right
+ */
+static blt::mat4x4 createCamera(const blt::vec3& eye, const blt::vec3& right, const blt::vec3& up) {
+    const float near = 0.1f, far = 2048.0f;
+    blt::mat4x4 projection;
+    projection.m00(1.0f / ((float) fp::OCCLUSION_WIDTH / fp::OCCLUSION_HEIGHT));
+    projection.m11(1.0f);
+    projection.m22(-(far + near) / (far - near));
+    projection.m23(-2 * far * near / (far - near));
+    projection.m32(-1);
+    projection.m33(0);
+    
+    // the camera looks down its -z axis
+    const blt::vec3 back{right.y() * up.z() - right.z() * up.y(), right.z() * up.x() - right.x() * up.z(), right.x() * up.y() - right.y() * up.x()};
+    const blt::vec3* rows[3] = {&right, &up, &back};
+    blt::mat4x4 view;
+    for (int r = 0; r < 3; r++) {
+        const auto& axis = *rows[r];
+        const float translation = -(axis.x() * eye.x() + axis.y() * eye.y() + axis.z() * eye.z());
+        if (r == 0) {
+            view.m00(axis.x()), view.m01(axis.y()), view.m02(axis.z()), view.m03(translation);
+        } else if (r == 1) {
+            view.m10(axis.x()), view.m11(axis.y()), view.m12(axis.z()), view.m13(translation);
+        } else {
+            view.m20(axis.x()), view.m21(axis.y()), view.m22(axis.z()), view.m23(translation);
+        }
+    }
+    view.m33(1);
+    return projection * view;
+}
+
+/**
+ * Cull decisions the occlusion buffer has to get right, culling anything visible leaves holes in the world. Runs before the benchmark
+ * @return false if any case failed, the failed cases are printed
+ */
+static bool checkOcclusion() {
+    struct occlusion_case {
+        const char* name;
+        blt::vec3 min;
+        blt::vec3 max;
+        bool visible;
+    };
+    // the camera is at the origin looking down -z. A block d away is 64 / d pixels wide, x = 0 is pixel column 128
+    const occlusion_case cases[] = {
+            {"behind the wall", {-2, -2, -131}, {2, 2, -130}, false},
+            // nearer than the wall's back, but the front face is what hides it
+            {"inside the wall", {-2, -2, -61}, {2, 2, -60}, false},
+            {"in front of the wall", {-2, -2, -11}, {2, 2, -10}, true},
+            {"crossing the near plane", {-1, -1, -1}, {1, 1, 1}, true},
+            {"off the screen", {600, -2, -131}, {610, 2, -130}, false},
+            // reaches 0.3 pixels past the wall's edge, into the part of column 163 the wall doesn't cover
+            {"sub-pixel sliver past the wall", {0, -1, -131}, {72.921875f, 1, -130}, true},
+    };
+    fp::occlusion_buffer occlusion;
+    occlusion.begin(createCamera({0, 0, 0}, {1, 0, 0}, {0, 1, 0}));
+    // 20 to 120 blocks away and covering the screen, except its right edge which ends 0.6 pixels into column 163
+    occlusion.addOccluder({-80, -80, -120}, {11.125f, 80, -20});
+    bool passed = true;
+    for (const auto& c : cases) {
+        if (occlusion.isVisible(c.min, c.max) != c.visible) {
+            std::cerr << "occlusion check failed: " << c.name << " should be " << (c.visible ? "visible" : "culled") << "\n";
+            passed = false;
+        }
+    }
+    return passed;
+}
+
+/**
+ * Walks the camera through anchor moves at each radius the view distance can reach, both single chunk steps and teleports. After every move the camera's chunk has to be inside the full resolution ring and each ring inside the next.
+ */
+static bool checkRings() {
+    for (int radius = 2; radius <= 16; radius += 2) {
+        fp::chunk_pos anchors[MAX_LOD_LEVEL + 1]{};
+        bool valid = false;
+        fp::chunk_pos camera{0, 0, 0};
+        unsigned int seed = 1;
+        const auto check = [&](const char* move) -> bool {
+            fp::updateRingAnchors(anchors, camera, radius, valid);
+            valid = true;
+            if (!fp::_static::inside_ring_box(camera, anchors[0], radius)) {
+                std::cerr << "ring check failed: radius " << radius << ", " << move << " left the camera outside of the full resolution ring\n";
+                return false;
+            }
+            for (int lod = 1; lod <= MAX_LOD_LEVEL; lod++) {
+                const auto& inner = anchors[lod - 1];
+                const auto& outer = anchors[lod];
+                // the finer ring's box in this level's regions, both corners have to be inside this ring's box
+                const fp::chunk_pos low{fp::_static::chunk_to_region(inner.x - radius, 1), fp::_static::chunk_to_region(inner.y - radius, 1),
+                                        fp::_static::chunk_to_region(inner.z - radius, 1)};
+                const fp::chunk_pos high{fp::_static::chunk_to_region(inner.x + radius - 1, 1),
+                                         fp::_static::chunk_to_region(inner.y + radius - 1, 1),
+                                         fp::_static::chunk_to_region(inner.z + radius - 1, 1)};
+                if (!fp::_static::inside_ring_box(low, outer, radius) || !fp::_static::inside_ring_box(high, outer, radius) ||
+                    inner.x % 2 != 0 || inner.y % 2 != 0 || inner.z % 2 != 0) {
+                    std::cerr << "ring check failed: radius " << radius << ", " << move << " moved ring " << lod - 1 << " out of ring " << lod << "\n";
+                    return false;
+                }
+            }
+            return true;
+        };
+        // a random walk one chunk at a time along a random axis, teleporting every 500 moves
+        for (int move = 0; move < 20000; move++) {
+            seed = seed * 1664525u + 1013904223u;
+            const auto random = (int) (seed >> 8);
+            const bool teleport = move % 500 == 0;
+            const int delta = teleport ? random % 81 - 40 : (random & 1) * 2 - 1;
+            switch ((random >> 8) % 3) {
+                case 0:
+                    camera.x += delta;
+                    break;
+                case 1:
+                    camera.y += delta;
+                    break;
+                default:
+                    camera.z += delta;
+                    break;
+            }
+            if (!check(teleport ? "a teleport" : "a step"))
+                return false;
+        }
+    }
+    return true;
+}
+
+static bool readInt(int argc, char** argv, int& i, int& value) {
+    if (i + 1 >= argc)
+        return false;
+    value = std::atoi(argv[++i]);
+    return value > 0;
+}
+
+int main(int argc, char** argv) {
+    int radius = 4;
+    int height = 4;
+    bool face_records = false;
+    bool huge_pages = false;
+    std::string output;
+    
+    for (int i = 1; i < argc; i++) {
+        if (std::strcmp(argv[i], "--radius") == 0) {
+            if (!readInt(argc, argv, i, radius)) {
+                std::cerr << "--radius requires a positive number\n";
+                return 1;
+            }
+        } else if (std::strcmp(argv[i], "--height") == 0) {
+            if (!readInt(argc, argv, i, height)) {
+                std::cerr << "--height requires a positive number\n";
+                return 1;
+            }
+        } else if (std::strcmp(argv[i], "--face-records") == 0) {
+            face_records = true;
+        } else if (std::strcmp(argv[i], "--huge-pages") == 0) {
+            huge_pages = true;
+        } else if (std::strcmp(argv[i], "--output") == 0 && i + 1 < argc) {
+            output = argv[++i];
+        } else {
+            std::cerr << "usage: " << argv[0] << " [--radius r] [--height h] [--face-records] [--huge-pages] [--output file]\n";
+            return 1;
+        }
+    }
+    
+    if (!checkOcclusion() || !checkRings())
+        return 1;
+    
+    // no palette exists here, every block keeps texture index 0 which meshes exactly the same
+    fp::registry::registerDefaultBlocks();
+    fp::block_storage::getSlabs().setHugePages(huge_pages);
+    
+    const int width = radius * 2;
+    const auto index = [width, height](int x, int y, int z) -> size_t {
+        return ((size_t) x * height + y) * width + z;
+    };
+    std::vector<fp::block_storage*> storages((size_t) width * width * height);
+    
+    phase_stats generation;
+    generation.latencies.reserve(storages.size());
+    generation.begin();
+    for (int x = 0; x < width; x++) {
+        for (int y = 0; y < height; y++) {
+            for (int z = 0; z < width; z++) {
+                auto start = blt::system::getCurrentTimeNanoseconds();
+                auto* storage = new fp::block_storage();
+                fp::generator::generateTerrain(storage, {x - radius, y, z - radius});
+                storages[index(x, y, z)] = storage;
+                generation.latencies.push_back(blt::system::getCurrentTimeNanoseconds() - start);
+            }
+        }
+    }
+    generation.end();
+    
+    const auto neighbour = [&](int x, int y, int z) -> const fp::block_storage* {
+        if (x < 0 || x >= width || y < 0 || y >= height || z < 0 || z >= width)
+            return nullptr;
+        return storages[index(x, y, z)];
+    };
+    
+    size_t vertices = 0, indices = 0, faces = 0, empty = 0;
+    // one draw per non-empty pass of a chunk, and the bytes its buffers would upload
+    size_t draws = 0, mesh_bytes = 0;
+    phase_stats meshing;
+    meshing.latencies.reserve(storages.size());
+    meshing.begin();
+    for (int x = 0; x < width; x++) {
+        for (int y = 0; y < height; y++) {
+            for (int z = 0; z < width; z++) {
+                // ordered the same as the face enum
+                const fp::block_storage* neighbours[6] = {
+                        neighbour(x + 1, y, z), neighbour(x - 1, y, z),
+                        neighbour(x, y + 1, z), neighbour(x, y - 1, z),
+                        neighbour(x, y, z + 1), neighbour(x, y, z - 1)
+                };
+                auto start = blt::system::getCurrentTimeNanoseconds();
+                fp::mesh_storage* meshes[fp::RENDER_PASS_COUNT];
+                for (int i = 0; i < fp::RENDER_PASS_COUNT; i++)
+                    meshes[i] = new fp::mesh_storage(face_records, i == fp::TRANSLUCENT_PASS);
+                fp::generator::generateMesh(meshes, storages[index(x, y, z)], neighbours);
+                meshing.latencies.push_back(blt::system::getCurrentTimeNanoseconds() - start);
+                
+                bool chunk_empty = true;
+                for (auto* mesh : meshes) {
+                    faces += mesh->getFaceCount();
+                    vertices += mesh->getVertices().size();
+                    indices += mesh->getIndexCount();
+                    chunk_empty &= mesh->isEmpty();
+                    draws += !mesh->isEmpty();
+                    mesh_bytes += face_records ? mesh->getFaceCount() * sizeof(fp::face_record) :
+                                  mesh->getVertices().size() * sizeof(fp::vertex) + mesh->getIndexCount() * sizeof(unsigned int);
+                    delete mesh;
+                }
+                empty += chunk_empty;
+            }
+        }
+    }
+    meshing.end();
+    
+    std::vector<std::vector<fp::generator::occluder_slab>> occluders(storages.size());
+    size_t occluder_slabs = 0;
+    phase_stats occluder_search;
+    occluder_search.latencies.reserve(storages.size());
+    occluder_search.begin();
+    for (size_t i = 0; i < storages.size(); i++) {
+        auto start = blt::system::getCurrentTimeNanoseconds();
+        fp::generator::findOccluders(storages[i], occluders[i]);
+        occluder_search.latencies.push_back(blt::system::getCurrentTimeNanoseconds() - start);
+        occluder_slabs += occluders[i].size();
+    }
+    occluder_search.end();
+    
+    // open chunks connect every face to every other, closed ones are solid or only hold sealed pockets
+    size_t connected_pairs = 0, open_chunks = 0, closed_chunks = 0;
+    phase_stats connectivity;
+    connectivity.latencies.reserve(storages.size());
+    connectivity.begin();
+    for (auto* storage : storages) {
+        auto start = blt::system::getCurrentTimeNanoseconds();
+        const auto connections = fp::generator::findConnections(storage);
+        connectivity.latencies.push_back(blt::system::getCurrentTimeNanoseconds() - start);
+        for (int bit = 0; bit < 15; bit++)
+            connected_pairs += (connections >> bit) & 1;
+        open_chunks += connections == fp::generator::ALL_FACES_CONNECTED;
+        closed_chunks += connections == 0;
+    }
+    connectivity.end();
+    
+    // same radius as the renderer uses
+    const int occluder_radius = 3;
+    const blt::vec3 eye{0.5f, (float) (height * CHUNK_SIZE) / 2 + 0.5f, 0.5f};
+    const int eye_chunk_y = (height * CHUNK_SIZE / 2) / CHUNK_SIZE;
+    const blt::mat4x4 views[5] = {
+            createCamera(eye, {0, 0, -1}, {0, 1, 0}),
+            createCamera(eye, {0, 0, 1}, {0, 1, 0}),
+            createCamera(eye, {1, 0, 0}, {0, 1, 0}),
+            createCamera(eye, {-1, 0, 0}, {0, 1, 0}),
+            createCamera(eye, {1, 0, 0}, {0, 0, -1})
+    };
+    fp::occlusion_buffer occlusion;
+    fp::occlusion_stats occlusion_totals;
+    phase_stats culling;
+    culling.begin();
+    for (const auto& view : views) {
+        auto start = blt::system::getCurrentTimeNanoseconds();
+        occlusion.begin(view);
+        for (int x = 0; x < width; x++) {
+            for (int y = 0; y < height; y++) {
+                for (int z = 0; z < width; z++) {
+                    if (std::abs(x - radius) > occluder_radius || std::abs(y - eye_chunk_y) > occluder_radius || std::abs(z - radius) > occluder_radius)
+                        continue;
+                    const blt::vec3 origin{(float) (x - radius) * CHUNK_SIZE - 0.5f, (float) y * CHUNK_SIZE - 0.5f, (float) (z - radius) * CHUNK_SIZE - 0.5f};
+                    for (const auto& slab : occluders[index(x, y, z)]) {
+                        occlusion.addOccluder(origin + blt::vec3{(float) slab.min.x, (float) slab.min.y, (float) slab.min.z},
+                                              origin + blt::vec3{(float) slab.max.x + 1, (float) slab.max.y + 1, (float) slab.max.z + 1});
+                    }
+                }
+            }
+        }
+        for (int x = 0; x < width; x++) {
+            for (int y = 0; y < height; y++) {
+                for (int z = 0; z < width; z++) {
+                    const blt::vec3 min{(float) (x - radius) * CHUNK_SIZE - 0.5f, (float) y * CHUNK_SIZE - 0.5f, (float) (z - radius) * CHUNK_SIZE - 0.5f};
+                    occlusion.isVisible(min, min + blt::vec3{CHUNK_SIZE, CHUNK_SIZE, CHUNK_SIZE});
+                }
+            }
+        }
+        culling.latencies.push_back(blt::system::getCurrentTimeNanoseconds() - start);
+        const auto& stats = occlusion.getStats();
+        occlusion_totals.occluders += stats.occluders;
+        occlusion_totals.polygons += stats.polygons;
+        occlusion_totals.tested += stats.tested;
+        occlusion_totals.outside += stats.outside;
+        occlusion_totals.occluded += stats.occluded;
+    }
+    culling.end();
+    
+    std::ofstream file;
+    if (!output.empty()) {
+        file.open(output);
+        if (!file) {
+            std::cerr << "unable to open " << output << " for writing\n";
+            return 1;
+        }
+    }
+    std::ostream& out = output.empty() ? std::cout : file;
+    
+    const auto chunks = (double) storages.size();
+    // chunk sizes are compared on the same volume of world, see the bench variants in CMakeLists.txt
+    const auto million_blocks = chunks * CHUNK_SIZE * CHUNK_SIZE * CHUNK_SIZE / 1000000.0;
+    out << "{\n";
+    out << "\t\"region\": {\"radius\": " << radius << ", \"height\": " << height << ", \"chunks\": " << storages.size()
+        << ", \"chunk_size\": " << CHUNK_SIZE << ", \"block_layout\": \"" << BLOCK_LAYOUT_NAMES[FP_BLOCK_LAYOUT] << "\", \"face_records\": " << (face_records ? "true" : "false")
+        << ", \"huge_pages\": " << (huge_pages ? "true" : "false") << "},\n";
+    out << "\t\"generation\": {\n";
+    generation.write(out);
+    out << ",\n";
+    out << "\t\t\"ms_per_million_blocks\": " << (double) generation.total / 1000000.0 / million_blocks << "\n";
+    out << "\t},\n";
+    out << "\t\"meshing\": {\n";
+    meshing.write(out);
+    out << ",\n";
+    out << "\t\t\"empty_chunks\": " << empty << ",\n";
+    out << "\t\t\"faces_per_chunk\": " << (double) faces / chunks << ",\n";
+    out << "\t\t\"vertices_per_chunk\": " << (double) vertices / chunks << ",\n";
+    out << "\t\t\"indices_per_chunk\": " << (double) indices / chunks << ",\n";
+    out << "\t\t\"ms_per_million_blocks\": " << (double) meshing.total / 1000000.0 / million_blocks << "\n";
+    out << "\t},\n";
+    out << "\t\"draw\": {\n";
+    out << "\t\t\"draws_per_chunk\": " << (double) draws / chunks << ",\n";
+    out << "\t\t\"bytes_per_chunk\": " << (double) mesh_bytes / chunks << ",\n";
+    out << "\t\t\"draws_per_million_blocks\": " << (double) draws / million_blocks << ",\n";
+    out << "\t\t\"bytes_per_million_blocks\": " << (double) mesh_bytes / million_blocks << ",\n";
+    out << "\t\t\"faces_per_million_blocks\": " << (double) faces / million_blocks << "\n";
+    out << "\t},\n";
+    out << "\t\"occluder_search\": {\n";
+    occluder_search.write(out);
+    out << ",\n";
+    out << "\t\t\"slabs_per_chunk\": " << (double) occluder_slabs / chunks << "\n";
+    out << "\t},\n";
+    out << "\t\"connectivity\": {\n";
+    connectivity.write(out);
+    out << ",\n";
+    out << "\t\t\"pairs_per_chunk\": " << (double) connected_pairs / chunks << ",\n";
+    out << "\t\t\"open_chunks\": " << open_chunks << ",\n";
+    out << "\t\t\"closed_chunks\": " << closed_chunks << "\n";
+    out << "\t},\n";
+    // the latencies here are per view, not per chunk
+    out << "\t\"occlusion\": {\n";
+    culling.write(out);
+    out << ",\n";
+    out << "\t\t\"views\": " << culling.latencies.size() << ",\n";
+    out << "\t\t\"occluders\": " << occlusion_totals.occluders << ",\n";
+    out << "\t\t\"polygons\": " << occlusion_totals.polygons << ",\n";
+    out << "\t\t\"tested\": " << occlusion_totals.tested << ",\n";
+    out << "\t\t\"outside\": " << occlusion_totals.outside << ",\n";
+    out << "\t\t\"occluded\": " << occlusion_totals.occluded << "\n";
+    out << "\t},\n";
+    const auto slabs = fp::block_storage::getSlabs().getStats();
+    out << "\t\"block_slabs\": {\"live\": " << slabs.live << ", \"capacity\": " << slabs.capacity << ", \"slabs\": " << slabs.slabs
+        << ", \"huge_page_slabs\": " << slabs.huge_page_slabs << "},\n";
+    // every mesh is freed by now, anything still live here is a leak
+    const auto mesh_blocks = fp::bump_arena::getBlocks().getStats();
+    out << "\t\"mesh_blocks\": {\"live\": " << mesh_blocks.live << ", \"capacity\": " << mesh_blocks.capacity << ", \"slabs\": "
+        << mesh_blocks.slabs << "}\n";
+    out << "}\n";
+    
+    for (auto* storage : storages)
+        delete storage;
+    fp::registry::blockCleanup();
+    return 0;
+}
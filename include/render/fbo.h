@@ -8,6 +8,7 @@
 #define FINALPROJECT_FBO_H
 
 #include <render/textures.h>
+#include <vector>
 
 namespace fp {
     
@@ -15,6 +16,8 @@ namespace fp {
         private:
             unsigned int fboID = 0;
             bool m_screen_space = false;
+            // GLES 3 requires attachment i to be at index i of the draw buffers, gaps are GL_NONE
+            std::vector<GLenum> draw_buffers;
         public:
             explicit FBO(bool screen_space = false): m_screen_space(screen_space) {
                 glGenFramebuffers(1, &fboID);
@@ -28,7 +31,16 @@ namespace fp {
                 glBindFramebuffer(GL_FRAMEBUFFER, 0);
             }
             
-            void attach(fp::texture::gl_texture* texture);
+            /**
+             * Attaches level 0 of the 2D texture, binding this framebuffer. Color attachments are added to the draw buffers
+             * @param attachment GL_COLOR_ATTACHMENTi, GL_DEPTH_ATTACHMENT or GL_DEPTH_STENCIL_ATTACHMENT
+             */
+            void attach(fp::texture::gl_texture* texture, GLenum attachment = GL_COLOR_ATTACHMENT0);
+            
+            /**
+             * @return true if the framebuffer can be drawn to, logs the status otherwise. Binds this framebuffer
+             */
+            [[nodiscard]] bool isComplete() const;
             
             ~FBO() {
                 glDeleteFramebuffers(1, &fboID);
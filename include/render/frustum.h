@@ -129,6 +129,29 @@ class frustum {
             return pointInside(start) || pointInside(end);
         }
         
+        /**
+         * Conservative box test against the planes of the projection view matrix. Only boxes entirely behind one plane are rejected,
+         * a box can still pass when it is outside near a corner of the frustum.
+         */
+        static bool isBoxInsideFrustum(const blt::mat4x4& pvm, const blt::vec3& min, const blt::vec3& max) {
+            // left, right, bottom, top, near and far are rows 0 to 2 added to or subtracted from row 3
+            for (int side = 0; side < 6; side++) {
+                const int row = side / 2;
+                const float sign = side % 2 == 0 ? 1.0f : -1.0f;
+                const float a = sign * pvm.m(row, 0) + pvm.m(3, 0);
+                const float b = sign * pvm.m(row, 1) + pvm.m(3, 1);
+                const float c = sign * pvm.m(row, 2) + pvm.m(3, 2);
+                const float d = sign * pvm.m(row, 3) + pvm.m(3, 3);
+                // the corner furthest along the plane's normal, if even that is behind the plane the whole box is
+                const float x = a >= 0 ? max.x() : min.x();
+                const float y = b >= 0 ? max.y() : min.y();
+                const float z = c >= 0 ? max.z() : min.z();
+                if (a * x + b * y + c * z + d < 0)
+                    return false;
+            }
+            return true;
+        }
+        
         static bool isInsideFrustum(const blt::mat4x4& pvm, const blt::vec3& point) {
             auto v = pvm * blt::vec4(point);
             v = v / v.w();
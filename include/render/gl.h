@@ -14,6 +14,10 @@
 #include <blt/math/math.h>
 #include <blt/std/string.h>
 #include <string>
+#include <cstring>
+#include <cstdint>
+#include <utility>
+#include <functional>
 
 namespace fp {
 /**
@@ -32,11 +36,14 @@ namespace fp {
     
     struct VBO {
         GLuint vboID = 0;
+        // bytes written by the last update
         int size = 0;
+        // bytes allocated on the GPU, never shrinks
+        int capacity = 0;
         vbo_type type = ARRAY_BUFFER;
         vbo_mem_type mem_type = STATIC;
         
-        VBO(vbo_type type, void* data, int size, vbo_mem_type mem_type = STATIC): type(type), size(size), mem_type(mem_type) {
+        VBO(vbo_type type, void* data, int size, vbo_mem_type mem_type = STATIC): type(type), size(size), capacity(size), mem_type(mem_type) {
             glGenBuffers(1, &vboID);
             bind();
             glBufferData(type, size, data, mem_type);
@@ -47,6 +54,7 @@ namespace fp {
             glGenBuffers(1, &vboID);
             bind();
             size = data.size() * sizeof(float);
+            capacity = size;
             glBufferData(type, size, data.data(), mem_type);
             //glBufferSubData(type, 0, )
         }
@@ -54,18 +62,31 @@ namespace fp {
         inline void update(void* new_data, int data_size) {
             bind();
             // optimization technique is to not reallocate the memory on the GPU if the new buffer size is not larger than our current buffer
-            if (data_size <= size){
+            if (data_size <= capacity){
 //                 we can do this as long as we overwrite from the beginning. Since the new draw call will only use of to size of the allocated buffer
 //                 to do all its drawing, the extra space unused can be ignored and saved for future use.
                 glBufferSubData(type, 0, data_size, new_data);
-            } else
+            } else {
                 glBufferData(type, data_size, new_data, mem_type);
+                capacity = data_size;
+            }
             size = data_size;
             glBindBuffer(type, 0);
         }
         
-        template<typename T>
-        inline void update(std::vector<T>& new_data) {
+        /**
+         * Orphans the buffer's storage: the driver hands back fresh memory of the same capacity and frees the old memory
+         * once any draws still reading from it have finished, so the next update never waits on the GPU.
+         */
+        inline void orphan() {
+            bind();
+            glBufferData(type, capacity, nullptr, mem_type);
+            size = 0;
+            glBindBuffer(type, 0);
+        }
+        
+        template<typename T, typename Alloc>
+        inline void update(std::vector<T, Alloc>& new_data) {
             update(new_data.data(), new_data.size() * sizeof(T));
         }
         
@@ -109,6 +130,22 @@ namespace fp {
              */
             void bindVBO(VBO* vbo, int attribute_number, int coordinate_size, GLenum type = GL_FLOAT, int stride = 0, long offset = 0, bool repeated = false);
             
+            /**
+             * binds the VBO as an attribute which advances once per instance instead of once per vertex.
+             * integer types reach the shader as int / uint without being converted to float, GL_FLOAT is passed as is.
+             * @param vbo vbo to bind
+             * @param attribute_number attribute position to bind
+             * @param coordinate_size size of this attribute (1 for uint, 2 for uvec2...)
+             * @param type type to store. GL_UNSIGNED_INT, GL_INT or GL_FLOAT mostly
+             * @param stride how many bytes the COMPLETE data takes in the VBO, 0 will automatically assume packed data.
+             * @param offset offset into the data that this attribute is stored
+             * @param repeated same as bindVBO, the VBO is already owned by another attribute of this VAO
+             */
+            void bindInstancedVBO(
+                    VBO* vbo, int attribute_number, int coordinate_size, GLenum type = GL_UNSIGNED_INT, int stride = 0, long offset = 0,
+                    bool repeated = false
+            );
+            
             /**
              * Binds the VBO as if it was the element buffer (indices). Note: calling this more than once is not supported.
              * @param vbo vbo to use
@@ -119,6 +156,24 @@ namespace fp {
                 return VBOs[attribute_number];
             }
             
+            /**
+             * @return bytes allocated by all the VBOs owned by this VAO
+             */
+            [[nodiscard]] inline int getCapacity() const {
+                int capacity = 0;
+                for (const auto& vbo : VBOs)
+                    capacity += vbo.second->capacity;
+                return capacity;
+            }
+            
+            /**
+             * Orphans every VBO owned by this VAO, see VBO::orphan()
+             */
+            inline void orphan() {
+                for (auto& vbo : VBOs)
+                    vbo.second->orphan();
+            }
+            
             inline void bind() const {
                 glBindVertexArray(vaoID);
             }
@@ -126,6 +181,150 @@ namespace fp {
             ~VAO();
     };
     
+    struct vao_pool_stats {
+        // VAOs handed out and not yet released
+        size_t live = 0;
+        // VAOs waiting in the pool and the bytes their buffers hold on to
+        size_t pooled = 0;
+        size_t pooled_bytes = 0;
+        // totals since the pool was created
+        size_t created = 0;
+        size_t reused = 0;
+        size_t destroyed = 0;
+    };
+    
+    /**
+     * Recycles VAOs along with their VBOs instead of deleting them, keeping the buffers they have grown to.
+     * Every VAO in a pool shares the same layout, which is set up by the factory. Free VAOs are bucketed by the log2 of their capacity.
+     * Must only be used on the GL thread.
+     */
+    class vao_pool {
+        private:
+            static constexpr int BUCKET_COUNT = 32;
+            // how many buckets above the requested size to search before settling for a smaller VAO, keeps small meshes off huge buffers
+            static constexpr int BUCKET_SEARCH = 2;
+            
+            std::function<VAO*()> factory;
+            std::vector<VAO*> buckets[BUCKET_COUNT];
+            size_t max_pooled;
+            vao_pool_stats stats;
+            
+            static int getBucket(int capacity);
+        public:
+            /**
+             * @param factory creates a new VAO with all of its VBOs bound
+             * @param max_pooled VAOs released past this many are deleted instead of kept
+             */
+            explicit vao_pool(std::function<VAO*()> factory, size_t max_pooled = 512):
+                    factory(std::move(factory)), max_pooled(max_pooled) {}
+            
+            vao_pool(const vao_pool& copy) = delete;
+            
+            /**
+             * @param capacity total bytes the caller is about to upload across the VAO's buffers
+             * @return a pooled VAO that can hold capacity bytes without reallocating if there is one, otherwise the closest fit or a new VAO
+             */
+            VAO* acquire(int capacity);
+            
+            /**
+             * Returns the VAO to the pool. Its buffers are orphaned so the next user never has to wait on draws still reading them
+             */
+            void release(VAO* vao);
+            
+            [[nodiscard]] inline const vao_pool_stats& getStats() const {
+                return stats;
+            }
+            
+            ~vao_pool();
+    };
+    
+    // uniform block bindings shared by every shader. Blocks with these names are bound automatically when a shader is created
+    constexpr int STANDARD_MATRICES_BINDING = 0;
+    // per draw data, see draw_data_buffer
+    constexpr int DRAW_DATA_BINDING = 1;
+    // lights of the clustered forward renderer, see light_clusters
+    constexpr int POINT_LIGHTS_BINDING = 2;
+    
+    /**
+     * Location of a uniform, resolved once with shader::getUniform() then stored by the caller.
+     * Setting a uniform through a handle skips the string hashing done by the name based setters.
+     */
+    struct uniform_handle {
+        GLint location = -1;
+        
+        [[nodiscard]] inline bool valid() const {
+            return location >= 0;
+        }
+    };
+    
+    /**
+     * Uniform buffer holding one block of per draw data (the DrawData block) for every draw in a frame.
+     * The blocks are written on the CPU, uploaded once, then each draw selects its block with glBindBufferRange.
+     * T must be laid out to match the std140 block in the shader.
+     */
+    template<typename T>
+    class draw_data_buffer {
+        private:
+            GLuint uboID = 0;
+            // blocks must start on a multiple of GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, which is commonly 256 bytes
+            size_t stride = sizeof(T);
+            size_t gpu_size = 0;
+            size_t count = 0;
+            std::vector<unsigned char> data;
+        public:
+            draw_data_buffer() {
+                GLint alignment = 0;
+                glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+                if (alignment > 0)
+                    stride = (sizeof(T) + alignment - 1) / alignment * alignment;
+                glGenBuffers(1, &uboID);
+            }
+            
+            draw_data_buffer(const draw_data_buffer& copy) = delete;
+            
+            inline void clear() {
+                count = 0;
+            }
+            
+            /**
+             * @return index of the block, to be passed to bind() once the buffer has been uploaded
+             */
+            inline size_t push(const T& block) {
+                if (data.size() < (count + 1) * stride)
+                    data.resize((count + 1) * stride);
+                std::memcpy(&data[count * stride], &block, sizeof(T));
+                return count++;
+            }
+            
+            inline void upload() {
+                if (count == 0)
+                    return;
+                glBindBuffer(GL_UNIFORM_BUFFER, uboID);
+                auto size = count * stride;
+                // like VBO::update, only reallocate when the buffer has to grow
+                if (size > gpu_size) {
+                    glBufferData(GL_UNIFORM_BUFFER, (GLsizeiptr) data.size(), data.data(), GL_DYNAMIC_DRAW);
+                    gpu_size = data.size();
+                } else
+                    glBufferSubData(GL_UNIFORM_BUFFER, 0, (GLsizeiptr) size, data.data());
+                glBindBuffer(GL_UNIFORM_BUFFER, 0);
+            }
+            
+            inline void bind(size_t index) const {
+                glBindBufferRange(GL_UNIFORM_BUFFER, DRAW_DATA_BINDING, uboID, (GLintptr) (index * stride), sizeof(T));
+            }
+            
+            ~draw_data_buffer() {
+                glDeleteBuffers(1, &uboID);
+            }
+    };
+    
+    /**
+     * #defines injected into every stage of a shader right after the #version line, as name -> value.
+     * Lets one source be compiled into several permutations and keeps constants shared with C++ in one place.
+     */
+    typedef std::vector<std::pair<std::string, std::string>> shader_defines;
+    
     class shader_base {
         protected:
             struct IntDefaultedToMinusOne {
@@ -199,30 +398,48 @@ namespace fp {
             // im leaving some of this stuff in here because I might expand the native application to use some of it.
             // im trying to keep the web and native versions the same though
             unsigned int tessellationShaderID = 0;
+            // filled once by reflect(), every active uniform outside of a block
             std::unordered_map<std::string, IntDefaultedToMinusOne> uniformVars;
         
-            static unsigned int createShader(const std::string& source, int type);
+            /**
+             * @param defines #define lines, inserted after the #version line without copying the source
+             */
+            static unsigned int createShader(const std::string& source, int type, const std::string& defines);
             
-            inline GLint getUniformLocation(const std::string &name) {
-                if (uniformVars[name].i != -1)
-                    return uniformVars[name].i;
-                // caching the result is a lot faster since it won't change after the shader is created.
-                // TODO: look into this: https://webglfundamentals.org/webgl/lessons/webgl-qna-how-can-i-get-all-the-uniforms-and-uniformblocks.html
-                int loc = glGetUniformLocation(programID, name.c_str());
-                uniformVars[name].i = loc;
-                return loc;
+            /**
+             * Loads a previously linked program from the binary cache, skipping compilation completely.
+             * @return false if there is no usable binary (missing, or the driver rejected it)
+             */
+            bool loadProgramBinary(std::uint64_t key);
+            
+            void saveProgramBinary(std::uint64_t key) const;
+            
+            /**
+             * Queries every active uniform and uniform block after linking.
+             * https://webglfundamentals.org/webgl/lessons/webgl-qna-how-can-i-get-all-the-uniforms-and-uniformblocks.html
+             */
+            void reflect();
+            
+            inline GLint getUniformLocation(const std::string &name) const {
+                // the program has already been reflected, anything missing is inactive (or optimized out) and is ignored by GL
+                auto loc = uniformVars.find(name);
+                if (loc == uniformVars.end())
+                    return -1;
+                return loc->second.i;
             }
             
-            static inline std::string removeEmptyFirstLines(const std::string& string){
-                auto lines = blt::string::split(string, "\n");
-                std::string new_source_string;
-                for (const auto& line : lines) {
-                    if (!line.empty() && !blt::string::contains(line, "\"")) {
-                        new_source_string += line;
-                        new_source_string += "\n";
-                    }
-                }
-                return new_source_string;
+            /**
+             * Shaders stored as C++ raw strings start with '"' and a newline before the #version, and end with a '"'.
+             * #version must be the first thing in the source so everything around the GLSL is cut off.
+             */
+            static inline std::string trimSourceString(const std::string& string){
+                auto start = string.find("#version");
+                if (start == std::string::npos)
+                    start = string.find_first_not_of("\" \n\r\t");
+                auto end = string.find_last_not_of("\" \n\r\t");
+                if (start == std::string::npos || end == std::string::npos || end < start)
+                    return "";
+                return string.substr(start, end - start + 1) + "\n";
             }
         
         public:
@@ -233,7 +450,16 @@ namespace fp {
              * @param geometry geometry shader source or file (optional)
              * @param load_as_string load the shader as a string (true) or use the string to load the shader as a file (false)
              */
-            shader(const std::string &vertex, const std::string &fragment, const std::string &geometry = "", bool load_as_string = true);
+            shader(
+                    const std::string &vertex, const std::string &fragment, const std::string &geometry = "", bool load_as_string = true,
+                    const shader_defines& defines = {}
+            );
+            
+            /**
+             * Creates a permutation of the shader source strings with the defines injected into every stage
+             */
+            shader(const std::string &vertex, const std::string &fragment, const shader_defines& defines):
+                    shader(vertex, fragment, "", true, defines) {}
             
             shader(shader&& move) noexcept;
             
@@ -243,6 +469,34 @@ namespace fp {
             // used to set location of shared UBOs like the perspective and view matrix
             void setUniformBlockLocation(const std::string &name, int location) const;
             
+            /**
+             * @return handle to the uniform, invalid if the shader doesn't use it. Resolve handles once, not every draw!
+             */
+            [[nodiscard]] inline uniform_handle getUniform(const std::string& name) const {
+                return {getUniformLocation(name)};
+            }
+            
+            // handle based setters. These are what should be used in anything that runs every frame
+            inline void setInt(uniform_handle handle, int value) const {
+                glUniform1i(handle.location, value);
+            }
+            
+            inline void setFloat(uniform_handle handle, float value) const {
+                glUniform1f(handle.location, value);
+            }
+            
+            inline void setMatrix(uniform_handle handle, const blt::mat4x4& matrix) const {
+                glUniformMatrix4fv(handle.location, 1, GL_FALSE, matrix.ptr());
+            }
+            
+            inline void setVec3(uniform_handle handle, const blt::vec3& vec) const {
+                glUniform3f(handle.location, vec.x(), vec.y(), vec.z());
+            }
+            
+            inline void setVec4(uniform_handle handle, const blt::vec4& vec) const {
+                glUniform4f(handle.location, vec.x(), vec.y(), vec.z(), vec[3]);
+            }
+            
             // set various data-types.
             inline void setBool(const std::string &name, bool value) {
                 glUniform1i(getUniformLocation(name), (int) value);
@@ -290,6 +544,9 @@ namespace fp {
             static void updateViewMatrix(const blt::mat4x4& viewMatrix);
             // returns the perspective view matrix which is calculated per frame. (This is for optimization)
             static const blt::mat4x4& getPVM();
+            // the matrices currently in the StandardMatrices block, unlike the camera's these keep moving while the camera is frozen
+            static const blt::mat4x4& getProjectionMatrix();
+            static const blt::mat4x4& getViewMatrix();
             
             ~shader();
     };
@@ -0,0 +1,63 @@
+/*
+ * Created by Brett on 19/10/26.
+ * Licensed under GNU General Public License V3.0
+ * See LICENSE file for license detail
+ */
+
+#ifndef FINALPROJECT_CLUSTERED_LIGHTS_H
+#define FINALPROJECT_CLUSTERED_LIGHTS_H
+
+#include <render/gl.h>
+#include <render/lighting/clusters.h>
+
+namespace fp {
+    
+    // texture units the cluster textures are bound to, the block palette keeps unit 0
+    constexpr int CLUSTER_GRID_UNIT = 1;
+    constexpr int CLUSTER_INDEX_UNIT = 2;
+    
+    /**
+     * GPU side of the clustered forward renderer. The lights go into the PointLights uniform block,
+     * each cluster's (offset, count) into a CLUSTER_X * CLUSTER_Y by CLUSTER_Z RG16UI texture and the light indices into an R16UI texture.
+     */
+    class light_clusters {
+        private:
+            /**
+             * The PointLights uniform block in chunk.frag, std140 layout
+             */
+            struct point_lights_block {
+                // xy is the viewport size, zw the depth slice scale and bias (see cluster_grid::getSliceScale())
+                blt::vec4 cluster_params;
+                point_light lights[MAX_POINT_LIGHTS];
+            };
+            
+            cluster_grid grid;
+            point_lights_block block{};
+            unsigned int uboID = 0;
+            unsigned int grid_texture = 0;
+            unsigned int index_texture = 0;
+        public:
+            light_clusters();
+            
+            light_clusters(const light_clusters& copy) = delete;
+            
+            /**
+             * Assigns the lights to the clusters of the current view and uploads the result. Must be called on the GL thread
+             */
+            void update(const std::vector<point_light>& lights);
+            
+            /**
+             * Binds the lights and cluster textures for the chunk shaders
+             */
+            void bind() const;
+            
+            [[nodiscard]] inline const cluster_stats& getStats() const {
+                return grid.getStats();
+            }
+            
+            ~light_clusters();
+    };
+    
+}
+
+#endif //FINALPROJECT_CLUSTERED_LIGHTS_H
@@ -0,0 +1,121 @@
+/*
+ * Created by Brett on 19/10/26.
+ * Licensed under GNU General Public License V3.0
+ * See LICENSE file for license detail
+ */
+
+#ifndef FINALPROJECT_CLUSTERS_H
+#define FINALPROJECT_CLUSTERS_H
+
+#include <blt/math/math.h>
+#include <vector>
+
+/*
+ * Clustered light culling (http://www.aortiz.me/2018/12/21/CG.html)
+ * The view frustum is cut into a grid of froxels, screen space tiles on x / y and exponentially growing depth slices on z.
+ * Every point light is assigned to the froxels its sphere touches, so each fragment only loops over the lights of its own froxel.
+ * Assignment runs on the CPU and needs no GL context, see clustered_lights.h for the GPU side.
+ */
+
+namespace fp {
+    
+    // shared with chunk.frag through getChunkShaderDefines()
+    constexpr int CLUSTER_X = 16;
+    constexpr int CLUSTER_Y = 9;
+    constexpr int CLUSTER_Z = 24;
+    constexpr int CLUSTER_COUNT = CLUSTER_X * CLUSTER_Y * CLUSTER_Z;
+    // size of the PointLights uniform block. 256 lights is 8KiB, well inside the 16KiB every GLES 3 device allows
+    constexpr int MAX_POINT_LIGHTS = 256;
+    // the index list is stored in a 2D integer texture this many texels wide, GLES 3 has no buffer textures
+    constexpr int CLUSTER_INDEX_WIDTH = 1024;
+    // indices are 16 bit, and so are the offsets into the list
+    constexpr int MAX_CLUSTER_INDICES = CLUSTER_INDEX_WIDTH * 32;
+    // the depth slices cover [CLUSTER_NEAR, CLUSTER_FAR] blocks. Slice 0 also covers everything closer, nothing is lit past the last slice
+    constexpr float CLUSTER_NEAR = 1.0f;
+    constexpr float CLUSTER_FAR = 256.0f;
+    
+    /**
+     * One light of the PointLights uniform block in chunk.frag, std140 layout
+     */
+    struct point_light {
+        // xyz is the light's world position, w is its radius in blocks
+        blt::vec4 position;
+        // rgb is the light's color, a is its intensity
+        blt::vec4 color;
+    };
+    static_assert(sizeof(point_light) == sizeof(float) * 8, "point_light must match the std140 PointLight struct");
+    
+    struct cluster_stats {
+        // lights assigned this frame, anything over MAX_POINT_LIGHTS is ignored
+        size_t lights = 0;
+        size_t indices = 0;
+        size_t max_per_cluster = 0;
+        // indices which didn't fit into MAX_CLUSTER_INDICES
+        size_t dropped = 0;
+    };
+    
+    class cluster_grid {
+        private:
+            // view space bounds of every cluster, indexed by (z * CLUSTER_Y + y) * CLUSTER_X + x.
+            // kept as separate arrays so 4 neighbouring x tiles can be tested against a light at once
+            std::vector<float> min_x, max_x, min_y, max_y, min_z, max_z;
+            float x_scale = 0, y_scale = 0;
+            
+            // (cluster, light) for every overlap found, sorted into the index list afterwards
+            std::vector<std::pair<unsigned int, unsigned short>> overlaps;
+            // offset and count into indices for every cluster, laid out like the grid texture
+            std::vector<unsigned short> grid;
+            std::vector<unsigned short> indices;
+            cluster_stats stats;
+        public:
+            cluster_grid();
+            
+            /**
+             * @return the depth slice holding this view space depth, unclamped
+             */
+            static int getSlice(float depth);
+            
+            /**
+             * @return the view space depth the slice starts at
+             */
+            static float getSliceDepth(int slice);
+            
+            /**
+             * slice = floor(log(depth) * scale + bias), for the shader
+             */
+            static float getSliceScale();
+            
+            static float getSliceBias();
+            
+            /**
+             * Rebuilds the cluster bounds if the projection changed.
+             * @param projection_x projection matrix [0][0], the cotangent of half the horizontal fov
+             * @param projection_y projection matrix [1][1], the cotangent of half the vertical fov
+             */
+            void setProjection(float projection_x, float projection_y);
+            
+            /**
+             * Assigns the first MAX_POINT_LIGHTS lights to every cluster they touch, rebuilding the grid and index list
+             * @param view the view matrix the frame is drawn with
+             */
+            void assign(const std::vector<point_light>& lights, const blt::mat4x4& view);
+            
+            [[nodiscard]] inline const std::vector<unsigned short>& getGrid() const {
+                return grid;
+            }
+            
+            /**
+             * @return every cluster's lights back to back, padded with zeros to whole rows of CLUSTER_INDEX_WIDTH
+             */
+            [[nodiscard]] inline const std::vector<unsigned short>& getIndices() const {
+                return indices;
+            }
+            
+            [[nodiscard]] inline const cluster_stats& getStats() const {
+                return stats;
+            }
+    };
+    
+}
+
+#endif //FINALPROJECT_CLUSTERS_H
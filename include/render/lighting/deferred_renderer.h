@@ -8,6 +8,80 @@
 #define FINALPROJECT_DEFERRED_RENDERER_H
 
 #include <render/textures.h>
+#include <render/fbo.h>
+#include <render/gl.h>
 
+namespace fp {
+    
+    // texture units the G-buffer is read from in the lighting pass, after the palette and the cluster textures
+    constexpr int GBUFFER_ALBEDO_UNIT = 3;
+    constexpr int GBUFFER_NORMAL_UNIT = 4;
+    constexpr int GBUFFER_DEPTH_UNIT = 5;
+    
+    /**
+     * Opaque and cutout chunks are drawn once into the G-buffer, then a single full screen pass lights every pixel exactly once.
+     * Cave terrain is drawn over itself many times, this way the cost of lighting only depends on the screen size.
+     * Translucent chunks are still drawn forward afterwards, the lighting pass writes the G-buffer's depth back for them.
+     *
+     * The G-buffer:
+     * - albedo: RGBA8, the palette color with mipmapping already applied
+     * - normal: RGBA8, the face normal packed into 0-1 in rgb and the voxel light level / MAX_LIGHT in a
+     * - depth: 24 bit depth, world positions are rebuilt from it
+     */
+    class deferred_renderer {
+        private:
+            shader* lighting;
+            FBO* gbuffer = nullptr;
+            texture::gl_buffer_texture* albedo = nullptr;
+            texture::gl_buffer_texture* normal = nullptr;
+            texture::gl_buffer_texture* depth = nullptr;
+            // the full screen triangle is built from gl_VertexID, but a VAO still has to be bound to draw
+            unsigned int empty_vao = 0;
+            
+            void createTargets(int width, int height);
+            
+            void deleteTargets();
+        public:
+            /**
+             * Must be called on the GL thread
+             * @param lighting the lighting pass shader, chunk.frag built with DEFERRED_LIGHTING (see getDeferredLightingDefines())
+             */
+            deferred_renderer(shader* lighting, int width, int height);
+            
+            deferred_renderer(const deferred_renderer& copy) = delete;
+            
+            /**
+             * Recreates the G-buffer at the new size, called from the window's resize listener
+             */
+            void resize(int width, int height);
+            
+            /**
+             * Binds and clears the G-buffer, the deferred chunk shaders draw into it until endGeometry()
+             */
+            void beginGeometry() const;
+            
+            /**
+             * Switches back to the default framebuffer
+             */
+            static void endGeometry();
+            
+            /**
+             * Draws the lighting pass over the default framebuffer. Sky pixels are left alone, everything else gets its G-buffer depth back.
+             * The point light clusters must already be bound if the shader uses them.
+             */
+            void light() const;
+            
+            [[nodiscard]] inline int getWidth() const {
+                return albedo->getWidth();
+            }
+            
+            [[nodiscard]] inline int getHeight() const {
+                return albedo->getHeight();
+            }
+            
+            ~deferred_renderer();
+    };
+    
+}
 
 #endif //FINALPROJECT_DEFERRED_RENDERER_H
@@ -0,0 +1,93 @@
+/*
+ * Created by Brett on 19/10/26.
+ * Licensed under GNU General Public License V3.0
+ * See LICENSE file for license detail
+ */
+
+#ifndef FINALPROJECT_OCCLUSION_H
+#define FINALPROJECT_OCCLUSION_H
+
+#include <blt/math/math.h>
+#include <vector>
+
+/*
+ * Software occlusion culling. The solid slabs of the chunks around the camera (see generator::findOccluders) are rasterized into a small
+ * depth buffer on the CPU, then every chunk's bounding box is tested against it before any draw is issued.
+ * Occluders write the farthest depth their front faces reach inside each pixel they cover completely, and boxes are tested with their
+ * nearest depth over every pixel their screen rectangle touches, so a box is only ever culled if it is completely behind occluders.
+ * Needs no GL context, the bench runs it headless.
+ */
+
+namespace fp {
+    
+    constexpr int OCCLUSION_WIDTH = 256;
+    constexpr int OCCLUSION_HEIGHT = 128;
+    // anything closer than this (clip w) can't be rasterized, occluders crossing it are skipped and boxes crossing it are always visible
+    constexpr float OCCLUSION_NEAR = 0.1f;
+    
+    struct occlusion_stats {
+        size_t occluders = 0;
+        size_t polygons = 0;
+        size_t tested = 0;
+        // boxes entirely off the screen
+        size_t outside = 0;
+        // boxes hidden behind occluders
+        size_t occluded = 0;
+    };
+    
+    class occlusion_buffer {
+        private:
+            // clip space w (view depth) of the nearest occluder covering each pixel, row 0 is the bottom of the screen
+            std::vector<float> depth;
+            // rows of the projection view matrix
+            float pvm[4][4]{};
+            occlusion_stats stats;
+            
+            /**
+             * @return x, y in pixels and the clip w of the point
+             */
+            [[nodiscard]] blt::vec3 project(float x, float y, float z) const;
+            
+            // 1 / clip w of a plane as x * pixel x + y * pixel y + c
+            struct depth_plane {
+                float x, y, c;
+            };
+            
+            /**
+             * Writes into every pixel completely covered by the convex counter-clockwise polygon the farthest depth the box's front faces
+             * reach inside that pixel, unless the pixel already holds something nearer
+             * @param count at most 8 points
+             * @param planes the box's front faces, at most 3
+             * @param farthest depth of the box's farthest corner, nothing is written past it
+             */
+            void rasterizePolygon(const blt::vec3* points, int count, const depth_plane* planes, int plane_count, float farthest);
+        public:
+            occlusion_buffer();
+            
+            /**
+             * Clears the buffer and stats for a new frame
+             */
+            void begin(const blt::mat4x4& projection_view);
+            
+            /**
+             * Rasterizes the outline of the box. The box must be fully opaque
+             */
+            void addOccluder(const blt::vec3& min, const blt::vec3& max);
+            
+            /**
+             * @return false if the box is off the screen or completely hidden by the occluders added so far
+             */
+            bool isVisible(const blt::vec3& min, const blt::vec3& max);
+            
+            [[nodiscard]] inline const occlusion_stats& getStats() const {
+                return stats;
+            }
+            
+            [[nodiscard]] inline const std::vector<float>& getDepth() const {
+                return depth;
+            }
+    };
+    
+}
+
+#endif //FINALPROJECT_OCCLUSION_H
@@ -0,0 +1,168 @@
+/*
+ * Created by Brett on 19/10/26.
+ * Licensed under GNU General Public License V3.0
+ * See LICENSE file for license detail
+ */
+
+#ifndef FINALPROJECT_OCCLUSION_QUERIES_H
+#define FINALPROJECT_OCCLUSION_QUERIES_H
+
+#include <render/gl.h>
+#include <vector>
+
+/*
+ * GPU occlusion culling. After the opaque passes every chunk's bounding box is drawn against the depth buffer inside a
+ * GL_ANY_SAMPLES_PASSED query, with color and depth writes off. The results are only read back the next frame once they are available,
+ * so the CPU never waits on the GPU. Chunks whose result is still in flight fall back to their last known state, on desktop GL they are
+ * drawn with conditional rendering instead which lets the GPU skip them itself once the query is done.
+ */
+
+#ifndef __EMSCRIPTEN__
+    // GLES and WebGL2 have no conditional rendering
+    #define FP_CONDITIONAL_RENDER
+#endif
+
+namespace fp {
+    
+    // hidden results in a row before a chunk stops being drawn. A single visible result brings it straight back
+    constexpr int QUERY_HYSTERESIS = 4;
+    // queries are generated this many at a time when the pool runs dry
+    constexpr int QUERY_BATCH = 64;
+    // blocks the query boxes are grown by on every side, multiplied by the chunk's LOD step (1 << lod). Faces on the chunk's edge lie
+    // exactly on its bounds, an unpadded box would z-fight with them and a chunk only showing those faces would keep reporting itself hidden.
+    // Depth precision falls off with distance, and coarser rings are further away: at the far plane a 24 bit buffer only separates
+    // depths about 2.5 blocks apart. Scaling with the step keeps the padding ahead of that, 4 blocks for the coarsest boxes
+    constexpr float QUERY_BOX_PADDING = 0.5f;
+    
+    struct query_stats {
+        // query objects owned by chunks
+        size_t live = 0;
+        // query objects waiting in the pool
+        size_t pooled = 0;
+        // boxes drawn this frame
+        size_t issued = 0;
+        // chunks skipped this frame
+        size_t hidden = 0;
+        // chunks left to the GPU this frame, see FP_CONDITIONAL_RENDER
+        size_t conditional = 0;
+    };
+    
+    class query_pool;
+    
+    /**
+     * A chunk's occlusion query and what the results so far say about it. Holds no GL objects until the first box is drawn,
+     * the query is handed back to its pool once the chunk is deleted.
+     */
+    class chunk_query {
+            friend query_pool;
+        private:
+            query_pool* pool = nullptr;
+            unsigned int id = 0;
+            // the box has been drawn, the result isn't read yet
+            bool pending = false;
+            bool conditional = false;
+            // visible until this many hidden results in a row come back
+            int visible_for = QUERY_HYSTERESIS;
+            // frame this chunk last passed culling on, one which wasn't drawn last frame has no useful results
+            size_t last_frame = 0;
+        public:
+            chunk_query() = default;
+            
+            chunk_query(const chunk_query& copy) = delete;
+            
+            /**
+             * Reads the last result if the GPU is done with it. Must be called on the GL thread once per frame the chunk passes culling
+             */
+            void poll(query_pool& queries);
+            
+            /**
+             * The camera is inside the box, it can't be tested. Keeps the chunk visible without issuing a query
+             */
+            inline void markVisible() {
+                visible_for = QUERY_HYSTERESIS;
+                conditional = false;
+            }
+            
+            [[nodiscard]] inline bool isVisible() const {
+                return visible_for > 0;
+            }
+            
+            /**
+             * @return true if the chunk is believed hidden but should be drawn with conditional rendering on its pending query
+             */
+            [[nodiscard]] inline bool isConditional() const {
+                return conditional;
+            }
+            
+            [[nodiscard]] inline bool isPending() const {
+                return pending;
+            }
+            
+            ~chunk_query();
+    };
+    
+    /**
+     * Owns the query objects and the box shader. Must only be used on the GL thread
+     */
+    class query_pool {
+            friend chunk_query;
+        private:
+            std::vector<unsigned int> free_queries;
+            shader box_shader;
+            uniform_handle box_min;
+            uniform_handle box_max;
+            // the box is built from gl_VertexID, but a VAO still has to be bound to draw
+            unsigned int empty_vao = 0;
+            size_t frame = 0;
+            query_stats stats;
+            
+            unsigned int acquire();
+            
+            void release(unsigned int query);
+        public:
+            query_pool();
+            
+            query_pool(const query_pool& copy) = delete;
+            
+            /**
+             * Resets the per frame stats, called before any chunk is polled
+             */
+            void beginFrame();
+            
+            /**
+             * Sets up the state for drawing boxes: the box shader, depth testing without depth or color writes and no culling.
+             * The depth buffer the boxes are tested against must be bound
+             */
+            void beginBoxes();
+            
+            /**
+             * Draws the box inside the chunk's query. The query must not be pending
+             */
+            void drawBox(chunk_query& query, const blt::vec3& min, const blt::vec3& max);
+            
+            /**
+             * Restores the state beginBoxes() changed
+             */
+            static void endBoxes();
+            
+            /**
+             * Draws after this are skipped by the GPU if the query's box was hidden. Does nothing unless the query is conditional
+             */
+            static void beginConditional(const chunk_query& query);
+            
+            static void endConditional(const chunk_query& query);
+            
+            inline void countHidden() {
+                stats.hidden++;
+            }
+            
+            [[nodiscard]] inline const query_stats& getStats() const {
+                return stats;
+            }
+            
+            ~query_pool();
+    };
+    
+}
+
+#endif //FINALPROJECT_OCCLUSION_QUERIES_H
@@ -0,0 +1,116 @@
+/*
+ * Created by Brett on 19/10/26.
+ * Licensed under GNU General Public License V3.0
+ * See LICENSE file for license detail
+ */
+
+#ifndef FINALPROJECT_TEXTURE_CACHE_H
+#define FINALPROJECT_TEXTURE_CACHE_H
+
+#include <string>
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+#include <algorithm>
+#include <utility>
+
+namespace fp::texture {
+    
+    class file_texture;
+    
+    constexpr std::uint64_t HASH_SEED = 0xcbf29ce484222325ULL;
+    
+    /**
+     * FNV-1a, used to key the on-disk caches. We only need to detect changes, not resist tampering.
+     * Start from HASH_SEED and feed every input that should invalidate the cache.
+     */
+    inline void hashBytes(std::uint64_t& hash, const void* data, size_t size) {
+        auto* bytes = (const unsigned char*) data;
+        for (size_t i = 0; i < size; i++) {
+            hash ^= bytes[i];
+            hash *= 0x100000001b3ULL;
+        }
+    }
+    
+    /**
+     * On-disk copy of the texture palette after every texture has been decoded, resized and mipmapped.
+     * Decoding the source images dominates startup time, so as long as none of the sources (or TEXTURE_SIZE) have changed
+     * the palette is uploaded straight out of the memory mapped cache file instead.
+     *
+     * File layout:
+     *  - header (magic, version, key, texture size, mipmap levels, layer count)
+     *  - layer names, each as a 32-bit length followed by the characters
+     *  - padding up to a 16 byte boundary
+     *  - RGBA pixels for each layer, every mipmap level stored largest to smallest
+     */
+    class palette_cache {
+        private:
+            std::string m_Path;
+            int m_TextureSize;
+            int m_Levels;
+            // hash of the cache settings and the contents of every source file
+            std::uint64_t m_Key = 0;
+            
+            unsigned char* m_Data = nullptr;
+            size_t m_Size = 0;
+            // true if m_Data was mapped instead of read into memory
+            bool m_Mapped = false;
+            
+            std::vector<std::string> m_Names;
+            // offset of each layer's first mipmap level in m_Data
+            std::vector<size_t> m_LayerOffsets;
+            
+            void release();
+        public:
+            palette_cache(std::string path, int texture_size, int levels):
+                    m_Path(std::move(path)), m_TextureSize(texture_size), m_Levels(levels) {}
+            
+            palette_cache(const palette_cache& copy) = delete;
+            
+            /**
+             * Hashes the sources the palette will be built from. Must be called before load() or save()
+             * @param sources textures in the order they were registered
+             */
+            void computeKey(const std::vector<file_texture*>& sources);
+            
+            /**
+             * Maps the cache file into memory.
+             * @return false if the cache doesn't exist or is stale, in which case the palette must be rebuilt from the sources
+             */
+            bool load();
+            
+            /**
+             * Writes the decoded textures out to the cache file. The textures must already contain all of their mipmap levels.
+             */
+            void save(const std::vector<file_texture*>& textures) const;
+            
+            [[nodiscard]] inline const std::vector<std::string>& getNames() const {
+                return m_Names;
+            }
+            
+            [[nodiscard]] inline int getLevels() const {
+                return m_Levels;
+            }
+            
+            [[nodiscard]] inline bool isLoaded() const {
+                return m_Data != nullptr;
+            }
+            
+            [[nodiscard]] const unsigned char* getLevel(int layer, int level) const;
+            
+            /**
+             * @return size in bytes of one RGBA mipmap level
+             */
+            static inline size_t levelSize(int texture_size, int level) {
+                auto size = (size_t) std::max(1, texture_size >> level);
+                return size * size * 4;
+            }
+            
+            ~palette_cache() {
+                release();
+            }
+    };
+    
+}
+
+#endif //FINALPROJECT_TEXTURE_CACHE_H
@@ -13,8 +13,10 @@
 #include <util/settings.h>
 #include <phmap.h>
 #include <vector>
+#include <algorithm>
 #include <render/gl.h>
 #include "stb/stb_image_resize.h"
+#include <render/texture_cache.h>
 
 namespace fp::texture {
     
@@ -24,6 +26,8 @@ namespace fp::texture {
             std::string m_Path;
             int width = 0, height = 0, channels = 0;
             unsigned char* m_Data = nullptr;
+            // levels 1+, level 0 is m_Data
+            std::vector<std::vector<unsigned char>> m_Mipmaps;
         public:
             /**
              * @param path path to the texture file
@@ -40,6 +44,8 @@ namespace fp::texture {
                         texture->m_Path.c_str(), &texture->width, &texture->height,
                         &texture->channels, channel_count
                 );
+                if (!texture->m_Data)
+                    BLT_WARN("Unable to load texture %s (%s), it will use the missing texture", texture->m_Path.c_str(), stbi_failure_reason());
                 texture->channels = channel_count;
                 return texture;
             }
@@ -47,7 +53,7 @@ namespace fp::texture {
             static file_texture* resize(
                     file_texture* texture, int target_width, int target_height
             ) {
-                if (target_width == texture->width && target_height == texture->height)
+                if (!texture->m_Data || (target_width == texture->width && target_height == texture->height))
                     return texture;
                 // since we will be replacing the loaded data pointer, is it wise to use the allocator
                 // that matches with what stb image uses, which is malloc, since we unload with stbi_image_free -> (free)
@@ -76,10 +82,78 @@ namespace fp::texture {
                 return texture;
             }
             
+            /**
+             * Builds the mipmap chain on the CPU using a 2x2 box filter. This lets the chain be baked into the palette cache
+             * instead of being regenerated by the GPU every launch. Requires a square, 4 channel texture.
+             * @param levels total number of levels including the base level
+             */
+            void generateMipmaps(int levels) {
+                m_Mipmaps.clear();
+                if (!m_Data)
+                    return;
+                const unsigned char* previous = m_Data;
+                int previous_size = width;
+                for (int level = 1; level < levels; level++) {
+                    int size = std::max(1, previous_size / 2);
+                    std::vector<unsigned char> current((size_t) size * size * 4);
+                    for (int y = 0; y < size; y++) {
+                        for (int x = 0; x < size; x++) {
+                            // clamp so a 1 pixel wide level still reads from inside the previous level
+                            int x0 = std::min(x * 2, previous_size - 1), x1 = std::min(x * 2 + 1, previous_size - 1);
+                            int y0 = std::min(y * 2, previous_size - 1), y1 = std::min(y * 2 + 1, previous_size - 1);
+                            for (int c = 0; c < 4; c++) {
+                                int sum = previous[(y0 * previous_size + x0) * 4 + c] + previous[(y0 * previous_size + x1) * 4 + c] +
+                                          previous[(y1 * previous_size + x0) * 4 + c] + previous[(y1 * previous_size + x1) * 4 + c];
+                                current[(y * size + x) * 4 + c] = (unsigned char) ((sum + 2) / 4);
+                            }
+                        }
+                    }
+                    m_Mipmaps.push_back(std::move(current));
+                    previous = m_Mipmaps.back().data();
+                    previous_size = size;
+                }
+            }
+            
             unsigned char* data() {
                 return m_Data;
             }
             
+            /**
+             * @return pixel data of the mipmap level, 0 being the full size texture. Null if the texture failed to load
+             * or the level was never generated, see getMissingLevel()
+             */
+            const unsigned char* level(int level) {
+                if (level > (int) m_Mipmaps.size())
+                    return nullptr;
+                return level == 0 ? m_Data : m_Mipmaps[level - 1].data();
+            }
+            
+            /**
+             * The texture drawn in place of one that couldn't be loaded, a magenta and black checkerboard of 2x2 squares.
+             * Every mip level keeps the squares so it still stands out in the distance.
+             * @param size width of the level in pixels
+             * @return 4 channel pixel data
+             */
+            static std::vector<unsigned char> getMissingLevel(int size) {
+                std::vector<unsigned char> pixels((size_t) size * size * 4);
+                const int square = std::max(1, size / 2);
+                for (int y = 0; y < size; y++) {
+                    for (int x = 0; x < size; x++) {
+                        const bool magenta = ((x / square) + (y / square)) % 2 == 0;
+                        auto* pixel = &pixels[((size_t) y * size + x) * 4];
+                        pixel[0] = magenta ? 255 : 0;
+                        pixel[1] = 0;
+                        pixel[2] = magenta ? 255 : 0;
+                        pixel[3] = 255;
+                    }
+                }
+                return pixels;
+            }
+            
+            [[nodiscard]] int getLevels() const {
+                return (int) m_Mipmaps.size() + 1;
+            }
+            
             [[nodiscard]] int getChannels() const {
                 return channels;
             }
@@ -96,6 +170,10 @@ namespace fp::texture {
                 return m_Name;
             }
             
+            [[nodiscard]] const std::string& getPath() {
+                return m_Path;
+            }
+            
             ~file_texture() {
                 stbi_image_free(m_Data);
             }
@@ -158,11 +236,14 @@ namespace fp::texture {
     
     struct gl_texture2D : public gl_texture {
         public:
-            gl_texture2D(int width, int height, GLint colorMode = GL_RGBA):
+            /**
+             * @param levels mipmap levels to allocate, 0 uses the MIPMAP_LEVELS setting
+             */
+            gl_texture2D(int width, int height, GLint colorMode = GL_RGBA, int levels = 0):
                     gl_texture(width, height, GL_TEXTURE_2D, colorMode) {
                 bind();
                 glTexStorage2D(
-                        textureBindType, std::stoi(fp::settings::get("MIPMAP_LEVELS")), colorMode,
+                        textureBindType, levels > 0 ? levels : std::stoi(fp::settings::get("MIPMAP_LEVELS")), colorMode,
                         width, height
                 );
             }
@@ -204,11 +285,11 @@ namespace fp::texture {
         protected:
             int m_layers;
         public:
-            gl_texture2D_array(int width, int height, int layers, GLint colorMode = GL_RGBA8):
+            gl_texture2D_array(int width, int height, int layers, GLint colorMode = GL_RGBA8, int levels = 6):
                     gl_texture(width, height, GL_TEXTURE_2D_ARRAY, colorMode), m_layers(layers) {
                 bind();
                 // 6+ mipmaps is about where I stop noticing any difference (size is 4x4 pixels, so that makes sense)
-                glTexStorage3D(textureBindType, 6, colorMode, width, height, layers);
+                glTexStorage3D(textureBindType, levels, colorMode, width, height, layers);
                 BLT_DEBUG("Creating 2D Texture Array with ID: %d", textureID);
             }
             
@@ -230,27 +311,28 @@ namespace fp::texture {
             }
     };
     
+    /**
+     * Render target texture, attach it to a framebuffer with FBO::attach(). Storage is immutable, resizing means creating a new one
+     */
     class gl_buffer_texture : public gl_texture2D {
-        private:
-        
         public:
-            // make sure a framebuffer is bound before constructing!
-            gl_buffer_texture(
-                    int width, int height, GLint format = GL_RGB32F,
-                    GLint colorAttachment = GL_COLOR_ATTACHMENT0
-            ): gl_texture2D(width, height, format) {
+            explicit gl_buffer_texture(int width, int height, GLint format = GL_RGB32F): gl_texture2D(width, height, format, 1) {
                 bind();
                 // no mipmaping and no interpolation to position textures!
                 glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
                 glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-                //
-                glFramebufferTexture2D(
-                        GL_FRAMEBUFFER, colorAttachment, GL_TEXTURE_2D, this->textureID, 0
-                );
-                
+                glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+                glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+                unbind();
+            }
+            
+            [[nodiscard]] inline int getWidth() const {
+                return m_width;
+            }
+            
+            [[nodiscard]] inline int getHeight() const {
+                return m_height;
             }
-        
-        
     };
     
     typedef int texture_index;
@@ -264,6 +346,8 @@ namespace fp::texture {
             static constexpr int MAX_ARRAY_LAYERS = 256;
             
             gl_texture2D_array* texture_array = nullptr;
+            // when loaded the textures are uploaded straight from the cache, otherwise the cache is rewritten from the textures
+            palette_cache* cache = nullptr;
             
             phmap::flat_hash_map<std::string, negDInt> textureIndices;
             std::vector<file_texture*> textures {};
@@ -271,20 +355,62 @@ namespace fp::texture {
         public:
             palette() = default;
             
+            /**
+             * 6+ mipmaps is about where I stop noticing any difference, but there can't be more levels than the texture size allows
+             */
+            static int getMipmapLevels(int texture_size) {
+                int levels = 1;
+                while (levels < 6 && (texture_size >> levels) > 0)
+                    levels++;
+                return levels;
+            }
+            
+            /**
+             * @param palette_cache cache to use, the palette takes ownership of it.
+             * If the cache is loaded its layers replace any registered textures.
+             */
+            void setCache(palette_cache* palette_cache) {
+                delete cache;
+                cache = palette_cache;
+                if (!cache->isLoaded())
+                    return;
+                textureIndices.clear();
+                const auto& names = cache->getNames();
+                for (int i = 0; i < (int) names.size(); i++)
+                    textureIndices[names[i]].i = i;
+            }
+            
             void generateGLTexture() {
                 auto texture_size = std::stoi(fp::settings::get("TEXTURE_SIZE"));
-                texture_array = new gl_texture2D_array(
-                        texture_size, texture_size, (int) textures.size());
+                auto levels = getMipmapLevels(texture_size);
+                bool from_cache = cache && cache->isLoaded();
+                auto layers = from_cache ? (int) cache->getNames().size() : (int) textures.size();
+                texture_array = new gl_texture2D_array(texture_size, texture_size, layers, GL_RGBA8, levels);
                 texture_array->bind();
-                for (const auto t : textures) {
-                    texture_array->upload(
-                            t->data(), textureIndices[t->getName()].i,
-                            t->getChannels() == 4 ? GL_RGBA : GL_RGB
-                    );
-                    BLT_TRACE("Loaded texture %s", t->getName().c_str());
+                // every mip level is computed on the CPU, so the GPU never has to generate them
+                for (int layer = 0; layer < layers; layer++) {
+                    bool warned = false;
+                    for (int level = 0; level < levels; level++) {
+                        auto size = std::max(1, texture_size >> level);
+                        const auto* data = from_cache ? cache->getLevel(layer, level) : textures[layer]->level(level);
+                        if (data) {
+                            texture_array->upload((void*) data, layer, GL_RGBA, level, 0, 0, size, size);
+                            continue;
+                        }
+                        if (!warned)
+                            BLT_WARN("Texture %s is missing mipmap level %d, using the missing texture", textures[layer]->getName().c_str(), level);
+                        warned = true;
+                        auto missing = file_texture::getMissingLevel(size);
+                        texture_array->upload(missing.data(), layer, GL_RGBA, level, 0, 0, size, size);
+                    }
                 }
+                BLT_TRACE("Uploaded %d textures (%d mipmap levels)", layers, levels);
                 texture_array->setDefaults();
-                texture_array->generateMipmaps();
+                if (cache && !from_cache)
+                    cache->save(textures);
+                // the pixels now live on the GPU
+                delete cache;
+                cache = nullptr;
             }
             
             void registerTexture(file_texture* texture) {
@@ -308,9 +434,9 @@ namespace fp::texture {
                 for (auto* t : textures)
                     delete t;
                 delete texture_array;
+                delete cache;
             };
-    };
-    
+    };    
     
 }
 
@@ -7,11 +7,23 @@
 #ifndef FINALPROJECT_DEBUG_H
 #define FINALPROJECT_DEBUG_H
 
+namespace fp {
+    class world;
+}
+
 namespace fp::debug {
     void enable();
     void disable();
     void toggle();
-    void render();
+    /**
+     * @param world the world statistics are read from. The debug keys (L places a lamp) only work while the screen is open
+     */
+    void render(fp::world& world);
+    
+    /**
+     * @return true if the chunk bounds overlay is enabled (F4 while the debug screen is open)
+     */
+    bool showChunkBounds();
 }
 
 #endif //FINALPROJECT_DEBUG_H
@@ -0,0 +1,58 @@
+/*
+ * Created by Brett on 19/10/26.
+ * Licensed under GNU General Public License V3.0
+ * See LICENSE file for license detail
+ */
+
+// internal types used by graphics to prevent cluttering of the main graphics.cpp file. Do not include elsewhere.
+#ifndef FINALPROJECT_DEBUG_GEOMETRY_H
+#define FINALPROJECT_DEBUG_GEOMETRY_H
+
+#include <blt/math/vectors.h>
+#include <vector>
+
+namespace fp::graphics {
+    
+    // layout must match debug.vert
+    struct debug_vertex {
+        float x, y, z;
+        float r, g, b, a;
+    };
+    static_assert(sizeof(debug_vertex) == sizeof(float) * 7, "debug vertices must be tightly packed to match the debug VAO");
+    
+    enum debug_primitive {
+        DEBUG_LINES = 0,
+        DEBUG_TRIANGLES = 1,
+        DEBUG_POINTS = 2
+    };
+    constexpr int DEBUG_PRIMITIVE_COUNT = 3;
+    
+    /**
+     * Every debug primitive requested this frame. One list per primitive type, split into depth tested / always on top.
+     * They are appended back to back into a single upload and each non-empty list is drawn with a single call.
+     */
+    struct debug_batch {
+        // [primitive][depth tested]
+        std::vector<debug_vertex> vertices[DEBUG_PRIMITIVE_COUNT][2];
+        // 2D lines in screen coordinates, drawn after everything else with the orthographic matrix
+        std::vector<debug_vertex> screen_lines;
+        
+        inline std::vector<debug_vertex>& get(debug_primitive primitive, bool depth_test) {
+            return vertices[primitive][depth_test];
+        }
+        
+        inline void push(debug_primitive primitive, bool depth_test, const blt::vec3& pos, const blt::vec4& color) {
+            vertices[primitive][depth_test].push_back({pos.x(), pos.y(), pos.z(), color.x(), color.y(), color.z(), color[3]});
+        }
+        
+        inline void clear() {
+            for (auto& primitive : vertices)
+                for (auto& list : primitive)
+                    list.clear();
+            screen_lines.clear();
+        }
+    };
+    
+}
+
+#endif //FINALPROJECT_DEBUG_GEOMETRY_H
@@ -22,7 +22,32 @@
  */
 namespace fp::graphics {
     
-    void drawPlane(const blt::vec4& plane, const blt::vec3& color);
+    /*
+     * Debug geometry. Everything requested during a frame is batched into one buffer, uploaded once then drawn with a single call
+     * per primitive type. Depth tested geometry is hidden behind the world, everything else is drawn on top of it.
+     */
+    
+    void drawLine(const blt::vec3& from, const blt::vec3& to, const blt::vec4& color, bool depth_test = true);
+    
+    void drawAABB(const blt::vec3& min, const blt::vec3& max, const blt::vec4& color, bool depth_test = true);
+    
+    /**
+     * Draws a line over everything in screen coordinates, (0, 0) is the top left like the text
+     */
+    void drawLine2D(float x1, float y1, float x2, float y2, const blt::vec4& color);
+    
+    void drawPoint(const blt::vec3& pos, const blt::vec4& color, bool depth_test = true);
+    
+    /**
+     * Draws a size * 2 wide, half transparent square of the plane (ax + by + cz + d = 0) centered on the point closest to the origin
+     */
+    void drawPlane(const blt::vec4& plane, const blt::vec3& color, float size = 10, bool depth_test = true);
+    
+    /**
+     * Loads the font and any cached glyphs. Doesn't touch GL so it can run on a worker while the window is being created.
+     * init() will call this itself if it hasn't been run yet.
+     */
+    void loadFont();
     
     void init(renderer& renderer);
     
@@ -7,7 +7,8 @@
 #define FINAL_PROJECT_WINDOW_H
 
 #ifndef FP_FAR_PLANE
-    #define FP_FAR_PLANE 1000.0f
+    // the outermost LOD ring reaches VIEW_DISTANCE * 2^MAX_LOD_LEVEL chunks away
+    #define FP_FAR_PLANE 2048.0f
     #define FP_NEAR_PLANE 0.1f
 #endif
 
@@ -22,6 +23,7 @@
 #endif
 #include <GLFW/glfw3.h>
 #include <blt/math/math.h>
+#include <functional>
 
 namespace fp::window {
     /**
@@ -61,6 +63,15 @@ namespace fp::window {
     
     const blt::mat4x4& getPerspectiveMatrix();
     
+    // size of the framebuffer in pixels
+    int getWidth();
+    int getHeight();
+    
+    /**
+     * The listener is called with the new framebuffer size every time the window is resized, after the viewport is updated
+     */
+    void addResizeListener(const std::function<void(int, int)>& listener);
+    
     void setFOV(float new_fov);
 }
 
@@ -4,20 +4,153 @@
 #version 300 es
 precision mediump float;
 
+// DEFERRED draws the G-buffer instead of lit colors, DEFERRED_LIGHTING turns this into the full screen lighting pass (with deferred.vert).
+// see fp::deferred_renderer
+
+#ifdef DEFERRED
+layout (location = 0) out vec4 FragColor;
+// packed normal in rgb, light level / MAX_LIGHT in a
+layout (location = 1) out vec4 FragNormal;
+#else
 out vec4 FragColor;
+#endif
+
+#ifdef DEFERRED_LIGHTING
+in vec2 screen_uv;
+
+layout (std140) uniform StandardMatrices
+{
+    mat4 projection;
+    mat4 view;
+    // projection view matrix
+    mat4 pvm;
+    // orthographic projection matrix
+    mat4 orthographic;
+};
 
+uniform mediump sampler2D gbuffer_albedo;
+uniform mediump sampler2D gbuffer_normal;
+uniform highp sampler2D gbuffer_depth;
+#else
 in vec2 uv;
 in float index;
+in float light;
 
 uniform mediump sampler2DArray texturep_palette;
 
+#if defined(CLUSTERED_LIGHTS) || defined(DEFERRED)
+in highp vec3 world_position;
+
+highp vec3 faceNormal() {
+    // faces are flat so the derivatives give the face normal without another vertex attribute
+    return normalize(cross(dFdx(world_position), dFdy(world_position)));
+}
+#endif
+#ifdef CLUSTERED_LIGHTS
+in highp float view_depth;
+#endif
+#endif
+
+#ifdef CLUSTERED_LIGHTS
+// point lights culled per cluster on the CPU, see fp::light_clusters. CLUSTER_X/Y/Z and MAX_POINT_LIGHTS come from getChunkShaderDefines()
+struct PointLight {
+    // xyz is the position, w the radius
+    vec4 position;
+    // rgb is the color, a the intensity
+    vec4 color;
+};
+
+layout (std140) uniform PointLights
+{
+    // xy is the viewport size, zw the scale and bias turning log(depth) into a depth slice
+    vec4 cluster_params;
+    PointLight point_lights[MAX_POINT_LIGHTS];
+};
+
+// (offset, count) of every cluster, x is the tile (y * CLUSTER_X + x) and y the depth slice
+uniform highp usampler2D cluster_grid;
+// the light indices of every cluster back to back, CLUSTER_INDEX_WIDTH per row
+uniform highp usampler2D cluster_indices;
+
+vec3 clusteredLight(highp vec3 position, highp float depth, highp vec3 normal) {
+    int slice = max(int(floor(log(depth) * cluster_params.z + cluster_params.w)), 0);
+    if (slice >= CLUSTER_Z)
+        return vec3(0.0);
+    ivec2 tile = clamp(ivec2(gl_FragCoord.xy / cluster_params.xy * vec2(CLUSTER_X, CLUSTER_Y)), ivec2(0), ivec2(CLUSTER_X - 1, CLUSTER_Y - 1));
+    uvec2 cluster = texelFetch(cluster_grid, ivec2(tile.y * CLUSTER_X + tile.x, slice), 0).xy;
+
+    vec3 result = vec3(0.0);
+    for (uint i = 0u; i < cluster.y; i++) {
+        int offset = int(cluster.x + i);
+        int light_index = int(texelFetch(cluster_indices, ivec2(offset % CLUSTER_INDEX_WIDTH, offset / CLUSTER_INDEX_WIDTH), 0).x);
+        PointLight point = point_lights[light_index];
+        highp vec3 to_light = point.position.xyz - position;
+        float light_distance = length(to_light);
+        if (light_distance >= point.position.w)
+            continue;
+        float falloff = 1.0 - light_distance / point.position.w;
+        result += point.color.rgb * point.color.a * falloff * falloff * max(dot(normal, to_light / light_distance), 0.0);
+    }
+    return result;
+}
+#endif
+
+float voxelLight(float level) {
+    // every level below full brightness is 20% darker than the last, never quite reaching black
+    return 0.1 + 0.9 * pow(0.8, float(MAX_LIGHT) - level);
+}
+
+#ifdef DEFERRED_LIGHTING
+void main() {
+    highp float depth = texture(gbuffer_depth, screen_uv).r;
+    // nothing was drawn here, the sky shows through
+    if (depth >= 1.0)
+        discard;
+    vec4 albedo = texture(gbuffer_albedo, screen_uv);
+    vec4 packed_normal = texture(gbuffer_normal, screen_uv);
+
+    // rebuild the view space position from the depth, the projection is a standard perspective matrix
+    highp float view_distance = projection[3][2] / (depth * 2.0 - 1.0 + projection[2][2]);
+    highp vec2 ndc = screen_uv * 2.0 - 1.0;
+    highp vec3 view_position = vec3(ndc.x / projection[0][0], ndc.y / projection[1][1], -1.0) * view_distance;
+    // the view matrix only rotates and translates, its inverse is the transposed rotation
+    highp vec3 world = transpose(mat3(view)) * (view_position - view[3].xyz);
+
+    float level = floor(packed_normal.a * float(MAX_LIGHT) + 0.5);
+#ifdef CLUSTERED_LIGHTS
+    vec3 lighting = vec3(voxelLight(level)) + clusteredLight(world, view_distance, normalize(packed_normal.rgb * 2.0 - 1.0));
+#else
+    vec3 lighting = vec3(voxelLight(level));
+#endif
+    FragColor = vec4(albedo.rgb * lighting, 1.0);
+    // translucent chunks are drawn afterwards and have to be hidden behind the G-buffer's geometry
+    gl_FragDepth = depth;
+}
+#else
 void main() {
 /** if (gl_fragcoord * gl_fragcoord < vec2(5, 5))
     FragColor = vec4(1.0f, 0.5f, 0.2f, 1.0f);
 else
     discard;*/
 FragColor = texture(texturep_palette, vec3(uv, index));
+#ifdef ALPHA_TEST
+    // cutout blocks (leaves, fences) are either fully see-through or not at all
+    if (FragColor.a < 0.5)
+        discard;
+    FragColor.a = 1.0;
+#elif !defined(TRANSLUCENT)
+    FragColor.a = 1.0;
+#endif
+#ifdef DEFERRED
+    // lit later by the lighting pass
+    FragNormal = vec4(faceNormal() * 0.5 + 0.5, light / float(MAX_LIGHT));
+#elif defined(CLUSTERED_LIGHTS)
+    FragColor.rgb *= voxelLight(light) + clusteredLight(world_position, view_depth, faceNormal());
+#else
+    FragColor.rgb *= voxelLight(light);
+#endif
 }
+#endif
 
 ")";
 #endif
\ No newline at end of file
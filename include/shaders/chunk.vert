@@ -4,22 +4,7 @@
 #version 300 es
 precision mediump float;
 
-//layout (location = 0) in vec3 vertex;
-//layout (location = 1) in vec3 texture_coord;
-
-const vec2 UV_COORDS[4] = vec2[4](
-    vec2(0, 0),
-    vec2(1, 0),
-    vec2(0, 1),
-    vec2(1, 1)
-);
-
-layout (location = 0) in float data;
-
-out vec2 uv;
-out float index;
-
-uniform mat4 translation;
+// CHUNK_SIZE, the bit layouts and FACE_RECORDS are defined by fp::getChunkShaderDefines() so they always match typedefs.h
 
 layout (std140) uniform StandardMatrices
 {
@@ -31,25 +16,116 @@ layout (std140) uniform StandardMatrices
     mat4 orthographic;
 };
 
+// per chunk data, must match fp::chunk_draw_data
+layout (std140) uniform DrawData
+{
+    // xyz is where the chunk's first block is placed in the world, w is the size of one block (2^lod)
+    vec4 chunk_offset;
+};
+
+out vec2 uv;
+out float index;
+// light level of the block the face looks into, 0 to MAX_LIGHT
+out float light;
+#if defined(CLUSTERED_LIGHTS) || defined(DEFERRED)
+// for the face normal and point lights in chunk.frag
+out highp vec3 world_position;
+#endif
+#ifdef CLUSTERED_LIGHTS
+out highp float view_depth;
+#endif
+
+#ifdef FACE_RECORDS
+// vertex pulling version. Each instance is a single face, the 6 vertices of its two triangles are rebuilt from gl_VertexID
+
+// corners of each face (relative to the block's -0.5 corner), ordered the same as the face enum and the unit faces in storage.cpp
+const vec3 CORNERS[24] = vec3[24](
+    // X_POS
+    vec3(1, 1, 1), vec3(1, 1, 0), vec3(1, 0, 0), vec3(1, 0, 1),
+    // X_NEG
+    vec3(0, 1, 1), vec3(0, 1, 0), vec3(0, 0, 0), vec3(0, 0, 1),
+    // Y_POS
+    vec3(1, 1, 1), vec3(0, 1, 1), vec3(0, 1, 0), vec3(1, 1, 0),
+    // Y_NEG
+    vec3(1, 0, 1), vec3(0, 0, 1), vec3(0, 0, 0), vec3(1, 0, 0),
+    // Z_POS
+    vec3(1, 1, 1), vec3(1, 0, 1), vec3(0, 0, 1), vec3(0, 1, 1),
+    // Z_NEG
+    vec3(1, 1, 0), vec3(1, 0, 0), vec3(0, 0, 0), vec3(0, 1, 0)
+);
+
+// every face uses the same uvs for its 4 corners
+const vec2 UV_COORDS[4] = vec2[4](
+    vec2(1, 1),
+    vec2(1, 0),
+    vec2(0, 0),
+    vec2(0, 1)
+);
+
+// triangle order is flipped between positive / negative faces as a result of back-face culling
+const int POSITIVE_INDICES[6] = int[6](3, 1, 0, 3, 2, 1);
+const int NEGATIVE_INDICES[6] = int[6](0, 1, 3, 1, 2, 3);
+
+layout (location = 0) in uint data;
+
+void main() {
+    const uint coord_mask = uint(CHUNK_SIZE - 1);
+
+    uint face = (data >> uint(FACE_DIRECTION_LOC)) & 0x7u;
+    vec3 block = vec3(float((data >> uint(FACE_X_COORD_LOC)) & coord_mask),
+                      float((data >> uint(FACE_Y_COORD_LOC)) & coord_mask),
+                      float((data >> uint(FACE_Z_COORD_LOC)) & coord_mask));
+
+    int corner = (face % 2u == 0u) ? POSITIVE_INDICES[gl_VertexID] : NEGATIVE_INDICES[gl_VertexID];
+    vec3 position = block + CORNERS[int(face) * 4 + corner];
+
+    index = float((data >> uint(FACE_TEXTURE_INDEX_LOC)) & uint((1 << FACE_TEXTURE_INDEX_BITS) - 1));
+    light = float((data >> uint(FACE_LIGHT_LOC)) & 0xFu);
+    vec3 world = chunk_offset.xyz + (position - 0.5) * chunk_offset.w;
+    gl_Position = pvm * vec4(world, 1.0);
+#if defined(CLUSTERED_LIGHTS) || defined(DEFERRED)
+    world_position = world;
+#endif
+#ifdef CLUSTERED_LIGHTS
+    view_depth = -(view * vec4(world, 1.0)).z;
+#endif
+    uv = UV_COORDS[corner];
+}
+#else
+const vec2 UV_COORDS[4] = vec2[4](
+    vec2(0, 0),
+    vec2(1, 0),
+    vec2(0, 1),
+    vec2(1, 1)
+);
+
+layout (location = 0) in float data;
+
 void main() {
-    const int texture_index_loc = 32 - 8;
-    const int uv_index_loc = texture_index_loc - 2;
-    const int x_coord_loc = uv_index_loc - 6;
-    const int y_coord_loc = x_coord_loc - 6;
-    const int z_coord_loc = y_coord_loc - 6;
+    // coords go up to CHUNK_SIZE inclusive since vertices sit on the far corners of the last block
+    const int coord_mask = (CHUNK_SIZE << 1) - 1;
 
     int idata = floatBitsToInt(data);
 
-    int texture_index = idata >> texture_index_loc;
-    int uv_index = ((idata >> uv_index_loc) & 0x3);
-    float x_coord = float((idata >> x_coord_loc) & 0x3F);
-    float y_coord = float((idata >> y_coord_loc) & 0x3F);
-    float z_coord = float((idata >> z_coord_loc) & 0x3F);
+    int texture_index = (idata >> VERTEX_TEXTURE_INDEX_LOC) & ((1 << VERTEX_TEXTURE_INDEX_BITS) - 1);
+    int uv_index = ((idata >> VERTEX_UV_LOC) & 0x3);
+    float x_coord = float((idata >> VERTEX_X_COORD_LOC) & coord_mask);
+    float y_coord = float((idata >> VERTEX_Y_COORD_LOC) & coord_mask);
+    float z_coord = float((idata >> VERTEX_Z_COORD_LOC) & coord_mask);
 
     index = float(texture_index);
-    gl_Position = projection * view * translation * vec4(-0.5 + x_coord, -0.5 + y_coord, -0.5 + z_coord, 1.0);
+    light = float((idata >> VERTEX_LIGHT_LOC) & 0xF);
+    vec3 world = chunk_offset.xyz + vec3(-0.5 + x_coord, -0.5 + y_coord, -0.5 + z_coord) * chunk_offset.w;
+    gl_Position = pvm * vec4(world, 1.0);
+#if defined(CLUSTERED_LIGHTS) || defined(DEFERRED)
+    world_position = world;
+#endif
+#ifdef CLUSTERED_LIGHTS
+    view_depth = -(view * vec4(world, 1.0)).z;
+#endif
     uv = UV_COORDS[uv_index].xy;
 }
+#endif
 
 ")";
 #endif
\ No newline at end of file
@@ -0,0 +1,16 @@
+#ifdef __cplusplus
+#include <string>
+std::string shader_debug_frag = R"("
+#version 300 es
+precision mediump float;
+
+in vec4 vertex_color;
+
+out vec4 FragColor;
+
+void main() {
+    FragColor = vertex_color;
+}
+
+")";
+#endif
\ No newline at end of file
@@ -0,0 +1,33 @@
+#ifdef __cplusplus
+#include <string>
+std::string shader_debug_vert = R"("
+#version 300 es
+precision mediump float;
+
+layout (location = 0) in vec3 vertex;
+layout (location = 1) in vec4 color;
+
+out vec4 vertex_color;
+
+// 1 when drawing the 2D overlay, the vertices are then in screen coordinates
+uniform int screen_space;
+
+layout (std140) uniform StandardMatrices
+{
+    mat4 projection;
+    mat4 view;
+// projection view matrix
+    mat4 pvm;
+// orthographic projection matrix
+    mat4 orthographic;
+};
+
+void main() {
+    gl_Position = (screen_space == 1 ? orthographic : pvm) * vec4(vertex, 1.0);
+    // only used when drawing points
+    gl_PointSize = 6.0;
+    vertex_color = color;
+}
+
+")";
+#endif
\ No newline at end of file
@@ -0,0 +1,19 @@
+#ifdef __cplusplus
+    #include <string>
+    std::string shader_deferred_vert = R"("
+#version 300 es
+precision mediump float;
+
+// full screen triangle for the deferred lighting pass (chunk.frag built with DEFERRED_LIGHTING), no vertex data is needed
+
+out vec2 screen_uv;
+
+void main() {
+    // (0, 0), (2, 0), (0, 2): one triangle covering the whole screen, counter-clockwise so it survives back-face culling
+    vec2 corner = vec2(float((gl_VertexID << 1) & 2), float(gl_VertexID & 2));
+    screen_uv = corner;
+    gl_Position = vec4(corner * 2.0 - 1.0, 0.0, 1.0);
+}
+
+")";
+#endif
\ No newline at end of file
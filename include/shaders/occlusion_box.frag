@@ -0,0 +1,16 @@
+#ifdef __cplusplus
+    #include <string>
+    std::string shader_occlusion_box_frag = R"("
+#version 300 es
+precision mediump float;
+
+// color writes are masked off while the boxes are drawn, only the depth test matters
+
+out vec4 FragColor;
+
+void main() {
+    FragColor = vec4(1.0);
+}
+
+")";
+#endif
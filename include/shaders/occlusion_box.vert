@@ -0,0 +1,39 @@
+#ifdef __cplusplus
+    #include <string>
+    std::string shader_occlusion_box_vert = R"("
+#version 300 es
+precision mediump float;
+
+// a chunk's bounding box for the occlusion queries (see query_pool), the cube is built from gl_VertexID so no vertex data is needed
+
+layout (std140) uniform StandardMatrices
+{
+    mat4 projection;
+    mat4 view;
+// projection view matrix
+    mat4 pvm;
+// orthographic projection matrix
+    mat4 orthographic;
+};
+
+uniform vec3 box_min;
+uniform vec3 box_max;
+
+// corners of the 12 triangles, bit 0 picks max x, bit 1 max y and bit 2 max z. Culling is off while the boxes are drawn so the winding doesn't matter
+const int CUBE_CORNERS[36] = int[36](
+    1, 3, 7, 1, 7, 5,
+    0, 4, 6, 0, 6, 2,
+    2, 6, 7, 2, 7, 3,
+    0, 1, 5, 0, 5, 4,
+    4, 5, 7, 4, 7, 6,
+    0, 2, 3, 0, 3, 1
+);
+
+void main() {
+    int corner = CUBE_CORNERS[gl_VertexID];
+    vec3 position = mix(box_min, box_max, vec3(float(corner & 1), float((corner >> 1) & 1), float((corner >> 2) & 1)));
+    gl_Position = pvm * vec4(position, 1.0);
+}
+
+")";
+#endif
@@ -5,16 +5,19 @@ std::string shader_text_frag = R"("
 precision mediump float;
 
 in vec2 texture_coords;
+in vec4 text_color;
 
 out vec4 FragColor;
 
+// every glyph lives in this single channel atlas as a signed distance field, 0.5 is the outline
 uniform sampler2D character;
-uniform vec4 text_color;
-uniform vec4 background_color;
 
 void main() {
-    FragColor = text_color * vec4(1.0, 1.0, 1.0, texture(character, texture_coords).r);
-    //FragColor = vec4(0.0, 1.0, 0.0, 1.0) * vec4(1.0, 1.0, 1.0, texture(character, texture_coords).r);
+    float distance = texture(character, texture_coords).r;
+    // fwidth is how much the distance changes over one pixel at the current scale, which keeps the edge one pixel wide at any size
+    float width = max(fwidth(distance), 0.001);
+    float alpha = smoothstep(0.5 - width, 0.5 + width, distance);
+    FragColor = text_color * vec4(1.0, 1.0, 1.0, alpha);
 }
 
 ")";
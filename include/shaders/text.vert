@@ -4,11 +4,16 @@ std::string shader_text_vert = R"("
 #version 300 es
 precision mediump float;
 
+// unit quad, xy is the position and zw the matching corner of the glyph
 layout (location = 0) in vec4 vertex;
+// per glyph instance data. x, y, width, height in screen space
+layout (location = 1) in vec4 glyph_rect;
+// top left and bottom right of the glyph inside the atlas
+layout (location = 2) in vec4 glyph_uv;
+layout (location = 3) in vec4 glyph_color;
 
 out vec2 texture_coords;
-
-uniform mat4 translation;
+out vec4 text_color;
 
 layout (std140) uniform StandardMatrices
 {
@@ -21,8 +26,9 @@ layout (std140) uniform StandardMatrices
 };
 
 void main()  {
-    gl_Position = orthographic * translation * vec4(vertex.xy, 0.0, 1.0);
-    texture_coords = vertex.zw;
+    gl_Position = orthographic * vec4(glyph_rect.xy + vertex.xy * glyph_rect.zw, 0.0, 1.0);
+    texture_coords = mix(glyph_uv.xy, glyph_uv.zw, vertex.zw);
+    text_color = glyph_color;
 }
 
 ")";
@@ -0,0 +1,90 @@
+/*
+ * Created by Brett on 19/10/26.
+ * Licensed under GNU General Public License V3.0
+ * See LICENSE file for license detail
+ */
+
+#ifndef FINALPROJECT_FRAME_PROFILER_H
+#define FINALPROJECT_FRAME_PROFILER_H
+
+/**
+ * Live per frame profiler shown on the debug screen. Unlike the BLT intervals, which are only written out at shutdown,
+ * this keeps the last FRAME_HISTORY frames so hitches can be looked at while they happen.
+ *  - CPU scopes nest, each frame records the time spent in every scope along with its depth
+ *  - GPU scopes use GL_TIME_ELAPSED queries (desktop only). Results are read a few frames later to avoid stalling.
+ *    Only one time elapsed query can be active at once, so a GPU scope inside another is counted as part of the outer one.
+ *    Passes are timed with sibling scopes instead, see world::render()
+ *
+ * Scope names must be string literals (or otherwise outlive the profiler) since only the pointer is stored.
+ */
+namespace fp::frame_profiler {
+    
+    constexpr int FRAME_HISTORY = 240;
+    
+    void beginFrame();
+    
+    void endFrame();
+    
+    void push(const char* name);
+    
+    void pop();
+    
+    void beginGPU(const char* name);
+    
+    void endGPU();
+    
+    /**
+     * Draws the per scope timings and the frame time graph, starting at y. y is moved past everything drawn.
+     */
+    void render(float x, float& y);
+    
+    /**
+     * @return milliseconds between beginFrame() and endFrame() of the last complete frame, 0 before the first one
+     */
+    double getLastFrameTime();
+    
+    /**
+     * @return milliseconds the last complete frame spent in the CPU scopes with this name
+     */
+    double getLastTime(const char* name);
+    
+    /**
+     * @return milliseconds of GPU work in the newest frame with all of its results back, negative if there are none (always on the web)
+     */
+    double getLastGPUTime();
+    
+    void cleanup();
+    
+    /**
+     * Times everything until the end of the current block as a CPU scope
+     */
+    struct scope {
+        explicit scope(const char* name) {
+            push(name);
+        }
+        
+        scope(const scope& copy) = delete;
+        
+        ~scope() {
+            pop();
+        }
+    };
+    
+    /**
+     * Times the GL work issued until the end of the current block
+     */
+    struct gpu_scope {
+        explicit gpu_scope(const char* name) {
+            beginGPU(name);
+        }
+        
+        gpu_scope(const gpu_scope& copy) = delete;
+        
+        ~gpu_scope() {
+            endGPU();
+        }
+    };
+    
+}
+
+#endif //FINALPROJECT_FRAME_PROFILER_H
@@ -0,0 +1,149 @@
+/*
+ * Created by Brett on 19/10/26.
+ * Licensed under GNU General Public License V3.0
+ * See LICENSE file for license detail
+ */
+
+#ifndef FINALPROJECT_MEMORY_H
+#define FINALPROJECT_MEMORY_H
+
+#include <vector>
+#include <mutex>
+#include <cstddef>
+
+namespace fp {
+    
+    struct slab_pool_stats {
+        // blocks currently handed out
+        size_t live = 0;
+        // blocks the slabs can hold in total
+        size_t capacity = 0;
+        size_t slabs = 0;
+        size_t huge_page_slabs = 0;
+    };
+    
+    /**
+     * Hands out fixed size blocks carved from large slabs. Freed blocks go on a free list and are handed out again before a new slab
+     * is made, so long sessions don't fragment the heap and blocks allocated together stay close together in memory.
+     * Slabs are never returned to the system until the pool is destroyed. Thread safe.
+     */
+    class slab_pool {
+        private:
+            struct slab {
+                void* memory;
+                size_t size;
+                // came from mmap instead of the heap, see createSlab()
+                bool mapped;
+                bool huge_pages;
+            };
+            
+            size_t block_size;
+            size_t blocks_per_slab;
+            bool use_huge_pages = false;
+            
+            std::vector<slab> slabs;
+            // freed blocks are linked through their first bytes
+            void* free_list = nullptr;
+            size_t live = 0;
+            std::mutex mutex;
+            
+            slab createSlab();
+        public:
+            /**
+             * @param block_size size of every allocation, at least the size of a pointer
+             * @param blocks_per_slab how many blocks are allocated at once
+             */
+            slab_pool(size_t block_size, size_t blocks_per_slab);
+            
+            slab_pool(const slab_pool& copy) = delete;
+            
+            void* allocate();
+            
+            void deallocate(void* block);
+            
+            /**
+             * Back slabs created from now on with huge pages (Linux only, ignored elsewhere).
+             * Falls back to transparent huge pages and then to regular pages if the system has none reserved.
+             */
+            void setHugePages(bool enabled);
+            
+            slab_pool_stats getStats();
+            
+            ~slab_pool();
+    };
+    
+    /**
+     * Bump allocator for data that is thrown away all at once. Allocating is a pointer increment and freeing does nothing,
+     * every block goes back to the shared pool when the arena is destroyed. Each mesh owns one, so its memory is released as soon as
+     * the mesh is uploaded no matter how many other meshes are still waiting. Only one thread may use an arena at a time.
+     */
+    class bump_arena {
+        private:
+            static constexpr size_t BLOCK_SIZE = 64 * 1024;
+            
+            // from getBlocks()
+            std::vector<char*> blocks;
+            // allocations too big for a block come from the heap
+            std::vector<char*> large;
+            size_t large_bytes = 0;
+            size_t offset = BLOCK_SIZE;
+        public:
+            bump_arena() = default;
+            
+            bump_arena(const bump_arena& copy) = delete;
+            
+            /**
+             * @return pool every arena takes its blocks from, one slab is 2MiB. Thread safe
+             */
+            static slab_pool& getBlocks();
+            
+            void* allocate(size_t bytes, size_t alignment);
+            
+            inline void deallocate() {}
+            
+            [[nodiscard]] inline size_t getCapacity() const {
+                return blocks.size() * BLOCK_SIZE + large_bytes;
+            }
+            
+            ~bump_arena();
+    };
+    
+    /**
+     * std allocator on top of a bump_arena. The arena must outlive every container using it
+     */
+    template<typename T>
+    struct arena_allocator {
+        typedef T value_type;
+        
+        bump_arena* arena;
+        
+        explicit arena_allocator(bump_arena& arena): arena(&arena) {}
+        
+        template<typename U>
+        arena_allocator(const arena_allocator<U>& copy): arena(copy.arena) {}
+        
+        T* allocate(size_t n) {
+            return static_cast<T*>(arena->allocate(n * sizeof(T), alignof(T)));
+        }
+        
+        void deallocate(T*, size_t) {
+            arena->deallocate();
+        }
+        
+        template<typename U>
+        bool operator==(const arena_allocator<U>& other) const {
+            return arena == other.arena;
+        }
+        
+        template<typename U>
+        bool operator!=(const arena_allocator<U>& other) const {
+            return arena != other.arena;
+        }
+    };
+    
+    template<typename T>
+    using mesh_vector = std::vector<T, arena_allocator<T>>;
+    
+}
+
+#endif //FINALPROJECT_MEMORY_H
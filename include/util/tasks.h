@@ -0,0 +1,75 @@
+/*
+ * Created by Brett on 19/10/26.
+ * Licensed under GNU General Public License V3.0
+ * See LICENSE file for license detail
+ */
+
+#ifndef FINALPROJECT_TASKS_H
+#define FINALPROJECT_TASKS_H
+
+#include <string>
+#include <vector>
+#include <functional>
+#include <queue>
+#include <mutex>
+#include <condition_variable>
+
+namespace fp {
+    
+    enum task_thread {
+        // can be run by any worker. Must not touch GL!
+        ANY_THREAD = 0,
+        // GL is single threaded, anything creating GL objects must run on the thread which owns the context
+        MAIN_THREAD = 1
+    };
+    
+    /**
+     * Small dependency graph of tasks, used to overlap the startup steps which don't depend on each other.
+     * Tasks are added up front then run() executes them all, starting each one as soon as its dependencies are done.
+     * Every task is timed so slow startup phases show up in the log.
+     */
+    class task_graph {
+        public:
+            typedef int task_id;
+        private:
+            struct task {
+                std::string name;
+                task_thread thread;
+                std::function<void()> func;
+                // dependencies which haven't finished yet
+                int remaining;
+                std::vector<task_id> dependents{};
+                long start = 0;
+                long end = 0;
+                bool on_main = false;
+            };
+            
+            std::vector<task> tasks;
+            std::queue<task_id> ready[2];
+            int finished = 0;
+            
+            std::mutex task_mutex;
+            std::condition_variable task_ready;
+            
+            /**
+             * blocks until there is a task this thread is allowed to run.
+             * @return -1 once every task has finished
+             */
+            task_id take(bool main_thread, bool run_any);
+            
+            void execute(task_id id, bool main_thread);
+        public:
+            task_graph() = default;
+            
+            task_id addTask(const std::string& name, task_thread thread, std::function<void()> func, const std::vector<task_id>& dependencies = {});
+            
+            /**
+             * Runs every task, returning once all have finished. Must be called from the main (GL) thread.
+             * @param worker_count number of worker threads, with 0 every task runs on the calling thread in dependency order
+             */
+            void run(int worker_count);
+    };
+    
+}
+
+#endif //FINALPROJECT_TASKS_H
@@ -0,0 +1,99 @@
+/*
+ * Created by Brett on 19/10/26.
+ * Licensed under GNU General Public License V3.0
+ * See LICENSE file for license detail
+ */
+
+#ifndef FINALPROJECT_GENERATOR_H
+#define FINALPROJECT_GENERATOR_H
+
+#include <world/chunk/storage.h>
+#include <vector>
+#include <cstdint>
+#include <utility>
+
+// terrain generation and meshing only ever touch block / mesh storages, none of this needs a GL context
+
+namespace fp {
+    // see world/light.h
+    class light_storage;
+}
+
+namespace fp::generator {
+    
+    /**
+     * A box of opaque blocks inside a chunk, min and max are both inclusive local block positions
+     */
+    struct occluder_slab {
+        block_pos min;
+        block_pos max;
+    };
+    
+    /**
+     * One bit per pair of chunk faces, set if the two faces can see each other through the chunk's non-opaque blocks. See getConnectionBit()
+     */
+    typedef std::uint16_t face_connections;
+    
+    constexpr face_connections ALL_FACES_CONNECTED = (1 << 15) - 1;
+    
+    /**
+     * @return the bit of the (unordered) pair of faces inside a face_connections mask, the faces must be different
+     */
+    inline int getConnectionBit(face a, face b) {
+        if (a > b)
+            std::swap(a, b);
+        // pairs are numbered (0, 1), (0, 2) ... (0, 5), (1, 2) ... (4, 5)
+        return a * (11 - a) / 2 + b - a - 1;
+    }
+    
+    inline bool areFacesConnected(face_connections connections, face a, face b) {
+        return connections & (1 << getConnectionBit(a, b));
+    }
+    
+    /**
+     * Fills the storage with the terrain for this chunk / LOD region. Only touches the storage so it is safe to call from any thread.
+     * The noise is not seeded, the same position always produces the same blocks.
+     */
+    void generateTerrain(block_storage* storage, const chunk_pos& pos, int lod = 0);
+    
+    /**
+     * Adds every visible face of the local storage to the mesh of the pass its block is drawn in.
+     * @param meshes one mesh per render_pass. The translucent mesh should be created sortable (see mesh_storage)
+     * @param neighbours storages surrounding the local storage, ordered the same as the face enum.
+     * A null neighbour is past the edge of the loaded area and its side is treated as air, producing a skirt.
+     * @param light light levels of the local storage, each face is lit by the block it looks into. Null meshes everything at full brightness
+     * @param neighbour_lights light levels of the neighbours, ordered the same as neighbours. Null entries are full brightness
+     */
+    void generateMesh(
+            mesh_storage* const meshes[RENDER_PASS_COUNT], const block_storage* local, const block_storage* const neighbours[6],
+            const light_storage* light = nullptr, const light_storage* const neighbour_lights[6] = nullptr
+    );
+    
+    /**
+     * Rough sky light for a LOD region, which the light engine never sees. Columns open to the sky are fully lit down to their first
+     * opaque block and the light is flood filled from there inside the region, falling off by 2^lod per coarse block so it fades
+     * over the same distance as it does in the full resolution chunks. Light never crosses into the neighbouring regions.
+     * @param above the region above, its columns decide which of the local columns see the sky. Null if it is past the top of the ring
+     */
+    void lightRegion(light_storage* light, const block_storage* local, const block_storage* above, int lod);
+    
+    /**
+     * Collects the local position of every light producing block in the storage, these become the point lights of the clustered renderer
+     */
+    void findEmitters(const block_storage* local, std::vector<block_pos>& emitters);
+    
+    /**
+     * Finds the runs of completely opaque layers along each axis, these are rasterized by the occlusion culling (see occlusion_buffer).
+     * A fully opaque storage produces a single slab covering the whole chunk.
+     */
+    void findOccluders(const block_storage* local, std::vector<occluder_slab>& occluders);
+    
+    /**
+     * Flood fills the non-opaque blocks to find which faces of the chunk are connected to each other through them.
+     * Used by the visibility graph to stop looking through chunks there is no way to see through.
+     */
+    face_connections findConnections(const block_storage* local);
+    
+}
+
+#endif //FINALPROJECT_GENERATOR_H
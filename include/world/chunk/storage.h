@@ -13,6 +13,7 @@
 #include "blt/std/format.h"
 #include <world/chunk/typedefs.h>
 #include <world/registry.h>
+#include <util/memory.h>
 #include <unordered_map>
 #ifdef __EMSCRIPTEN__
 #include <phmap.h>
@@ -26,20 +27,42 @@ namespace fp {
     
     class block_storage {
         private:
-            block_type* blocks;
+            // storages which only contain air never allocate. This keeps sky chunks and the mostly empty LOD regions cheap.
+            block_type* blocks = nullptr;
         public:
-            block_storage() {
-                blocks = new unsigned char[CHUNK_SIZE * CHUNK_SIZE * CHUNK_SIZE];
-                for (int i = 0; i < CHUNK_SIZE * CHUNK_SIZE * CHUNK_SIZE; i++)
-                    blocks[i] = fp::registry::AIR;
-            }
+            block_storage() = default;
+            
+            block_storage(const block_storage& copy) = delete;
             
             ~block_storage() {
-                delete[] blocks;
+                getSlabs().deallocate(blocks);
+            }
+            
+            /**
+             * @return pool every block array is allocated from, one slab holds exactly one 2MiB huge page worth of arrays
+             */
+            static slab_pool& getSlabs();
+            
+            [[nodiscard]] inline bool isEmpty() const {
+                return blocks == nullptr;
             }
             
             [[nodiscard]] inline block_type get(const block_pos& pos) const {
-                return blocks[pos.z * CHUNK_SIZE * CHUNK_SIZE + pos.y * CHUNK_SIZE + pos.x];
+                if (!blocks)
+                    return fp::registry::AIR;
+                return blocks[block_layout::index(pos.x, pos.y, pos.z)];
+            }
+            
+            /**
+             * Calls func(const block_pos&, block_type) for every block in the order they are stored, see block_layout.
+             * Does nothing for an empty storage, every block of it is air.
+             */
+            template<typename F>
+            inline void forEach(F&& func) const {
+                if (!blocks)
+                    return;
+                for (int index = 0; index < CHUNK_BLOCK_COUNT; index++)
+                    func(block_layout::position(index), blocks[index]);
             }
             
             [[nodiscard]] inline bool checkBlockVisibility(const block_pos& pos) const {
@@ -51,12 +74,31 @@ namespace fp {
             }
             
             inline void set(const block_pos& pos, block_type blockID) {
-                blocks[pos.z * CHUNK_SIZE * CHUNK_SIZE + pos.y * CHUNK_SIZE + pos.x] = blockID;
+                if (!blocks) {
+                    if (blockID == fp::registry::AIR)
+                        return;
+                    blocks = static_cast<block_type*>(getSlabs().allocate());
+                    for (int i = 0; i < CHUNK_BLOCK_COUNT; i++)
+                        blocks[i] = fp::registry::AIR;
+                }
+                blocks[block_layout::index(pos.x, pos.y, pos.z)] = blockID;
             }
+            
+            /**
+             * Reduces the source storage by 2x on each axis and writes it into one octant of this storage.
+             * Each 2x2x2 cell becomes its most common opaque block if at least half of the cell is opaque, otherwise it becomes air.
+             * @param source storage one LOD level finer than this storage
+             * @param offset where the octant starts inside this storage, either 0 or CHUNK_SIZE / 2 on each axis
+             */
+            void downsample(const block_storage& source, const block_pos& offset);
     };
     
+    typedef mesh_vector<face_record> face_record_list;
+    
     class mesh_storage {
         private:
+            // meshes only live until they are uploaded, so their lists come from an arena freed with the mesh. Declared first so it outlives them
+            bump_arena arena;
             // spp doesn't support emscripten, but phmap does work
             // slightly more memory consumption but still much lower than std::unordered_map (plus much faster access)
 #ifdef __EMSCRIPTEN__
@@ -64,22 +106,73 @@ namespace fp {
 #else
             spp::sparse_hash_map<vertex, unsigned int, _static::vertex_hash, _static::vertex_equality> created_vertices_index;
 #endif
-            std::vector<vertex> vertices;
-            std::vector<unsigned int> indices;
+            mesh_vector<vertex> vertices;
+            // faces are either turned into indexed vertices or stored as a single record each
+            bool use_face_records;
+            // indexed meshes also keep a record per face, in the same order as the indices. Used to sort translucent faces after meshing
+            bool keep_face_records;
+            face_record_list faces[6];
+            // one list per face direction, uploaded back to back so the renderer can skip the directions facing away from the camera
+            mesh_vector<unsigned int> indices[6];
         public:
+            /**
+             * @param face_records build one face_record per face for the vertex pulling renderer instead of indexed vertices
+             * @param sortable always keep the face records, even for indexed meshes (see translucent_order)
+             */
+            explicit mesh_storage(bool face_records = false, bool sortable = false);
+            
+            mesh_storage(const mesh_storage& copy) = delete;
+            
+            /**
+             * @return arena the mesh's lists live in, scratch lists used while uploading the mesh can come from it too
+             */
+            inline bump_arena& getArena() {
+                return arena;
+            }
+            
             /**
              * since a chunk mesh contains all the faces for all the blocks inside the chunk
              * we can add the translated values of predefined "unit" faces. This is for the simple "fast" chunk mesh generator.
              * @param face the direction the face is facing to be added to the mesh.
              * @param pos position of the face
+             * @param light level of the block the face looks into, see light_storage::getLevel()
              */
-            void addFace(face face, const block_pos& pos, unsigned char texture_index);
+            void addFace(face face, const block_pos& pos, unsigned char texture_index, unsigned char light = MAX_LIGHT);
             
-            inline std::vector<vertex>& getVertices() {
+            inline mesh_vector<vertex>& getVertices() {
                 return vertices;
             }
-            inline std::vector<unsigned int>& getIndices() {
-                return indices;
+            inline face_record_list& getFaces(face face) {
+                return faces[face];
+            }
+            
+            [[nodiscard]] inline bool usesFaceRecords() const {
+                return use_face_records;
+            }
+            
+            inline mesh_vector<unsigned int>& getIndices(face face) {
+                return indices[face];
+            }
+            
+            [[nodiscard]] inline size_t getIndexCount() const {
+                size_t count = 0;
+                for (const auto& direction : indices)
+                    count += direction.size();
+                return count;
+            }
+            
+            [[nodiscard]] inline size_t getFaceCount() const {
+                // indexed faces are always two triangles
+                if (!use_face_records)
+                    return getIndexCount() / 6;
+                size_t count = 0;
+                for (const auto& direction : faces)
+                    count += direction.size();
+                return count;
+            }
+            
+            [[nodiscard]] inline bool isEmpty() const {
+                return getFaceCount() == 0;
             }
     };
     
@@ -7,11 +7,93 @@
 #ifndef FINALPROJECT_CHUNK_TYPEDEFS_H
 #define FINALPROJECT_CHUNK_TYPEDEFS_H
 
+#include <cstddef>
+#include <functional>
+
+#ifndef FP_CHUNK_SHIFT
+    // chunks are 2^FP_CHUNK_SHIFT blocks wide. 4 (16^3) and 6 (64^3) also work, the bench is built for all three (see CMakeLists.txt).
+    // Meshing costs the same per block at every size. 16^3 needs 5x the draws of 32^3 for the same world, while re-meshing a single
+    // 64^3 chunk after an edit takes ~18ms (p99), more than a whole frame. 32^3 stays under 4ms
+    #define FP_CHUNK_SHIFT 5
+#endif
+
+// orders blocks can be stored in inside a chunk, named from the slowest changing axis to the fastest. See block_layout
+#define FP_LAYOUT_ZYX 0
+#define FP_LAYOUT_XZY 1
+#define FP_LAYOUT_YZX 2
+#define FP_LAYOUT_MORTON 3
+
+#ifndef FP_BLOCK_LAYOUT
+    // rows along x. The three linear orders bench within noise of each other, morton order is ~30% slower to mesh
+    // since every block lookup spreads its coordinates again. The bench is built for every layout (see CMakeLists.txt)
+    #define FP_BLOCK_LAYOUT FP_LAYOUT_ZYX
+#endif
+
+namespace fp {
+    
+    /**
+     * Everything that depends on the width of a chunk, worked out at compile time. The bit layouts are passed to chunk.vert as defines
+     * (see getChunkShaderDefines()) so the shader always unpacks what the mesher packed.
+     */
+    template<int Shift>
+    struct chunk_dimensions {
+        static_assert(Shift >= 2, "chunks must be at least 4 blocks wide, the LOD octants and translucent cells halve them");
+        
+        static constexpr int SHIFT = Shift;
+        static constexpr int SIZE = 1 << Shift;
+        
+        // packed vertex (see vertex), from the lowest bit up. Vertices sit on block corners so coordinates reach SIZE inclusive, one extra bit
+        static constexpr int VERTEX_COORD_BITS = Shift + 1;
+        static constexpr int VERTEX_LIGHT_LOC = 0;
+        static constexpr int VERTEX_Z_COORD_LOC = VERTEX_LIGHT_LOC + 4;
+        static constexpr int VERTEX_Y_COORD_LOC = VERTEX_Z_COORD_LOC + VERTEX_COORD_BITS;
+        static constexpr int VERTEX_X_COORD_LOC = VERTEX_Y_COORD_LOC + VERTEX_COORD_BITS;
+        static constexpr int VERTEX_UV_LOC = VERTEX_X_COORD_LOC + VERTEX_COORD_BITS;
+        static constexpr int VERTEX_TEXTURE_INDEX_LOC = VERTEX_UV_LOC + 2;
+        // whatever is left, up to a byte
+        static constexpr int VERTEX_TEXTURE_INDEX_BITS = 32 - VERTEX_TEXTURE_INDEX_LOC < 8 ? 32 - VERTEX_TEXTURE_INDEX_LOC : 8;
+        
+        // face record (see face_record), from the lowest bit up. The face direction replaces the +1 corner offsets so SIZE - 1 is the largest coord
+        static constexpr int FACE_COORD_BITS = Shift;
+        static constexpr int FACE_X_COORD_LOC = 0;
+        static constexpr int FACE_Y_COORD_LOC = FACE_X_COORD_LOC + FACE_COORD_BITS;
+        static constexpr int FACE_Z_COORD_LOC = FACE_Y_COORD_LOC + FACE_COORD_BITS;
+        static constexpr int FACE_DIRECTION_LOC = FACE_Z_COORD_LOC + FACE_COORD_BITS;
+        static constexpr int FACE_TEXTURE_INDEX_LOC = FACE_DIRECTION_LOC + 3;
+        // the light level always goes in the top 4 bits that are used
+        static constexpr int FACE_TEXTURE_INDEX_BITS = 32 - 4 - FACE_TEXTURE_INDEX_LOC < 8 ? 32 - 4 - FACE_TEXTURE_INDEX_LOC : 8;
+        static constexpr int FACE_LIGHT_LOC = FACE_TEXTURE_INDEX_LOC + FACE_TEXTURE_INDEX_BITS;
+        
+        // textures either layout can address
+        static constexpr int MAX_TEXTURES = 1 << (VERTEX_TEXTURE_INDEX_BITS < FACE_TEXTURE_INDEX_BITS ? VERTEX_TEXTURE_INDEX_BITS : FACE_TEXTURE_INDEX_BITS);
+        
+        static_assert(VERTEX_TEXTURE_INDEX_BITS >= 4, "the packed vertex has no room left for texture indices");
+        static_assert(FACE_TEXTURE_INDEX_BITS >= 4, "the face record has no room left for texture indices");
+        static_assert(FACE_LIGHT_LOC + 4 <= 32, "the face record must fit in 32 bits");
+    };
+    
+    // every chunk size the code is expected to build with, so a layout change that breaks one of them fails everywhere
+    static_assert(chunk_dimensions<4>::MAX_TEXTURES == 256 && chunk_dimensions<5>::MAX_TEXTURES == 256 && chunk_dimensions<6>::MAX_TEXTURES == 32,
+                  "unexpected texture limit");
+    // the layout the original hand written packing used
+    static_assert(chunk_dimensions<5>::VERTEX_TEXTURE_INDEX_LOC == 24 && chunk_dimensions<5>::VERTEX_X_COORD_LOC == 16 &&
+                  chunk_dimensions<5>::FACE_TEXTURE_INDEX_LOC == 18 && chunk_dimensions<5>::FACE_LIGHT_LOC == 26, "32^3 layout changed");
+    
+    typedef chunk_dimensions<FP_CHUNK_SHIFT> chunk_layout;
+}
+
+// log2 of the chunk size, world coordinates are turned into chunk coordinates with an arithmetic shift by this
+constexpr int CHUNK_SHIFT = fp::chunk_layout::SHIFT;
 // size of the chunk in number of blocks
-constexpr int CHUNK_SIZE = 32;
-const int CHUNK_SHIFT = (int) (log(CHUNK_SIZE) / log(2));
+constexpr int CHUNK_SIZE = fp::chunk_layout::SIZE;
+// blocks stored by a single chunk
+constexpr int CHUNK_BLOCK_COUNT = CHUNK_SIZE * CHUNK_SIZE * CHUNK_SIZE;
 // size that the base vertex arrays are assumed to be (per face)
 constexpr int VTX_ARR_SIZE = 4;
+// number of downsampled rings drawn past the full resolution chunks. A block at level L is 2^L blocks wide
+constexpr int MAX_LOD_LEVEL = 3;
+// how many regions the camera can drift away from a ring's anchor before the ring is re-centered, smaller rings use less (see getRingHysteresis())
+constexpr int LOD_HYSTERESIS = 2;
 
 namespace fp {
     
@@ -33,6 +115,23 @@ namespace fp {
         DIRTY = 2
     };
     
+    // a contiguous run of indices inside a chunk's element buffer
+    struct index_range {
+        unsigned int start = 0;
+        unsigned int count = 0;
+    };
+    
+    // each chunk has one mesh per pass. Passes are drawn in this order
+    enum render_pass {
+        // OPAQUE blocks, no blending or alpha test
+        SOLID_PASS = 0,
+        // TRANSPARENT_TEXTURE blocks, alpha tested but still written to the depth buffer
+        CUTOUT_PASS = 1,
+        // TRANSLUCENT blocks, blended back to front without writing depth
+        TRANSLUCENT_PASS = 2,
+    };
+    constexpr int RENDER_PASS_COUNT = 3;
+    
     enum chunk_update_status {
         NONE = 0,
         NEIGHBOUR_CREATE = 1,
@@ -50,6 +149,104 @@ namespace fp {
         block_pos(float x, float y, float z): block_pos(int(x), int(y), int(z)) {}
     };
     
+    /**
+     * Blocks stored as rows of the Inner axis, stacked along Middle then Outer (0 x, 1 y, 2 z).
+     */
+    template<int Outer, int Middle, int Inner>
+    struct linear_layout {
+        static constexpr int OUTER = Outer;
+        static constexpr int MIDDLE = Middle;
+        static constexpr int INNER = Inner;
+        
+        static constexpr int index(int x, int y, int z) {
+            const int coords[3] = {x, y, z};
+            return (coords[Outer] << (CHUNK_SHIFT * 2)) | (coords[Middle] << CHUNK_SHIFT) | coords[Inner];
+        }
+        
+        static inline block_pos position(int index) {
+            int coords[3];
+            coords[Outer] = index >> (CHUNK_SHIFT * 2);
+            coords[Middle] = (index >> CHUNK_SHIFT) & (CHUNK_SIZE - 1);
+            coords[Inner] = index & (CHUNK_SIZE - 1);
+            return {coords[0], coords[1], coords[2]};
+        }
+    };
+    
+    /**
+     * Blocks stored in Z-order, the bits of x, y and z interleaved with x lowest. Every aligned 2^n cube is contiguous,
+     * so all six neighbours of a block are usually in the same or a nearby cache line whichever way it is walked.
+     */
+    struct morton_layout {
+        // z holds the top bit of each triple, so these only say which way whole layers are closer together
+        static constexpr int OUTER = 2;
+        static constexpr int MIDDLE = 1;
+        static constexpr int INNER = 0;
+        
+        static_assert(CHUNK_SHIFT <= 10, "spread() only handles 10 bits");
+        
+        // puts two zero bits between each bit of the value
+        static constexpr int spread(int value) {
+            value = (value | (value << 16)) & 0x030000FF;
+            value = (value | (value << 8)) & 0x0300F00F;
+            value = (value | (value << 4)) & 0x030C30C3;
+            return (value | (value << 2)) & 0x09249249;
+        }
+        
+        // inverse of spread(), ignores the bits in between
+        static constexpr int compact(int value) {
+            value &= 0x09249249;
+            value = (value | (value >> 2)) & 0x030C30C3;
+            value = (value | (value >> 4)) & 0x0300F00F;
+            value = (value | (value >> 8)) & 0x030000FF;
+            return (value | (value >> 16)) & 0x000003FF;
+        }
+        
+        static constexpr int index(int x, int y, int z) {
+            return spread(x) | (spread(y) << 1) | (spread(z) << 2);
+        }
+        
+        static inline block_pos position(int index) {
+            return {compact(index), compact(index >> 1), compact(index >> 2)};
+        }
+    };
+
+#if FP_BLOCK_LAYOUT == FP_LAYOUT_ZYX
+    typedef linear_layout<2, 1, 0> block_layout;
+#elif FP_BLOCK_LAYOUT == FP_LAYOUT_XZY
+    // whole columns are contiguous, which is how the terrain generator works
+    typedef linear_layout<0, 2, 1> block_layout;
+#elif FP_BLOCK_LAYOUT == FP_LAYOUT_YZX
+    // horizontal slices are contiguous
+    typedef linear_layout<1, 2, 0> block_layout;
+#elif FP_BLOCK_LAYOUT == FP_LAYOUT_MORTON
+    typedef morton_layout block_layout;
+#else
+    #error "unknown FP_BLOCK_LAYOUT"
+#endif
+
+    static_assert(linear_layout<2, 1, 0>::index(1, 2, 3) == (3 * CHUNK_SIZE + 2) * CHUNK_SIZE + 1, "ZYX must match the original layout");
+    static_assert(morton_layout::index(CHUNK_SIZE - 1, 0, 0) == morton_layout::spread(CHUNK_SIZE - 1) &&
+                  morton_layout::compact(morton_layout::spread(CHUNK_SIZE - 1)) == CHUNK_SIZE - 1, "morton bits don't round trip");
+    static_assert(block_layout::index(CHUNK_SIZE - 1, CHUNK_SIZE - 1, CHUNK_SIZE - 1) == CHUNK_BLOCK_COUNT - 1, "layout must fill the array");
+    
+    /**
+     * @return the block of the layer at layer along the axis (0 x, 1 y, 2 z). outer and inner are given to the other two axes
+     * in storage order, looping over inner innermost walks the layer the way block_layout stores it
+     */
+    inline block_pos getLayerPos(int axis, int layer, int outer, int inner) {
+        int coords[3];
+        coords[axis] = layer;
+        const int order[3] = {block_layout::OUTER, block_layout::MIDDLE, block_layout::INNER};
+        bool first = true;
+        for (int a : order) {
+            if (a == axis)
+                continue;
+            coords[a] = first ? outer : inner;
+            first = false;
+        }
+        return {coords[0], coords[1], coords[2]};
+    }
+    
     // to ensure this is a POD we define the vertex as a C-struct. This allows us to store one large vertex array and pass that to the GPU
     // instead of sending arrays for the positions, UVs, normals, etc.
     // since OpenGL allows us to specify attributes based on offsets from the same VBO.
@@ -57,11 +254,38 @@ namespace fp {
         // since opaque textures only use 4 possible coords in our basic engine
         // UVs can be stored on the gpu as a const array, using 2 bits we can index into them
         // texture arrays store 256 max possible textures, so 1 byte can store that.
-        // position can be stored using 33 values or 6 bits each, taking 18 bits total.
-        // leaving us with 4 bits currently unused in the float.
+        // position can be stored using CHUNK_SIZE + 1 values, CHUNK_SHIFT + 1 bits each.
+        // 4 bits in the float hold the light level of the block the face looks into. See chunk_dimensions for the exact layout
         float data;
     } vertex;
     
+    // layout of the packed vertex. These are also passed to chunk.vert as defines
+    constexpr int VERTEX_TEXTURE_INDEX_LOC = chunk_layout::VERTEX_TEXTURE_INDEX_LOC;
+    constexpr int VERTEX_TEXTURE_INDEX_BITS = chunk_layout::VERTEX_TEXTURE_INDEX_BITS;
+    constexpr int VERTEX_UV_LOC = chunk_layout::VERTEX_UV_LOC;
+    constexpr int VERTEX_X_COORD_LOC = chunk_layout::VERTEX_X_COORD_LOC;
+    constexpr int VERTEX_Y_COORD_LOC = chunk_layout::VERTEX_Y_COORD_LOC;
+    constexpr int VERTEX_Z_COORD_LOC = chunk_layout::VERTEX_Z_COORD_LOC;
+    constexpr int VERTEX_LIGHT_LOC = chunk_layout::VERTEX_LIGHT_LOC;
+    
+    // sunlight and block light levels are both 4 bits, see world/light.h
+    constexpr int MAX_LIGHT = 15;
+    
+    // layout of the 32 bit face records used by the vertex pulling renderer (chunk.vert with FACE_RECORDS).
+    // the face direction replaces the +1 corner offsets of the packed vertex, so CHUNK_SHIFT bits per coord is enough.
+    constexpr int FACE_X_COORD_LOC = chunk_layout::FACE_X_COORD_LOC;
+    constexpr int FACE_Y_COORD_LOC = chunk_layout::FACE_Y_COORD_LOC;
+    constexpr int FACE_Z_COORD_LOC = chunk_layout::FACE_Z_COORD_LOC;
+    constexpr int FACE_DIRECTION_LOC = chunk_layout::FACE_DIRECTION_LOC;
+    constexpr int FACE_TEXTURE_INDEX_LOC = chunk_layout::FACE_TEXTURE_INDEX_LOC;
+    constexpr int FACE_TEXTURE_INDEX_BITS = chunk_layout::FACE_TEXTURE_INDEX_BITS;
+    constexpr int FACE_LIGHT_LOC = chunk_layout::FACE_LIGHT_LOC;
+    
+    // blocks using a palette texture past this can't be meshed with the current chunk size
+    constexpr int MAX_CHUNK_TEXTURES = chunk_layout::MAX_TEXTURES;
+    
+    typedef unsigned int face_record;
+    
     typedef struct {
         float x, y, z;
         float u, v;
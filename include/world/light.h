@@ -0,0 +1,245 @@
+/*
+ * Created by Brett on 19/10/26.
+ * Licensed under GNU General Public License V3.0
+ * See LICENSE file for license detail
+ */
+
+#ifndef FINALPROJECT_LIGHT_H
+#define FINALPROJECT_LIGHT_H
+
+#include <world/chunk/storage.h>
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <phmap.h>
+
+// flood fill lighting. Only touches block / light storages, so like the generator none of this needs a GL context
+
+namespace fp {
+    
+    typedef phmap::flat_hash_set<chunk_pos, _static::chunk_pos_hash, _static::chunk_pos_equality> chunk_pos_set;
+    
+    enum light_channel {
+        // light coming straight down from the sky. Keeps its full level while travelling down, loses 1 per block in every other direction
+        SKY_LIGHT = 0,
+        // light produced by blocks (see block_properties::produces_light), loses 1 per block in every direction
+        BLOCK_LIGHT = 1
+    };
+    
+    /**
+     * Light levels of every block in a chunk, one byte per block holding the sunlight in the high nibble and the block light in the low nibble.
+     * Like block_storage the array is only allocated once a block differs from the fill level, so open sky stays cheap.
+     */
+    class light_storage {
+        private:
+            unsigned char* levels = nullptr;
+            // level of every block while the array is not allocated
+            unsigned char fill = 0;
+            // set by the light engine once the chunk's first propagation is done, the chunk can't be meshed before that
+            std::atomic<bool> ready{false};
+        public:
+            light_storage() = default;
+            
+            light_storage(const light_storage& copy) = delete;
+            
+            ~light_storage() {
+                getSlabs().deallocate(levels);
+            }
+            
+            /**
+             * @return pool every light array is allocated from, sized the same as block_storage's
+             */
+            static slab_pool& getSlabs();
+            
+            [[nodiscard]] inline unsigned char get(const block_pos& pos) const {
+                if (!levels)
+                    return fill;
+                return levels[block_layout::index(pos.x, pos.y, pos.z)];
+            }
+            
+            [[nodiscard]] inline int get(const block_pos& pos, light_channel channel) const {
+                return channel == SKY_LIGHT ? get(pos) >> 4 : get(pos) & 0xF;
+            }
+            
+            /**
+             * @return the level a face looking into this block is lit with, the brighter of the two channels
+             */
+            [[nodiscard]] inline int getLevel(const block_pos& pos) const {
+                auto value = get(pos);
+                return std::max(value >> 4, value & 0xF);
+            }
+            
+            inline void set(const block_pos& pos, light_channel channel, int level) {
+                auto value = get(pos);
+                value = channel == SKY_LIGHT ? (value & 0x0F) | (level << 4) : (value & 0xF0) | level;
+                if (!levels) {
+                    if (value == fill)
+                        return;
+                    levels = static_cast<unsigned char*>(getSlabs().allocate());
+                    for (int i = 0; i < CHUNK_BLOCK_COUNT; i++)
+                        levels[i] = fill;
+                }
+                levels[block_layout::index(pos.x, pos.y, pos.z)] = value;
+            }
+            
+            /**
+             * Sets every block to the same sky level without allocating. Only valid before anything else was written.
+             */
+            inline void fillSky(int level) {
+                fill = level << 4;
+            }
+            
+            [[nodiscard]] inline bool isReady() const {
+                return ready;
+            }
+            
+            inline void markReady() {
+                ready = true;
+            }
+    };
+    
+    /**
+     * Spreads sunlight and block light through the loaded chunks with a breadth first flood fill.
+     * Chunks are lit once when they are added, after that only the blocks around an edit are re-lit (removal followed by refill)
+     * so breaking a block never has to touch more than the light it actually affected.
+     *
+     * The work runs on a worker thread. Propagation freely crosses chunk borders, so every job holds the one world lock (see lock())
+     * for its whole duration and jobs run one after another.
+     */
+    class light_engine {
+        private:
+            struct light_chunk {
+                const block_storage* blocks;
+                light_storage* light;
+            };
+            
+            struct light_job {
+                // chunk jobs light a newly added chunk at pos, block jobs re-light around the block at pos (world coords)
+                bool add_chunk = false;
+                block_pos pos{0, 0, 0};
+                const block_storage* blocks = nullptr;
+                light_storage* light = nullptr;
+            };
+            
+            struct removal_node {
+                block_pos pos;
+                int level;
+            };
+            
+            // guards chunks and every light / block storage inside of it
+            std::mutex world_mutex;
+            // number of threads blocked in lock(), the worker lets them go first
+            std::atomic<int> waiting{0};
+            phmap::flat_hash_map<chunk_pos, light_chunk, _static::chunk_pos_hash, _static::chunk_pos_equality> chunks;
+            
+            // guards jobs and changed
+            std::mutex job_mutex;
+            std::condition_variable job_condition;
+            std::deque<light_job> jobs;
+            chunk_pos_set changed;
+            
+            bool running = true;
+            std::thread* worker = nullptr;
+            
+            // scratch space of the job being run, only touched while holding the world lock
+            std::vector<block_pos> add_queue;
+            std::vector<removal_node> removal_queue;
+            std::vector<chunk_pos> touched;
+            light_chunk* cached_chunk = nullptr;
+            chunk_pos cached_pos{};
+            
+            light_chunk* findChunk(const chunk_pos& pos);
+            
+            /**
+             * @return the chunk holding the world position, or null if it isn't loaded. local is set to the position inside of it
+             */
+            light_chunk* findBlock(const block_pos& pos, block_pos& local);
+            
+            void setLevel(light_chunk* chunk, const block_pos& pos, const block_pos& local, light_channel channel, int level);
+            
+            /**
+             * @return the level the block has on its own: 15 for emitters, and 15 sunlight for open blocks below a chunk which isn't loaded
+             */
+            int getSourceLevel(light_chunk* chunk, const block_pos& pos, const block_pos& local, light_channel channel);
+            
+            /**
+             * Spreads the light of every block in add_queue, emptying it
+             */
+            void propagate(light_channel channel);
+            
+            /**
+             * Clears the light which depended on every block in removal_queue, emptying it.
+             * The brighter blocks found on the edge of the cleared area are queued in add_queue so propagate() can refill it.
+             */
+            void remove(light_channel channel);
+            
+            void lightChunk(const light_job& job);
+            
+            void updateBlock(const block_pos& pos);
+            
+            void processJob(const light_job& job);
+            
+            /**
+             * Pops the next job. Must be called while holding the world lock, so a chunk can't be removed between popping its job and running it
+             */
+            bool popJob(light_job& job);
+            
+            void workerLoop();
+        
+        public:
+            /**
+             * @param threaded start a worker thread. Otherwise jobs only run when runJob() is called, used where no spare thread exists (emscripten)
+             */
+            explicit light_engine(bool threaded = true);
+            
+            light_engine(const light_engine& copy) = delete;
+            
+            /**
+             * Queues the chunk to be lit. Both storages must stay alive until removeChunk() is called
+             */
+            void addChunk(const chunk_pos& pos, const block_storage* blocks, light_storage* light);
+            
+            /**
+             * Forgets the chunk, after this returns its storages are never touched again and can be deleted
+             */
+            void removeChunk(const chunk_pos& pos);
+            
+            /**
+             * Queues the light around this block to be updated. The block storage must only be changed while holding lock()
+             */
+            void blockChanged(const block_pos& pos);
+            
+            /**
+             * @return every chunk whose light (or the light on its border) changed since the last call. Their meshes are out of date
+             */
+            chunk_pos_set takeChanged();
+            
+            /**
+             * Locks every light and block storage known to the engine, waiting for the current job to finish.
+             * Needed to read light while meshing or to write blocks.
+             */
+            std::unique_lock<std::mutex> lock();
+            
+            /**
+             * Runs a single queued job on the calling thread
+             * @return false if there was nothing to run
+             */
+            bool runJob();
+            
+            /**
+             * Stops the worker thread. Queued jobs are dropped
+             */
+            void stop();
+            
+            ~light_engine() {
+                stop();
+            }
+    };
+    
+}
+
+#endif //FINALPROJECT_LIGHT_H
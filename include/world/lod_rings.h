@@ -0,0 +1,59 @@
+/*
+ * Created by Brett on 19/10/26.
+ * Licensed under GNU General Public License V3.0
+ * See LICENSE file for license detail
+ */
+
+#ifndef FINALPROJECT_LOD_RINGS_H
+#define FINALPROJECT_LOD_RINGS_H
+
+#include <world/chunk/typedefs.h>
+#include <algorithm>
+
+namespace fp {
+    
+    namespace _static {
+        /**
+         * Converts from chunk pos coords to the coords of the LOD region containing that chunk. A region at level L is 2^L chunks wide.
+         * This is a flooring division, for the same reasons as world_to_chunk
+         */
+        static inline int chunk_to_region(int coord, int lod) {
+            return coord >= 0 ? coord >> lod : -((-coord - 1) >> lod) - 1;
+        }
+        
+        static inline chunk_pos chunk_to_region(const chunk_pos& pos, int lod) {
+            return {chunk_to_region(pos.x, lod), chunk_to_region(pos.y, lod), chunk_to_region(pos.z, lod)};
+        }
+        
+        /**
+         * @return true if the chunk / region is inside the box of the ring centered on anchor, holes are not taken into account
+         */
+        static inline bool inside_ring_box(const chunk_pos& pos, const chunk_pos& anchor, int radius) {
+            return pos.x >= anchor.x - radius && pos.x < anchor.x + radius &&
+                   pos.y >= anchor.y - radius && pos.y < anchor.y + radius &&
+                   pos.z >= anchor.z - radius && pos.z < anchor.z + radius;
+        }
+    }
+    
+    /**
+     * LOD_HYSTERESIS shrunk to fit the radius, the camera stays less than radius / 2 regions from the anchor. At least half of each ring
+     * is always left in front of it.
+     */
+    inline int getRingHysteresis(int radius) {
+        return std::min(LOD_HYSTERESIS, radius / 2 - 1);
+    }
+    
+    /**
+     * Re-centers the anchor of each ring on the camera once it drifts further than getRingHysteresis() regions away.
+     * The full resolution ring is placed first, every coarser anchor is then clamped so the finer ring stays inside its box.
+     * That keeps the rings nested, the finer ring is always exactly the hole in the middle of the coarser one, and whatever ring holds
+     * the camera holds it in every coarser ring too.
+     * @param anchors anchor of each ring, in regions of its level. Always even
+     * @param radius even, at least 2
+     * @param valid false to place every ring from scratch
+     * @return true if any anchor moved
+     */
+    bool updateRingAnchors(chunk_pos anchors[MAX_LOD_LEVEL + 1], const chunk_pos& camera_chunk_pos, int radius, bool valid);
+}
+
+#endif //FINALPROJECT_LOD_RINGS_H
@@ -8,12 +8,18 @@
 #define FINALPROJECT_REGISTRY_H
 
 #include <string>
-#include <render/textures.h>
 
 namespace fp {
     typedef unsigned char block_type;
 }
 
+namespace fp::texture {
+    // defined in render/textures.h. Only declared here so the blocks can be used without pulling in GL (see bench/)
+    class file_texture;
+    
+    typedef int texture_index;
+}
+
 namespace fp::registry {
     
     /**
@@ -37,6 +43,7 @@ namespace fp::registry {
         // WebGL doesn't default to empty textures, use index 0 to store an empty texture
         std::string textureName;
         // this significantly improves performance (halved chunk mesh gen time, see doc for more info)
+        // filled in by resolveBlockTextures(), until then every block uses index 0
         texture::texture_index textureIndex = 0;
         // does this block produce light?
         bool produces_light = false;
@@ -52,6 +59,7 @@ namespace fp::registry {
     constexpr block_type DIRT = 2;
     constexpr block_type COBBLE = 3;
     constexpr block_type GRASS = 4;
+    constexpr block_type LAMP = 5;
     
     void registerBlock(block_type id, block_properties properties);
     
@@ -60,12 +68,28 @@ namespace fp::registry {
     void textureInit();
     void blockInit();
     
+    /**
+     * Looks up the palette index of every registered block's texture. Must be called once both the blocks and the textures have been registered
+     */
+    void resolveBlockTextures();
+    
+    /**
+     * Decodes every queued texture using count threads, returning once they have all been loaded (or came from the cache)
+     */
     void setupTextureLoaderThreads(int count = 8);
     
+    /**
+     * Uploads the loaded textures to the GPU. Must be called on the GL thread after registerDefaultTextures()
+     */
     void generateTexturePalette();
     
     void cleanup();
     
+    /**
+     * Frees the block properties only, for programs which never created a texture palette
+     */
+    void blockCleanup();
+    
     block_properties& get(block_type id);
     
     unsigned int getTextureID();
@@ -85,22 +109,15 @@ namespace fp::registry {
         registerBlock(STONE, {OPAQUE, "Stone"});
         registerBlock(DIRT, {OPAQUE, "Dolph"});
         registerBlock(COBBLE, {OPAQUE, "Sit"});
+        block_properties lamp{OPAQUE, "Explode"};
+        lamp.produces_light = true;
+        registerBlock(LAMP, lamp);
     }
     
-    inline void registerDefaultTextures() {
-        textureInit();
-        
-        registerTexture(new texture::file_texture{"assets/textures/1676004600027876.jpg", "Stone"});
-        registerTexture(new texture::file_texture{"assets/textures/1668750351593692.jpg", "Dirt"});
-        registerTexture(new texture::file_texture{"assets/textures/1638777414645.jpg", "Dolph"});
-        registerTexture(new texture::file_texture{"assets/textures/1603423355849.jpg", "Sit"});
-        registerTexture(new texture::file_texture{"assets/textures/1603422678312.jpg", "Loser"});
-        registerTexture(new texture::file_texture{"assets/textures/1592244663459.png", "Frog"});
-        registerTexture(new texture::file_texture{"assets/textures/1592234267606.png", "Explode"});
-        
-        setupTextureLoaderThreads();
-        generateTexturePalette();
-    }
+    /**
+     * Queues and decodes the default textures. CPU only, generateTexturePalette() must be called afterwards to create the GL texture
+     */
+    void registerDefaultTextures();
     
 }
 #endif //FINALPROJECT_REGISTRY_H
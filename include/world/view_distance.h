@@ -0,0 +1,73 @@
+/*
+ * Created by Brett on 19/10/26.
+ * Licensed under GNU General Public License V3.0
+ * See LICENSE file for license detail
+ */
+
+#ifndef FINALPROJECT_VIEW_DISTANCE_H
+#define FINALPROJECT_VIEW_DISTANCE_H
+
+namespace fp {
+    
+    // weight of the newest frame in the smoothed frame times
+    constexpr double VIEW_SMOOTHING = 0.05;
+    // the smoothed frame time has to stay past target * this many frames in a row before the view distance shrinks
+    constexpr double VIEW_SHRINK_THRESHOLD = 1.1;
+    constexpr int VIEW_SHRINK_FRAMES = 30;
+    // and under target * this before it grows. The gap between the two keeps it from bouncing between two radii
+    constexpr double VIEW_GROW_THRESHOLD = 0.7;
+    constexpr int VIEW_GROW_FRAMES = 120;
+    // frames ignored after a change, meshing the new ring (or evicting the old one) is a spike which says nothing about the new radius
+    constexpr int VIEW_COOLDOWN_FRAMES = 90;
+    
+    /**
+     * Moves the view radius up and down to hold a frame time. Fed once per frame with the time spent on actual work,
+     * waiting on vsync doesn't count. The slower of the CPU and the GPU decides.
+     */
+    class view_distance_controller {
+        private:
+            int min_radius;
+            int max_radius;
+            int radius;
+            double target_ms;
+            double cpu_ms = 0;
+            double gpu_ms = 0;
+            int frames_over = 0;
+            int frames_under = 0;
+            int cooldown = VIEW_COOLDOWN_FRAMES;
+        public:
+            /**
+             * The radius always moves in steps of 2, the rings have to stay even. Both limits are rounded up to even radii
+             * @param target_ms frame time to hold
+             */
+            view_distance_controller(int min_radius, int max_radius, double target_ms);
+            
+            /**
+             * @param frame_gpu_ms negative if the GPU can't be timed, the CPU then decides alone
+             * @return true if the radius changed
+             */
+            bool update(double frame_cpu_ms, double frame_gpu_ms);
+            
+            [[nodiscard]] inline int getRadius() const {
+                return radius;
+            }
+            
+            [[nodiscard]] inline double getTarget() const {
+                return target_ms;
+            }
+            
+            [[nodiscard]] inline double getCPUTime() const {
+                return cpu_ms;
+            }
+            
+            /**
+             * @return negative if the GPU can't be timed
+             */
+            [[nodiscard]] inline double getGPUTime() const {
+                return gpu_ms;
+            }
+    };
+    
+}
+
+#endif //FINALPROJECT_VIEW_DISTANCE_H
@@ -8,10 +8,18 @@
 #define FINALPROJECT_WORLD_H
 
 #include <world/chunk/storage.h>
+#include <world/chunk/generator.h>
+#include <world/light.h>
 #include <render/gl.h>
+#include <render/lighting/clustered_lights.h>
+#include <render/lighting/deferred_renderer.h>
 #include <phmap.h>
 #include "blt/profiling/profiler.h"
 #include <render/frustum.h>
+#include <render/occlusion.h>
+#include <render/occlusion_queries.h>
+#include <world/view_distance.h>
+#include <world/lod_rings.h>
 
 namespace fp {
     
@@ -22,8 +30,8 @@ namespace fp {
          * @return chunk internal coord
          */
         static inline int world_to_internal(int coord) {
-            auto val = coord % CHUNK_SIZE;
-            return val < 0 ? CHUNK_SIZE + val : val;
+            // chunks are a power of two wide, masking is a modulo that never goes negative
+            return coord & (CHUNK_SIZE - 1);
         }
         
         static inline block_pos world_to_internal(const block_pos& coord) {
@@ -48,12 +56,8 @@ namespace fp {
             ucoord >>= CHUNK_SHIFT;
             
             if (coord < 0) {
-                // the mask only has to be generated once since it is never modified at runtime beyond assignment
-                static unsigned int mask = 0;
-                if (mask == 0) {
-                    for (int i = 0; i < CHUNK_SHIFT; i++)
-                        mask |= (1 << ((sizeof(int) * 8 - 1) - i));
-                }
+                // the top CHUNK_SHIFT bits, which the shift filled with zeros
+                constexpr unsigned int mask = ~(~0u >> CHUNK_SHIFT);
                 ucoord |= mask;
             }
             
@@ -64,33 +68,192 @@ namespace fp {
             return {world_to_chunk(pos.x), world_to_chunk(pos.y), world_to_chunk(pos.z)};
         }
         
+        /**
+         * @return the position of the neighbouring chunk / region in the direction of face
+         */
+        static inline chunk_pos offset(const chunk_pos& pos, face face) {
+            switch (face) {
+                case X_POS:
+                    return {pos.x + 1, pos.y, pos.z};
+                case X_NEG:
+                    return {pos.x - 1, pos.y, pos.z};
+                case Y_POS:
+                    return {pos.x, pos.y + 1, pos.z};
+                case Y_NEG:
+                    return {pos.x, pos.y - 1, pos.z};
+                case Z_POS:
+                    return {pos.x, pos.y, pos.z + 1};
+                default:
+                    return {pos.x, pos.y, pos.z - 1};
+            }
+        }
+        
+    }
+    
+    /**
+     * @return the defines chunk.vert is compiled with, generated from typedefs.h so the shader can never fall out of sync with the mesher
+     * @param face_records compile the vertex pulling permutation (FACE_RENDERER)
+     * @param pass the cutout pass adds ALPHA_TEST, the translucent pass adds TRANSLUCENT
+     * @param clustered_lights light the chunks with the point lights of fp::light_clusters (CLUSTERED_LIGHTS)
+     * @param deferred draw the solid and cutout passes into the G-buffer of fp::deferred_renderer (DEFERRED). Translucent chunks stay forward
+     */
+    inline shader_defines getChunkShaderDefines(bool face_records, render_pass pass = SOLID_PASS, bool clustered_lights = false,
+                                                bool deferred = false) {
+        shader_defines defines{
+                {"CHUNK_SIZE",                std::to_string(CHUNK_SIZE)},
+                {"VERTEX_TEXTURE_INDEX_LOC",  std::to_string(VERTEX_TEXTURE_INDEX_LOC)},
+                {"VERTEX_TEXTURE_INDEX_BITS", std::to_string(VERTEX_TEXTURE_INDEX_BITS)},
+                {"VERTEX_UV_LOC",             std::to_string(VERTEX_UV_LOC)},
+                {"VERTEX_X_COORD_LOC",        std::to_string(VERTEX_X_COORD_LOC)},
+                {"VERTEX_Y_COORD_LOC",        std::to_string(VERTEX_Y_COORD_LOC)},
+                {"VERTEX_Z_COORD_LOC",        std::to_string(VERTEX_Z_COORD_LOC)},
+                {"VERTEX_LIGHT_LOC",          std::to_string(VERTEX_LIGHT_LOC)},
+                {"FACE_X_COORD_LOC",          std::to_string(FACE_X_COORD_LOC)},
+                {"FACE_Y_COORD_LOC",          std::to_string(FACE_Y_COORD_LOC)},
+                {"FACE_Z_COORD_LOC",          std::to_string(FACE_Z_COORD_LOC)},
+                {"FACE_DIRECTION_LOC",        std::to_string(FACE_DIRECTION_LOC)},
+                {"FACE_TEXTURE_INDEX_LOC",    std::to_string(FACE_TEXTURE_INDEX_LOC)},
+                {"FACE_TEXTURE_INDEX_BITS",   std::to_string(FACE_TEXTURE_INDEX_BITS)},
+                {"FACE_LIGHT_LOC",            std::to_string(FACE_LIGHT_LOC)},
+                {"MAX_LIGHT",                 std::to_string(MAX_LIGHT)},
+        };
+        if (face_records)
+            defines.emplace_back("FACE_RECORDS", "1");
+        if (pass == CUTOUT_PASS)
+            defines.emplace_back("ALPHA_TEST", "1");
+        else if (pass == TRANSLUCENT_PASS)
+            defines.emplace_back("TRANSLUCENT", "1");
+        if (clustered_lights) {
+            defines.emplace_back("CLUSTERED_LIGHTS", "1");
+            defines.emplace_back("CLUSTER_X", std::to_string(CLUSTER_X));
+            defines.emplace_back("CLUSTER_Y", std::to_string(CLUSTER_Y));
+            defines.emplace_back("CLUSTER_Z", std::to_string(CLUSTER_Z));
+            defines.emplace_back("CLUSTER_INDEX_WIDTH", std::to_string(CLUSTER_INDEX_WIDTH));
+            defines.emplace_back("MAX_POINT_LIGHTS", std::to_string(MAX_POINT_LIGHTS));
+        }
+        if (deferred && pass != TRANSLUCENT_PASS)
+            defines.emplace_back("DEFERRED", "1");
+        return defines;
+    }
+    
+    /**
+     * @return the defines of the deferred lighting pass, chunk.frag paired with deferred.vert
+     */
+    inline shader_defines getDeferredLightingDefines(bool clustered_lights) {
+        auto defines = getChunkShaderDefines(false, SOLID_PASS, clustered_lights);
+        defines.emplace_back("DEFERRED_LIGHTING", "1");
+        return defines;
     }
     
+    /**
+     * Per chunk block of the DrawData uniform block in chunk.vert, std140 layout
+     */
+    struct chunk_draw_data {
+        // xyz is where the chunk's first block is placed in the world, w is the size of one block (2^lod)
+        blt::vec4 offset;
+    };
+    static_assert(sizeof(chunk_draw_data) == sizeof(float) * 4, "chunk_draw_data must match the std140 DrawData block");
+    
+    /**
+     * Back to front orderings of a chunk's translucent faces. Sorting per frame would cost far too much, so the faces are only re-sorted
+     * when the camera crosses into another octant around the chunk's center (each octant's order is cached), or into another block
+     * while it is inside the chunk. From outside the octant order treats the camera as far away along the octant's diagonal.
+     */
+    struct translucent_order {
+        // one record per face in the order the faces were meshed, only used to find each face's center
+        std::vector<face_record> keys;
+        // the meshed face data, stride values per face (the 6 indices of its triangles, or its face record)
+        std::vector<unsigned int> faces;
+        int stride = 1;
+        // face data reordered for each octant, empty until the camera first looks from that octant
+        std::vector<unsigned int> octants[8];
+        // what the buffer currently holds: an octant, or OCTANT_COUNT + the camera's block index while inside the chunk
+        long current = -1;
+        
+        static constexpr int OCTANT_COUNT = 8;
+    };
+    
+    /**
+     * GPU side of a chunk, one per render pass. Only created once the pass has a non-empty mesh to upload,
+     * which keeps sky and buried chunks free of GL objects. The VAO is borrowed from the world's pool and handed back when the record is deleted.
+     */
+    struct chunk_render_record {
+        vao_pool* pool;
+        VAO* vao;
+        // ranges of the element buffer holding each face direction, ordered the same as the face enum.
+        // when using face records the ranges count faces inside the record buffer instead.
+        // translucent faces are re-ordered across the whole buffer, that pass always draws every range as one
+        index_range face_ranges[6]{};
+        // only used by the translucent pass
+        translucent_order* order = nullptr;
+        
+        /**
+         * Must be called on the GL thread
+         * @param capacity bytes of the first mesh, used to pick a pooled VAO which already fits it
+         */
+        chunk_render_record(vao_pool& pool, int capacity): pool(&pool), vao(pool.acquire(capacity)) {}
+        
+        chunk_render_record(const chunk_render_record& copy) = delete;
+        
+        ~chunk_render_record() {
+            pool->release(vao);
+            delete order;
+        }
+    };
+    
     struct chunk {
         private:
             block_storage* storage;
-            mesh_storage* mesh = nullptr;
-            VAO* chunk_vao;
+            // full resolution chunks are lit by the light engine, LOD regions get a rough sky light when meshed (see world::lightRegion())
+            light_storage* light;
+            mesh_storage* meshes[RENDER_PASS_COUNT]{};
+            // null until the pass's first non-empty mesh is uploaded, see updateChunkMesh()
+            chunk_render_record* render_records[RENDER_PASS_COUNT]{};
+            // local positions of the light producing blocks, found whenever a full resolution chunk is meshed
+            std::vector<block_pos> emitters;
+            // opaque slabs rasterized by the occlusion culling, found whenever a full resolution chunk is meshed
+            std::vector<generator::occluder_slab> occluders;
+            // GPU occlusion query against the chunk's bounds, see query_pool
+            chunk_query query;
+            // which faces can see each other through the chunk, found whenever a full resolution chunk is meshed. Open until then
+            generator::face_connections connections = generator::ALL_FACES_CONNECTED;
             chunk_pos pos;
+            // level of detail this chunk is stored at. LOD chunks cover 2^lod chunks on each axis, pos is then in region coords
+            int lod;
+            // draw with the vertex pulling renderer (one face_record per face, no element buffer)
+            bool face_records;
             
             chunk_mesh_status dirtiness = OKAY;
             chunk_update_status status = NONE;
-            unsigned long render_size = 0;
         public:
-            explicit chunk(chunk_pos pos): pos(pos) {
-                storage = new block_storage();
-                chunk_vao = new VAO();
-                auto vbo = new VBO(ARRAY_BUFFER, nullptr, 0, DYNAMIC);
-                //auto data_size = 3 * sizeof(float) + 3 * sizeof(float);
-                //chunk_vao->bindVBO(vbo, 0, 3, GL_FLOAT, (int) data_size, 0);
-                //chunk_vao->bindVBO(vbo, 1, 3, GL_FLOAT, (int) data_size, 3 * sizeof(float), true);
-                chunk_vao->bindVBO(vbo, 0, 1, GL_FLOAT, sizeof(float), 0);
-                chunk_vao->bindElementVBO(new VBO(ELEMENT_BUFFER, nullptr, 0, DYNAMIC));
+            /**
+             * Creates no GL objects, so chunks can be constructed on any thread.
+             * @param storage already generated blocks to adopt, a new empty storage is created if this is null
+             */
+            explicit chunk(chunk_pos pos, int lod = 0, bool face_records = false, block_storage* storage = nullptr):
+                    storage(storage), light(new light_storage()), pos(pos), lod(lod), face_records(face_records) {
+                if (this->storage == nullptr)
+                    this->storage = new block_storage();
             }
             
-            void render(shader& shader);
+            [[nodiscard]] chunk_draw_data getDrawData() const;
+            
+            /**
+             * Draws the faces of this pass which can face the camera. The chunk's draw data must already be bound
+             */
+            void render(render_pass pass);
+            
+            /**
+             * Uploads the waiting meshes, creating each pass's render record on first use. Must be called on the GL thread.
+             * An empty mesh releases its render record instead.
+             * @param pool the VAOs are taken from here, their layout must match this chunk's renderer
+             */
+            void updateChunkMesh(vao_pool& pool);
             
-            void updateChunkMesh();
+            /**
+             * Makes sure the translucent faces are uploaded in back to front order for the camera, see translucent_order
+             */
+            void sortTranslucent(const blt::vec3& camera_pos);
             
             /**
              * Mark the chunk as completely dirty and in need of a full chunk refresh
@@ -110,18 +273,60 @@ namespace fp {
                 return storage;
             }
             
-            [[nodiscard]] inline mesh_storage*& getMeshStorage() {
-                return mesh;
+            /**
+             * @return null for LOD regions
+             */
+            [[nodiscard]] inline light_storage* getLightStorage() {
+                return light;
+            }
+            
+            [[nodiscard]] inline std::vector<block_pos>& getEmitters() {
+                return emitters;
+            }
+            
+            [[nodiscard]] inline std::vector<generator::occluder_slab>& getOccluders() {
+                return occluders;
+            }
+            
+            [[nodiscard]] inline chunk_query& getQuery() {
+                return query;
+            }
+            
+            [[nodiscard]] inline generator::face_connections& getConnections() {
+                return connections;
+            }
+            
+            [[nodiscard]] inline mesh_storage*& getMeshStorage(render_pass pass) {
+                return meshes[pass];
+            }
+            
+            /**
+             * @return true if the chunk has uploaded faces to draw in any pass
+             */
+            [[nodiscard]] inline bool isDrawable() const {
+                for (auto* record : render_records) {
+                    if (record)
+                        return true;
+                }
+                return false;
             }
             
-            [[nodiscard]] inline VAO*& getVAO() {
-                return chunk_vao;
+            [[nodiscard]] inline bool hasPass(render_pass pass) const {
+                return render_records[pass] != nullptr;
             }
             
             [[nodiscard]] inline chunk_pos getPos() const {
                 return pos;
             }
             
+            [[nodiscard]] inline bool usesFaceRecords() const {
+                return face_records;
+            }
+            
+            [[nodiscard]] inline int getLOD() const {
+                return lod;
+            }
+            
             [[nodiscard]] inline chunk_mesh_status getDirtiness() const {
                 return dirtiness;
             }
@@ -134,10 +339,19 @@ namespace fp {
                 status = new_status;
             }
             
+            // chunks come from a slab, keeping the chunks walked every frame close together in memory.
+            // Anything of another size (a subclass) doesn't fit in a slot and goes to the global heap
+            static void* operator new(size_t size);
+            
+            static void operator delete(void* ptr, size_t size);
+            
             ~chunk() {
                 delete storage;
-                delete chunk_vao;
-                delete mesh;
+                delete light;
+                for (int i = 0; i < RENDER_PASS_COUNT; i++) {
+                    delete render_records[i];
+                    delete meshes[i];
+                }
             }
     };
     
@@ -149,54 +363,225 @@ namespace fp {
         }
     };
     
+    struct visibility_stats {
+        // full resolution chunks the search from the camera got to
+        size_t reached = 0;
+        // drawable chunks skipped because the search never got to them
+        size_t culled = 0;
+    };
+    
     class world {
         private:
-            phmap::flat_hash_map<chunk_pos, chunk*, _static::chunk_pos_hash, _static::chunk_pos_equality> chunk_storage;
+            typedef phmap::flat_hash_map<chunk_pos, chunk*, _static::chunk_pos_hash, _static::chunk_pos_equality> chunk_map;
+            // full resolution chunks
+            chunk_map chunk_storage;
+            // downsampled regions, lod_storage[0] holds level 1
+            chunk_map lod_storage[MAX_LOD_LEVEL];
+            
+            // rings are centered on their anchor, which only moves once the camera drifts more than LOD_HYSTERESIS regions away from it
+            // (see updateRingAnchors()). Anchors are always even and the radius is always even, that way each ring's box lines up with
+            // the grid of the next level
+            chunk_pos ring_anchors[MAX_LOD_LEVEL + 1]{};
+            int ring_radius = 0;
+            bool rings_valid = false;
+            // what ring_radius becomes on the next updateRings(), see setViewRadius()
+            int view_radius;
+            // null unless the ADAPTIVE_VIEW_DISTANCE setting is on
+            view_distance_controller* view_controller = nullptr;
+            
+            // the FACE_RENDERER setting, read once since every chunk has to be created for the same renderer
+            bool face_renderer;
+            
+            // VAOs of chunks which were unloaded or lost their faces, reused by the next chunk needing one
+            vao_pool chunk_vaos;
+            
+            // lights the full resolution chunks in the background, meshes are rebuilt as their light changes
+            light_engine lights;
+            
+            // chunks which passed culling this frame, in the order they are drawn
+            std::vector<chunk*> draw_list;
+            draw_data_buffer<chunk_draw_data>* draw_data = nullptr;
+            
+            // the CLUSTERED_LIGHTS setting, the chunk shaders must be built with the same value
+            bool clustered_lights;
+            // light producing blocks near the camera, rebuilt every frame out of the drawn chunks' emitters
+            std::vector<point_light> point_lights;
+            light_clusters* clusters = nullptr;
+            
+            // the OCCLUSION_CULLING setting
+            bool occlusion_culling;
+            occlusion_buffer occlusion;
+            // full resolution chunks close enough to the camera to be used as occluders this frame
+            std::vector<chunk*> occluder_chunks;
+            
+            // the OCCLUSION_QUERIES setting
+            bool occlusion_queries;
+            query_pool* queries = nullptr;
+            // chunks whose bounding box is drawn inside a query this frame, hidden ones included so they can come back
+            std::vector<chunk*> query_list;
+            
+            // the VISIBILITY_GRAPH setting
+            bool visibility_graph;
+            // one entry per chunk of the full resolution ring, see getGraphIndex()
+            std::vector<bool> reachable;
+            visibility_stats graph_stats;
         protected:
-            void generateChunkMesh(chunk* chunk);
+            /**
+             * @param light_lock the light engine's lock, taken the first time a full resolution chunk is meshed and kept until the caller releases it
+             */
+            void generateChunkMesh(chunk* chunk, std::unique_lock<std::mutex>& light_lock);
+            
+            chunk* generateChunk(const chunk_pos& pos, int lod = 0);
+            
+            /**
+             * Builds the LOD region out of the 8 regions one level finer than it, if they all exist.
+             * @return false if the region must be generated from the noise instead
+             */
+            bool downsampleChildren(chunk* chunk);
+            
+            void queueChunk(const chunk_pos& pos, int lod);
+            
+            /**
+             * Re-centers the rings on the camera using hysteresis, evicting anything that falls outside the new rings.
+             */
+            void updateRings(const chunk_pos& camera_chunk_pos);
+            
+            /**
+             * @return true if the region is part of the ring at this level, meaning it should exist and be drawn.
+             * Regions in the middle of a LOD ring are covered by the finer ring inside it.
+             */
+            [[nodiscard]] bool isInsideRing(const chunk_pos& pos, int lod) const;
+            
+            /**
+             * Gives a LOD region its sky light (see generator::lightRegion()) unless it already has it
+             */
+            void lightRegion(chunk* region);
+            
+            /**
+             * @return true if all children of this region exist with an uploaded mesh. The region can then be dropped without leaving a hole.
+             */
+            bool areChildrenReady(const chunk_pos& pos, int lod);
             
-            chunk* generateChunk(const chunk_pos& pos);
+            /**
+             * Walks the full resolution chunks outwards from the camera's chunk, only leaving a chunk through faces connected to the one it was
+             * entered through and never heading back towards the camera. Chunks which aren't reached can't be seen.
+             */
+            void findReachableChunks(const chunk_pos& camera_chunk_pos);
+            
+            /**
+             * @return index of the full resolution chunk inside reachable, -1 if it is outside the ring
+             */
+            [[nodiscard]] inline long getGraphIndex(const chunk_pos& pos) const {
+                const int size = ring_radius * 2;
+                const int x = pos.x - ring_anchors[0].x + ring_radius;
+                const int y = pos.y - ring_anchors[0].y + ring_radius;
+                const int z = pos.z - ring_anchors[0].z + ring_radius;
+                if (x < 0 || y < 0 || z < 0 || x >= size || y >= size || z >= size)
+                    return -1;
+                return ((long) x * size + y) * size + z;
+            }
+            
+            inline chunk_map& getStorage(int lod) {
+                return lod == 0 ? chunk_storage : lod_storage[lod - 1];
+            }
             
-            inline void getNeighbours(const chunk_pos& pos, chunk_neighbours& neighbours) {
-                neighbours[X_POS] = getChunk(chunk_pos{pos.x + 1, pos.y, pos.z});
-                neighbours[X_NEG] = getChunk(chunk_pos{pos.x - 1, pos.y, pos.z});
-                neighbours[Y_POS] = getChunk(chunk_pos{pos.x, pos.y + 1, pos.z});
-                neighbours[Y_NEG] = getChunk(chunk_pos{pos.x, pos.y - 1, pos.z});
-                neighbours[Z_POS] = getChunk(chunk_pos{pos.x, pos.y, pos.z + 1});
-                neighbours[Z_NEG] = getChunk(chunk_pos{pos.x, pos.y, pos.z - 1});
+            inline void getNeighbours(const chunk_pos& pos, chunk_neighbours& neighbours, int lod = 0) {
+                for (int i = 0; i < 6; i++)
+                    neighbours[i] = getChunk(_static::offset(pos, (face) i), lod);
             }
             
             inline void insertChunk(chunk* chunk) {
                 if (chunk == nullptr)
                     return;
-                chunk_storage.insert({chunk->getPos(), chunk});
+                getStorage(chunk->getLOD()).insert({chunk->getPos(), chunk});
+                if (chunk->getLOD() == 0)
+                    lights.addChunk(chunk->getPos(), chunk->getBlockStorage(), chunk->getLightStorage());
                 
                 chunk_neighbours chunkNeighbours{};
-                getNeighbours(chunk->getPos(), chunkNeighbours);
+                getNeighbours(chunk->getPos(), chunkNeighbours, chunk->getLOD());
                 
+                // the chunk itself might already be surrounded, so it must also try to mesh
+                chunk->setStatus(NEIGHBOUR_CREATE);
                 for (auto* p : chunkNeighbours.neighbours) {
                     if (p)
                         p->setStatus(NEIGHBOUR_CREATE);
                 }
             }
             
-            inline chunk* getChunk(const chunk_pos& pos) {
-                const auto map_pos = chunk_storage.find(pos);
-                if (map_pos == chunk_storage.end())
+            inline chunk* getChunk(const chunk_pos& pos, int lod = 0) {
+                auto& storage = getStorage(lod);
+                const auto map_pos = storage.find(pos);
+                if (map_pos == storage.end())
                     return nullptr;
                 return map_pos->second;
             }
             
             inline chunk* getChunk(const block_pos& pos) {
-                return chunk_storage[_static::world_to_chunk(pos)];
+                return getChunk(_static::world_to_chunk(pos));
             }
         
         public:
-            world() = default;
+            world();
+            
+            /**
+             * Adopts a block storage generated off the main thread (see generator::generateTerrain) as a full resolution chunk.
+             */
+            void insertPregenerated(const chunk_pos& pos, block_storage* storage);
             
             void update();
             
-            void render(fp::shader& shader);
+            /**
+             * Changes the radius of every ring, in chunks / regions of its level. Rounded up to an even radius of at least 2.
+             * Takes effect on the next frame: chunks leaving the rings are evicted and the new ones are queued for generation.
+             */
+            inline void setViewRadius(int radius) {
+                view_radius = std::max(2, (radius + 1) / 2 * 2);
+            }
+            
+            /**
+             * @return null if the view distance is fixed
+             */
+            [[nodiscard]] inline const view_distance_controller* getViewController() const {
+                return view_controller;
+            }
+            
+            /**
+             * @param shaders the chunk shader of each render pass, see getChunkShaderDefines()
+             * @param deferred draws the solid and cutout passes through this G-buffer if not null, the shaders must be built for it
+             */
+            void render(fp::shader* const shaders[RENDER_PASS_COUNT], const deferred_renderer* deferred = nullptr);
+            
+            [[nodiscard]] inline const vao_pool_stats& getVAOPoolStats() const {
+                return chunk_vaos.getStats();
+            }
+            
+            /**
+             * @return null until the first frame is drawn with clustered lights
+             */
+            [[nodiscard]] inline const cluster_stats* getClusterStats() const {
+                return clusters ? &clusters->getStats() : nullptr;
+            }
+            
+            /**
+             * @return null if occlusion culling is off
+             */
+            [[nodiscard]] inline const occlusion_stats* getOcclusionStats() const {
+                return occlusion_culling ? &occlusion.getStats() : nullptr;
+            }
+            
+            /**
+             * @return null if the visibility graph is off
+             */
+            [[nodiscard]] inline const visibility_stats* getVisibilityStats() const {
+                return visibility_graph ? &graph_stats : nullptr;
+            }
+            
+            /**
+             * @return null until the first frame is drawn with occlusion queries
+             */
+            [[nodiscard]] inline const query_stats* getQueryStats() const {
+                return queries ? &queries->getStats() : nullptr;
+            }
             
             inline bool setBlock(const block_pos& pos, block_type blockID) {
                 auto c = getChunk(pos);
@@ -204,7 +589,12 @@ namespace fp {
                     return false;
                 // mark the chunk for a mesh update
                 c->markDirty();
-                c->getBlockStorage()->set(_static::world_to_internal(pos), blockID);
+                {
+                    // the light engine might be reading the blocks
+                    auto lock = lights.lock();
+                    c->getBlockStorage()->set(_static::world_to_internal(pos), blockID);
+                }
+                lights.blockChanged(pos);
                 return true;
             }
             
@@ -8,10 +8,15 @@
 
 #include <shaders/chunk.frag>
 #include <shaders/chunk.vert>
+#include <shaders/deferred.vert>
 #include "render/camera.h"
 #include "world/world.h"
+#include <world/chunk/generator.h>
 #include "util/settings.h"
 #include <util/math.h>
+#include <util/tasks.h>
+#include <util/frame_profiler.h>
+#include <thread>
 
 
 #ifdef __EMSCRIPTEN__
@@ -20,23 +25,42 @@
     #define EGL_EGLEXT_PROTOTYPES
 #endif
 
-fp::shader* chunk_shader;
+fp::shader* chunk_shaders[fp::RENDER_PASS_COUNT];
 fp::world* world;
 fp::renderer* renderer;
+// null unless the DEFERRED setting is on
+fp::deferred_renderer* deferred = nullptr;
 
 void loop(){
+    fp::frame_profiler::beginFrame();
     glClearColor(1.0, 1.0, 1.0, 1.0);
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
     
-    world->update();
-    world->render(*chunk_shader);
+    {
+        fp::frame_profiler::scope update_scope{"World Update"};
+        world->update();
+    }
+    {
+        // the world times its own passes on the GPU
+        fp::frame_profiler::scope render_scope{"World Render"};
+        world->render(chunk_shaders, deferred);
+    }
     
     //fp::text::drawText("Hello There", 0, 0, fp::text::FONT_18, {0,0,0, 1.0});
     
     fp::camera::update();
-    fp::debug::render();
-    fp::graphics::render();
-    fp::window::update();
+    fp::debug::render(*world);
+    {
+        fp::frame_profiler::scope graphics_scope{"Graphics"};
+        fp::frame_profiler::gpu_scope gpu_graphics_scope{"Graphics"};
+        fp::graphics::render();
+    }
+    {
+        // includes waiting on vsync
+        fp::frame_profiler::scope swap_scope{"Swap"};
+        fp::window::update();
+    }
+    fp::frame_profiler::endFrame();
 }
 
 int main() {
@@ -48,18 +72,95 @@ int main() {
 #endif
     
     blt::logging::init(logging_properties);
-    fp::settings::load("settings.txt");
     
-    fp::window::init();
+    /*
+     * Startup is a graph of tasks so the slow CPU work (decoding images, loading the font, generating the spawn chunks)
+     * overlaps with window creation. Anything touching GL is pinned to the main thread.
+     */
+    fp::task_graph startup;
+    
+    auto settings_task = startup.addTask("Settings", fp::ANY_THREAD, []() -> void {
+        fp::settings::load("settings.txt");
+        fp::block_storage::getSlabs().setHugePages(fp::settings::get("HUGE_PAGES") == "1");
+    });
+    auto window_task = startup.addTask("Window", fp::MAIN_THREAD, []() -> void { fp::window::init(); });
+    auto font_task = startup.addTask("Font Load", fp::ANY_THREAD, []() -> void { fp::graphics::loadFont(); });
+    auto texture_task = startup.addTask("Texture Decode", fp::ANY_THREAD, []() -> void { fp::registry::registerDefaultTextures(); }, {settings_task});
+    // textures must be decoded before the blocks can look up their IDs
+    auto block_task = startup.addTask("Block Registry", fp::ANY_THREAD, []() -> void {
+        fp::registry::registerDefaultBlocks();
+        fp::registry::resolveBlockTextures();
+    }, {texture_task});
+    
+    auto graphics_task = startup.addTask("Graphics", fp::MAIN_THREAD, []() -> void {
+        renderer = new fp::renderer();
+        fp::graphics::init(*renderer);
+    }, {window_task, font_task});
+    startup.addTask("Texture Upload", fp::MAIN_THREAD, []() -> void { fp::registry::generateTexturePalette(); }, {window_task, texture_task});
+    startup.addTask("Chunk Shader", fp::MAIN_THREAD, []() -> void {
+        const bool face_records = fp::settings::get("FACE_RENDERER") == "1";
+        const bool clustered_lights = fp::settings::get("CLUSTERED_LIGHTS") == "1";
+        const bool use_deferred = fp::settings::get("DEFERRED") == "1";
+        const auto bindClusterTextures = [clustered_lights](fp::shader* shader) -> void {
+            if (!clustered_lights)
+                return;
+            // the palette stays on unit 0, see light_clusters::bind()
+            shader->use();
+            shader->setInt("cluster_grid", fp::CLUSTER_GRID_UNIT);
+            shader->setInt("cluster_indices", fp::CLUSTER_INDEX_UNIT);
+        };
+        for (int pass = 0; pass < fp::RENDER_PASS_COUNT; pass++) {
+            auto defines = fp::getChunkShaderDefines(face_records, (fp::render_pass) pass, clustered_lights, use_deferred);
+            chunk_shaders[pass] = renderer->createShader(fp::shader(shader_chunk_vert, shader_chunk_frag, defines));
+            bindClusterTextures(chunk_shaders[pass]);
+        }
+        if (use_deferred) {
+            auto* lighting = renderer->createShader(fp::shader(shader_deferred_vert, shader_chunk_frag, fp::getDeferredLightingDefines(clustered_lights)));
+            bindClusterTextures(lighting);
+            deferred = new fp::deferred_renderer(lighting, fp::window::getWidth(), fp::window::getHeight());
+            // the G-buffer has to follow the framebuffer's size
+            fp::window::addResizeListener([](int width, int height) -> void { deferred->resize(width, height); });
+        }
+    }, {graphics_task, settings_task});
+    
+#ifdef __EMSCRIPTEN__
+    // the texture loader already fills the thread pool, run the graph in order on the main thread instead
+    const int worker_count = 0;
+#else
+    const int worker_count = (int) std::max(2u, std::thread::hardware_concurrency() / 2);
+#endif
+    
+    // the spawn area is split into interleaved x slices, one task each. Every task generates into its own list so the workers never share anything
+    typedef std::vector<std::pair<fp::chunk_pos, fp::block_storage*>> pregen_list;
+    const int pregen_tasks = std::max(1, worker_count);
+    std::vector<pregen_list> pregen_slices(pregen_tasks);
+    std::vector<fp::task_graph::task_id> world_dependencies{block_task, settings_task};
+    for (int i = 0; i < pregen_tasks; i++) {
+        auto& slice = pregen_slices[i];
+        world_dependencies.push_back(startup.addTask("World Pregeneration", fp::ANY_THREAD, [i, pregen_tasks, &slice]() -> void {
+            const int distance = std::stoi(fp::settings::get("PREGEN_DISTANCE"));
+            for (int x = -distance + i; x < distance; x += pregen_tasks) {
+                for (int y = -distance; y < distance; y++) {
+                    for (int z = -distance; z < distance; z++) {
+                        auto* storage = new fp::block_storage();
+                        fp::generator::generateTerrain(storage, {x, y, z});
+                        slice.emplace_back(fp::chunk_pos{x, y, z}, storage);
+                    }
+                }
+            }
+        }, {settings_task}));
+    }
     
-    renderer = new fp::renderer();
-    fp::graphics::init(*renderer);
-    // textures must come first as blocks will require the IDs
-    fp::registry::registerDefaultTextures();
-    fp::registry::registerDefaultBlocks();
+    // chunks only create their GL objects once they have a mesh to upload, so the world can be assembled off the main thread
+    startup.addTask("World", fp::ANY_THREAD, [&pregen_slices]() -> void {
+        world = new fp::world();
+        for (auto& slice : pregen_slices) {
+            for (auto& p : slice)
+                world->insertPregenerated(p.first, p.second);
+        }
+    }, world_dependencies);
     
-    chunk_shader = renderer->createShader(fp::shader(shader_chunk_vert, shader_chunk_frag));
-    world = new fp::world();
+    startup.run(worker_count);
     
     glEnable(GL_CULL_FACE);
     glEnable(GL_DEPTH_TEST);
@@ -79,11 +180,13 @@ int main() {
 #endif
     
     delete(world);
+    delete(deferred);
     delete(renderer);
     
     /** !! MUST BE CALLED HERE OTHERWISE glDeleteTextures WILL BE CALLED AFTER THE GL CONTEXT IS DESTROYED! !! **/
     fp::registry::cleanup();
     fp::graphics::cleanup();
+    fp::frame_profiler::cleanup();
     fp::window::close();
     fp::settings::save("settings.txt");
     
@@ -4,12 +4,31 @@
  * See LICENSE file for license detail
  */
 #include <render/fbo.h>
+#include <blt/std/logging.h>
 
 namespace fp {
-
-    void FBO::attach(fp::texture::gl_texture* texture) {
-        texture->bind();
+    
+    void FBO::attach(fp::texture::gl_texture* texture, GLenum attachment) {
+        bind();
+        glFramebufferTexture2D(GL_FRAMEBUFFER, attachment, GL_TEXTURE_2D, texture->getTextureID(), 0);
         
+        if (attachment < GL_COLOR_ATTACHMENT0 || attachment >= GL_COLOR_ATTACHMENT0 + 16)
+            return;
+        const auto index = attachment - GL_COLOR_ATTACHMENT0;
+        if (draw_buffers.size() <= index)
+            draw_buffers.resize(index + 1, GL_NONE);
+        draw_buffers[index] = attachment;
+        glDrawBuffers((GLsizei) draw_buffers.size(), draw_buffers.data());
+    }
+    
+    bool FBO::isComplete() const {
+        bind();
+        auto status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+        if (status != GL_FRAMEBUFFER_COMPLETE) {
+            BLT_ERROR("Framebuffer %d is incomplete! (status 0x%x)", fboID, status);
+            return false;
+        }
+        return true;
     }
     
-}
\ No newline at end of file
+}
@@ -13,6 +13,16 @@
 #include <blt/std/memory.h>
 #include <blt/std/loader.h>
 #include <render/textures.h>
+#include <render/texture_cache.h>
+#include <fstream>
+#include <cstdio>
+#include <algorithm>
+
+// linked programs are cached on desktop GL. WebGL has no way to get a program binary
+#ifndef __EMSCRIPTEN__
+    #include <filesystem>
+    #define FP_PROGRAM_BINARY_CACHE
+#endif
 
 namespace fp::_static {
     bool matricesUBOCreated = false;
@@ -32,7 +42,7 @@ namespace fp::_static {
         glBindBuffer(GL_UNIFORM_BUFFER, 0);
     
         // set the main matrices UBO to be in position 0. This will always be reserved for this purpose.
-        glBindBufferBase(GL_UNIFORM_BUFFER, 0, matricesUBO);
+        glBindBufferBase(GL_UNIFORM_BUFFER, STANDARD_MATRICES_BINDING, matricesUBO);
     }
     
     inline void updatePerspectiveUBO(){
@@ -65,6 +75,26 @@ namespace fp::_static {
 }
 
 namespace fp {
+    
+    constexpr std::uint32_t PROGRAM_CACHE_MAGIC = 0x43535046; // FPSC
+    // bump this whenever the layout of the file changes
+    constexpr std::uint32_t PROGRAM_CACHE_VERSION = 1;
+    const std::string PROGRAM_CACHE_DIRECTORY = "shader_cache";
+    
+    struct program_cache_header {
+        std::uint32_t magic;
+        std::uint32_t version;
+        std::uint64_t key;
+        std::uint32_t format;
+        std::uint32_t length;
+    };
+    
+    static inline std::string programCachePath(std::uint64_t key) {
+        char name[17];
+        std::snprintf(name, sizeof(name), "%016llx", (unsigned long long) key);
+        return PROGRAM_CACHE_DIRECTORY + "/" + name + ".bin";
+    }
+    
     VAO::VAO() {
         glGenVertexArrays(1, &vaoID);
     }
@@ -89,6 +119,21 @@ namespace fp {
             VBOs.insert({attribute_number, vbo});
     }
     
+    void VAO::bindInstancedVBO(VBO* vbo, int attribute_number, int coordinate_size, GLenum type, int stride, long offset, bool repeated) {
+        bind();
+        vbo->bind();
+        
+        if (type == GL_FLOAT)
+            glVertexAttribPointer(attribute_number, coordinate_size, type, GL_FALSE, stride <= 0 ? 0 : stride, (void*) offset);
+        else
+            glVertexAttribIPointer(attribute_number, coordinate_size, type, stride <= 0 ? 0 : stride, (void*) offset);
+        glVertexAttribDivisor(attribute_number, 1);
+        glEnableVertexAttribArray(attribute_number);
+        
+        if (!repeated)
+            VBOs.insert({attribute_number, vbo});
+    }
+    
     void VAO::bindElementVBO(VBO* vbo) {
         bind();
         vbo->bind();
@@ -96,14 +141,87 @@ namespace fp {
         VBOs.insert({-1, vbo});
     }
     
+    int vao_pool::getBucket(int capacity) {
+        int bucket = 0;
+        while (capacity > 1 && bucket < BUCKET_COUNT - 1) {
+            capacity >>= 1;
+            bucket++;
+        }
+        return bucket;
+    }
+    
+    VAO* vao_pool::acquire(int capacity) {
+        const auto bucket = getBucket(capacity);
+        // anything in a higher bucket can always hold the data. The requested bucket only holds it if this VAO is at the top of its range
+        for (int i = bucket; i <= std::min(bucket + BUCKET_SEARCH, BUCKET_COUNT - 1); i++) {
+            auto& free = buckets[i];
+            for (size_t j = free.size(); j > 0; j--) {
+                auto* vao = free[j - 1];
+                const auto vao_capacity = vao->getCapacity();
+                if (vao_capacity < capacity)
+                    continue;
+                free.erase(free.begin() + (long) (j - 1));
+                stats.pooled--;
+                stats.pooled_bytes -= vao_capacity;
+                stats.reused++;
+                stats.live++;
+                return vao;
+            }
+        }
+        // a smaller VAO still saves creating the GL objects, its buffers grow on the first update
+        for (int i = std::min(bucket, BUCKET_COUNT - 1); i >= 0; i--) {
+            auto& free = buckets[i];
+            if (free.empty())
+                continue;
+            auto* vao = free.back();
+            free.pop_back();
+            stats.pooled--;
+            stats.pooled_bytes -= vao->getCapacity();
+            stats.reused++;
+            stats.live++;
+            return vao;
+        }
+        stats.created++;
+        stats.live++;
+        return factory();
+    }
     
-    unsigned int shader::createShader(const std::string& source, int type) {
-        const char* shader_code = source.c_str();
+    void vao_pool::release(VAO* vao) {
+        if (vao == nullptr)
+            return;
+        stats.live--;
+        if (stats.pooled >= max_pooled) {
+            delete vao;
+            stats.destroyed++;
+            return;
+        }
+        vao->orphan();
+        const auto capacity = vao->getCapacity();
+        buckets[getBucket(capacity)].push_back(vao);
+        stats.pooled++;
+        stats.pooled_bytes += capacity;
+    }
+    
+    vao_pool::~vao_pool() {
+        for (auto& bucket : buckets) {
+            for (auto* vao : bucket)
+                delete vao;
+        }
+    }
+    
+    unsigned int shader::createShader(const std::string& source, int type, const std::string& defines) {
         // creates a Shader
         unsigned int shaderID = glCreateShader(type);
         // loads the shader code for later complication and uploading into the graphics card
-        // TODO: defines can be added here by sending them as additional strings. No need to edit the source string
-        glShaderSource(shaderID, 1, &shader_code, nullptr);
+        // the defines are sent as an additional string between the #version line and the rest of the source. No need to edit the source string
+        size_t version_end = 0;
+        if (source.compare(0, 8, "#version") == 0) {
+            version_end = source.find('\n');
+            version_end = version_end == std::string::npos ? source.size() : version_end + 1;
+        }
+        const char* parts[3] = {source.c_str(), defines.c_str(), source.c_str() + version_end};
+        GLint lengths[3] = {(GLint) version_end, (GLint) defines.size(), (GLint) (source.size() - version_end)};
+        glShaderSource(shaderID, 3, parts, lengths);
         // Compile it
         glCompileShader(shaderID);
         
@@ -131,7 +249,9 @@ namespace fp {
         return shaderID;
     }
     
-    shader::shader(const std::string& vertex, const std::string& fragment, const std::string& geometry, bool load_as_string) {
+    shader::shader(
+            const std::string& vertex, const std::string& fragment, const std::string& geometry, bool load_as_string, const shader_defines& defines
+    ) {
         // load shader sources
         bool load_geometry = !geometry.empty();
         std::string vertex_source = vertex;
@@ -144,19 +264,44 @@ namespace fp {
             if (load_geometry)
                 geometry_source = blt::fs::loadShaderFile(geometry);
         } else {
-            vertex_source = removeEmptyFirstLines(vertex_source);
-            fragment_source = removeEmptyFirstLines(fragment_source);
-            geometry_source = removeEmptyFirstLines(geometry_source);
+            vertex_source = trimSourceString(vertex_source);
+            fragment_source = trimSourceString(fragment_source);
+            geometry_source = trimSourceString(geometry_source);
         }
         
+        std::string define_lines;
+        for (const auto& define : defines)
+            define_lines += "#define " + define.first + " " + define.second + "\n";
+        
+#ifdef FP_PROGRAM_BINARY_CACHE
+        // everything which can change the compiled program, including the driver since binaries are only valid for the one that made them
+        std::uint64_t key = texture::HASH_SEED;
+        texture::hashBytes(key, &PROGRAM_CACHE_VERSION, sizeof(PROGRAM_CACHE_VERSION));
+        for (auto name : {GL_VENDOR, GL_RENDERER, GL_VERSION}) {
+            auto* str = (const char*) glGetString(name);
+            if (str)
+                texture::hashBytes(key, str, std::strlen(str));
+        }
+        texture::hashBytes(key, define_lines.data(), define_lines.size());
+        texture::hashBytes(key, vertex_source.data(), vertex_source.size());
+        texture::hashBytes(key, fragment_source.data(), fragment_source.size());
+        if (loadProgramBinary(key)) {
+            reflect();
+            return;
+        }
+#endif
+        
         // create the shaders
-        vertexShaderID = createShader(vertex_source, GL_VERTEX_SHADER);
-        fragmentShaderID = createShader(fragment_source, GL_FRAGMENT_SHADER);
+        vertexShaderID = createShader(vertex_source, GL_VERTEX_SHADER, define_lines);
+        fragmentShaderID = createShader(fragment_source, GL_FRAGMENT_SHADER, define_lines);
         if (load_geometry)
             BLT_ERROR("Unable to load geometry shader because webgl doesn't support it!");
         
         // bind them to a program
         programID = glCreateProgram();
+#ifdef FP_PROGRAM_BINARY_CACHE
+        glProgramParameteri(programID, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+#endif
         // attach the loaded shaders to the Shader program
         glAttachShader(programID, vertexShaderID);
         glAttachShader(programID, fragmentShaderID);
@@ -185,11 +330,114 @@ namespace fp {
             BLT_ERROR("--- --- --- --- --- --- --- --- ---");
         }
         
+#ifdef FP_PROGRAM_BINARY_CACHE
+        if (success)
+            saveProgramBinary(key);
+#endif
+        
         glValidateProgram(programID);
-        use();
-        setUniformBlockLocation("StandardMatrices", 0);
-        glUseProgram(0);
+        reflect();
+    }
+    
+    bool shader::loadProgramBinary(std::uint64_t key) {
+#ifdef FP_PROGRAM_BINARY_CACHE
+        GLint formats = 0;
+        glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+        if (formats <= 0)
+            return false;
+        
+        std::ifstream file{programCachePath(key), std::ios::binary};
+        if (!file)
+            return false;
+        program_cache_header header{};
+        if (!file.read((char*) &header, sizeof(header)) || header.magic != PROGRAM_CACHE_MAGIC || header.version != PROGRAM_CACHE_VERSION ||
+            header.key != key)
+            return false;
+        std::vector<char> binary(header.length);
+        if (!file.read(binary.data(), (std::streamsize) binary.size()))
+            return false;
+        
+        programID = glCreateProgram();
+        glProgramBinary(programID, header.format, binary.data(), (GLsizei) binary.size());
+        GLint success;
+        glGetProgramiv(programID, GL_LINK_STATUS, &success);
+        if (!success) {
+            // drivers are allowed to reject binaries at any time (updates, different settings) so this isn't an error, just recompile
+            BLT_DEBUG("Cached program binary was rejected by the driver, recompiling");
+            glDeleteProgram(programID);
+            programID = 0;
+            return false;
+        }
+        return true;
+#else
+        return false;
+#endif
+    }
+    
+    void shader::saveProgramBinary(std::uint64_t key) const {
+#ifdef FP_PROGRAM_BINARY_CACHE
+        GLint formats = 0;
+        glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+        GLint length = 0;
+        glGetProgramiv(programID, GL_PROGRAM_BINARY_LENGTH, &length);
+        if (formats <= 0 || length <= 0)
+            return;
+        
+        std::vector<char> binary(length);
+        GLenum format = 0;
+        glGetProgramBinary(programID, length, &length, &format, binary.data());
         
+        std::error_code error;
+        std::filesystem::create_directories(PROGRAM_CACHE_DIRECTORY, error);
+        std::ofstream file{programCachePath(key), std::ios::binary | std::ios::trunc};
+        if (!file) {
+            BLT_WARN("Unable to write program binary to %s", programCachePath(key).c_str());
+            return;
+        }
+        program_cache_header header{PROGRAM_CACHE_MAGIC, PROGRAM_CACHE_VERSION, key, format, (std::uint32_t) length};
+        file.write((const char*) &header, sizeof(header));
+        file.write(binary.data(), length);
+#endif
+    }
+    
+    void shader::reflect() {
+        GLint count = 0;
+        GLint max_length = 0;
+        glGetProgramiv(programID, GL_ACTIVE_UNIFORMS, &count);
+        glGetProgramiv(programID, GL_ACTIVE_UNIFORM_MAX_LENGTH, &max_length);
+        blt::scoped_buffer<GLchar> name{static_cast<unsigned long>(max_length + 1)};
+        for (GLint i = 0; i < count; i++) {
+            GLint size;
+            GLenum type;
+            GLsizei length = 0;
+            glGetActiveUniform(programID, i, max_length + 1, &length, &size, &type, name.buffer);
+            // uniforms inside a block don't have a location, they are set through the block's buffer
+            auto loc = glGetUniformLocation(programID, name.buffer);
+            if (loc < 0)
+                continue;
+            std::string uniform_name{name.buffer, (size_t) length};
+            // arrays are reported as name[0]
+            auto bracket = uniform_name.find('[');
+            if (bracket != std::string::npos)
+                uniform_name = uniform_name.substr(0, bracket);
+            uniformVars[uniform_name].i = loc;
+        }
+        
+        glGetProgramiv(programID, GL_ACTIVE_UNIFORM_BLOCKS, &count);
+        glGetProgramiv(programID, GL_ACTIVE_UNIFORM_BLOCK_MAX_NAME_LENGTH, &max_length);
+        blt::scoped_buffer<GLchar> block_name{static_cast<unsigned long>(max_length + 1)};
+        for (GLint i = 0; i < count; i++) {
+            glGetActiveUniformBlockName(programID, i, max_length + 1, nullptr, block_name.buffer);
+            std::string block{block_name.buffer};
+            if (block == "StandardMatrices")
+                glUniformBlockBinding(programID, i, STANDARD_MATRICES_BINDING);
+            else if (block == "DrawData")
+                glUniformBlockBinding(programID, i, DRAW_DATA_BINDING);
+            else if (block == "PointLights")
+                glUniformBlockBinding(programID, i, POINT_LIGHTS_BINDING);
+            else
+                BLT_WARN("Shader %d uses unknown uniform block %s, it must be bound with setUniformBlockLocation()", programID, block.c_str());
+        }
     }
     
     void shader::bindAttribute(int attribute, const std::string &name) const {
@@ -207,21 +455,25 @@ namespace fp {
         // shader was moved
         if (programID <= 0)
             return;
-        // remove all the shaders from the program
-        glDetachShader(programID, vertexShaderID);
+        // remove all the shaders from the program. Programs loaded from the binary cache never had any
+        if (vertexShaderID)
+            glDetachShader(programID, vertexShaderID);
         if (geometryShaderID)
             glDetachShader(programID, geometryShaderID);
         if (tessellationShaderID)
             glDetachShader(programID, tessellationShaderID);
-        glDetachShader(programID, fragmentShaderID);
+        if (fragmentShaderID)
+            glDetachShader(programID, fragmentShaderID);
     
         // delete the shaders
-        glDeleteShader(vertexShaderID);
+        if (vertexShaderID)
+            glDeleteShader(vertexShaderID);
         if (geometryShaderID)
             glDeleteShader(geometryShaderID);
         if (tessellationShaderID)
             glDeleteShader(tessellationShaderID);
-        glDeleteShader(fragmentShaderID);
+        if (fragmentShaderID)
+            glDeleteShader(fragmentShaderID);
     
         // delete the Shader program
         glDeleteProgram(programID);
@@ -246,6 +498,14 @@ namespace fp {
         return _static::pvm;
     }
     
+    const blt::mat4x4& shader::getProjectionMatrix() {
+        return _static::projectionMatrix;
+    }
+    
+    const blt::mat4x4& shader::getViewMatrix() {
+        return _static::viewMatrix;
+    }
+    
     shader::shader(shader&& move) noexcept {
         // the move constructor doesn't need to construct a new shader but it does need to ensure all old variables are moved over
         programID = move.programID;
@@ -0,0 +1,71 @@
+/*
+ * Created by Brett on 19/10/26.
+ * Licensed under GNU General Public License V3.0
+ * See LICENSE file for license detail
+ */
+#include <render/lighting/clustered_lights.h>
+#include <algorithm>
+
+fp::light_clusters::light_clusters() {
+    glGenBuffers(1, &uboID);
+    glBindBuffer(GL_UNIFORM_BUFFER, uboID);
+    glBufferData(GL_UNIFORM_BUFFER, sizeof(point_lights_block), nullptr, GL_DYNAMIC_DRAW);
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+    
+    // integer textures can't be filtered
+    glGenTextures(1, &grid_texture);
+    glBindTexture(GL_TEXTURE_2D, grid_texture);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RG16UI, CLUSTER_X * CLUSTER_Y, CLUSTER_Z, 0, GL_RG_INTEGER, GL_UNSIGNED_SHORT, nullptr);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    
+    glGenTextures(1, &index_texture);
+    glBindTexture(GL_TEXTURE_2D, index_texture);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_R16UI, CLUSTER_INDEX_WIDTH, MAX_CLUSTER_INDICES / CLUSTER_INDEX_WIDTH, 0, GL_RED_INTEGER,
+                 GL_UNSIGNED_SHORT, nullptr);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glBindTexture(GL_TEXTURE_2D, 0);
+}
+
+void fp::light_clusters::update(const std::vector<fp::point_light>& lights) {
+    const auto& projection = shader::getProjectionMatrix();
+    grid.setProjection(projection.m(0, 0), projection.m(1, 1));
+    grid.assign(lights, shader::getViewMatrix());
+    
+    GLint viewport[4];
+    glGetIntegerv(GL_VIEWPORT, viewport);
+    block.cluster_params = blt::vec4{(float) viewport[2], (float) viewport[3], cluster_grid::getSliceScale(), cluster_grid::getSliceBias()};
+    const auto light_count = grid.getStats().lights;
+    std::copy(lights.begin(), lights.begin() + (long) light_count, block.lights);
+    
+    // only the lights in use are sent, the shader never indexes past them
+    glBindBuffer(GL_UNIFORM_BUFFER, uboID);
+    glBufferSubData(GL_UNIFORM_BUFFER, 0, (GLsizeiptr) (sizeof(blt::vec4) + light_count * sizeof(point_light)), &block);
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+    
+    glBindTexture(GL_TEXTURE_2D, grid_texture);
+    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, CLUSTER_X * CLUSTER_Y, CLUSTER_Z, GL_RG_INTEGER, GL_UNSIGNED_SHORT, grid.getGrid().data());
+    const auto& indices = grid.getIndices();
+    if (!indices.empty()) {
+        glBindTexture(GL_TEXTURE_2D, index_texture);
+        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, CLUSTER_INDEX_WIDTH, (int) (indices.size() / CLUSTER_INDEX_WIDTH), GL_RED_INTEGER,
+                        GL_UNSIGNED_SHORT, indices.data());
+    }
+    glBindTexture(GL_TEXTURE_2D, 0);
+}
+
+void fp::light_clusters::bind() const {
+    glBindBufferBase(GL_UNIFORM_BUFFER, POINT_LIGHTS_BINDING, uboID);
+    glActiveTexture(GL_TEXTURE0 + CLUSTER_GRID_UNIT);
+    glBindTexture(GL_TEXTURE_2D, grid_texture);
+    glActiveTexture(GL_TEXTURE0 + CLUSTER_INDEX_UNIT);
+    glBindTexture(GL_TEXTURE_2D, index_texture);
+    glActiveTexture(GL_TEXTURE0);
+}
+
+fp::light_clusters::~light_clusters() {
+    glDeleteTextures(1, &index_texture);
+    glDeleteTextures(1, &grid_texture);
+    glDeleteBuffers(1, &uboID);
+}
@@ -0,0 +1,160 @@
+/*
+ * Created by Brett on 19/10/26.
+ * Licensed under GNU General Public License V3.0
+ * See LICENSE file for license detail
+ */
+#include <render/lighting/clusters.h>
+#include <algorithm>
+#include <cmath>
+
+#if defined(__SSE__) || defined(_M_X64)
+    #include <xmmintrin.h>
+    #define FP_CLUSTER_SSE
+#endif
+
+static_assert(fp::CLUSTER_X % 4 == 0, "clusters are tested 4 x tiles at a time");
+static_assert(fp::MAX_POINT_LIGHTS <= 65536 && fp::MAX_CLUSTER_INDICES <= 65536, "light indices and offsets are 16 bit");
+
+// scale and bias turning log(depth) into a depth slice, chunk.frag gets the same values from the PointLights block
+static const float slice_scale = (float) fp::CLUSTER_Z / std::log(fp::CLUSTER_FAR / fp::CLUSTER_NEAR);
+static const float slice_bias = -std::log(fp::CLUSTER_NEAR) * slice_scale;
+
+fp::cluster_grid::cluster_grid():
+        min_x(CLUSTER_COUNT), max_x(CLUSTER_COUNT), min_y(CLUSTER_COUNT), max_y(CLUSTER_COUNT), min_z(CLUSTER_COUNT),
+        max_z(CLUSTER_COUNT), grid(CLUSTER_COUNT * 2) {}
+
+int fp::cluster_grid::getSlice(float depth) {
+    if (depth <= CLUSTER_NEAR)
+        return 0;
+    return (int) std::floor(std::log(depth) * slice_scale + slice_bias);
+}
+
+float fp::cluster_grid::getSliceDepth(int slice) {
+    // slice 0 reaches all the way to the camera
+    if (slice <= 0)
+        return 0;
+    return CLUSTER_NEAR * std::pow(CLUSTER_FAR / CLUSTER_NEAR, (float) slice / CLUSTER_Z);
+}
+
+float fp::cluster_grid::getSliceScale() {
+    return slice_scale;
+}
+
+float fp::cluster_grid::getSliceBias() {
+    return slice_bias;
+}
+
+void fp::cluster_grid::setProjection(float projection_x, float projection_y) {
+    if (projection_x == x_scale && projection_y == y_scale)
+        return;
+    x_scale = projection_x;
+    y_scale = projection_y;
+    
+    for (int k = 0; k < CLUSTER_Z; k++) {
+        const float near = getSliceDepth(k);
+        const float far = getSliceDepth(k + 1);
+        for (int j = 0; j < CLUSTER_Y; j++) {
+            // the tile's edges as slopes (view space offset per unit of depth)
+            const float bottom = (-1.0f + 2.0f * (float) j / CLUSTER_Y) / y_scale;
+            const float top = (-1.0f + 2.0f * (float) (j + 1) / CLUSTER_Y) / y_scale;
+            for (int i = 0; i < CLUSTER_X; i++) {
+                const float left = (-1.0f + 2.0f * (float) i / CLUSTER_X) / x_scale;
+                const float right = (-1.0f + 2.0f * (float) (i + 1) / CLUSTER_X) / x_scale;
+                const auto index = (k * CLUSTER_Y + j) * CLUSTER_X + i;
+                // the froxel is a frustum, its box has to hold the corners at both the near and far depth
+                min_x[index] = std::min(left * near, left * far);
+                max_x[index] = std::max(right * near, right * far);
+                min_y[index] = std::min(bottom * near, bottom * far);
+                max_y[index] = std::max(top * near, top * far);
+                // the camera looks down -z
+                min_z[index] = -far;
+                max_z[index] = -near;
+            }
+        }
+    }
+}
+
+void fp::cluster_grid::assign(const std::vector<fp::point_light>& lights, const blt::mat4x4& view) {
+    overlaps.clear();
+    stats = {};
+    stats.lights = std::min(lights.size(), (size_t) MAX_POINT_LIGHTS);
+    
+    for (size_t l = 0; l < stats.lights; l++) {
+        const auto& position = lights[l].position;
+        const float radius = position.w();
+        const float x = view.m(0, 0) * position.x() + view.m(0, 1) * position.y() + view.m(0, 2) * position.z() + view.m(0, 3);
+        const float y = view.m(1, 0) * position.x() + view.m(1, 1) * position.y() + view.m(1, 2) * position.z() + view.m(1, 3);
+        const float z = view.m(2, 0) * position.x() + view.m(2, 1) * position.y() + view.m(2, 2) * position.z() + view.m(2, 3);
+        const float depth = -z;
+        if (depth + radius < 0 || depth - radius > CLUSTER_FAR)
+            continue;
+        
+        // only the slices the sphere's depth range covers can be touched
+        const int first_slice = std::max(0, getSlice(depth - radius));
+        const int last_slice = std::min(CLUSTER_Z - 1, getSlice(depth + radius));
+        const float radius2 = radius * radius;
+#ifdef FP_CLUSTER_SSE
+        const __m128 light_x = _mm_set1_ps(x);
+        const __m128 light_y = _mm_set1_ps(y);
+        const __m128 light_z = _mm_set1_ps(z);
+        const __m128 light_radius2 = _mm_set1_ps(radius2);
+        const __m128 zero = _mm_setzero_ps();
+#endif
+        for (int k = first_slice; k <= last_slice; k++) {
+            for (int j = 0; j < CLUSTER_Y; j++) {
+                const auto row = (k * CLUSTER_Y + j) * CLUSTER_X;
+                for (int i = 0; i < CLUSTER_X; i += 4) {
+                    const auto base = row + i;
+                    int mask = 0;
+#ifdef FP_CLUSTER_SSE
+                    // squared distance from the light to the closest point of each box, 4 boxes at once
+                    __m128 dx = _mm_max_ps(_mm_sub_ps(_mm_loadu_ps(&min_x[base]), light_x), _mm_sub_ps(light_x, _mm_loadu_ps(&max_x[base])));
+                    __m128 dy = _mm_max_ps(_mm_sub_ps(_mm_loadu_ps(&min_y[base]), light_y), _mm_sub_ps(light_y, _mm_loadu_ps(&max_y[base])));
+                    __m128 dz = _mm_max_ps(_mm_sub_ps(_mm_loadu_ps(&min_z[base]), light_z), _mm_sub_ps(light_z, _mm_loadu_ps(&max_z[base])));
+                    dx = _mm_max_ps(dx, zero);
+                    dy = _mm_max_ps(dy, zero);
+                    dz = _mm_max_ps(dz, zero);
+                    const __m128 distance2 = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), _mm_mul_ps(dz, dz));
+                    mask = _mm_movemask_ps(_mm_cmple_ps(distance2, light_radius2));
+#else
+                    for (int n = 0; n < 4; n++) {
+                        const float dx = std::max(0.0f, std::max(min_x[base + n] - x, x - max_x[base + n]));
+                        const float dy = std::max(0.0f, std::max(min_y[base + n] - y, y - max_y[base + n]));
+                        const float dz = std::max(0.0f, std::max(min_z[base + n] - z, z - max_z[base + n]));
+                        if (dx * dx + dy * dy + dz * dz <= radius2)
+                            mask |= 1 << n;
+                    }
+#endif
+                    for (int n = 0; n < 4; n++) {
+                        if (mask & (1 << n))
+                            overlaps.emplace_back(base + n, (unsigned short) l);
+                    }
+                }
+            }
+        }
+    }
+    
+    // counting sort the overlaps into one list, each cluster's lights next to each other
+    std::fill(grid.begin(), grid.end(), 0);
+    std::vector<unsigned int> counts(CLUSTER_COUNT, 0);
+    for (const auto& overlap : overlaps)
+        counts[overlap.first]++;
+    unsigned int offset = 0;
+    for (int c = 0; c < CLUSTER_COUNT; c++) {
+        const auto count = std::min(counts[c], (unsigned int) MAX_CLUSTER_INDICES - offset);
+        stats.max_per_cluster = std::max(stats.max_per_cluster, (size_t) counts[c]);
+        stats.dropped += counts[c] - count;
+        grid[c * 2] = (unsigned short) offset;
+        grid[c * 2 + 1] = (unsigned short) count;
+        // reused as the write cursor below
+        counts[c] = offset;
+        offset += count;
+    }
+    indices.assign((offset + CLUSTER_INDEX_WIDTH - 1) / CLUSTER_INDEX_WIDTH * CLUSTER_INDEX_WIDTH, 0);
+    for (const auto& overlap : overlaps) {
+        const auto c = overlap.first;
+        if (counts[c] < (unsigned int) grid[c * 2] + grid[c * 2 + 1])
+            indices[counts[c]++] = overlap.second;
+    }
+    stats.indices = offset;
+}
@@ -4,4 +4,77 @@
  * See LICENSE file for license detail
  */
 #include <render/lighting/deferred_renderer.h>
+#include <blt/std/logging.h>
 
+fp::deferred_renderer::deferred_renderer(fp::shader* lighting, int width, int height): lighting(lighting) {
+    glGenVertexArrays(1, &empty_vao);
+    lighting->use();
+    lighting->setInt("gbuffer_albedo", GBUFFER_ALBEDO_UNIT);
+    lighting->setInt("gbuffer_normal", GBUFFER_NORMAL_UNIT);
+    lighting->setInt("gbuffer_depth", GBUFFER_DEPTH_UNIT);
+    createTargets(width, height);
+}
+
+void fp::deferred_renderer::createTargets(int width, int height) {
+    gbuffer = new FBO();
+    albedo = new texture::gl_buffer_texture(width, height, GL_RGBA8);
+    normal = new texture::gl_buffer_texture(width, height, GL_RGBA8);
+    depth = new texture::gl_buffer_texture(width, height, GL_DEPTH_COMPONENT24);
+    gbuffer->attach(albedo, GL_COLOR_ATTACHMENT0);
+    gbuffer->attach(normal, GL_COLOR_ATTACHMENT1);
+    gbuffer->attach(depth, GL_DEPTH_ATTACHMENT);
+    if (gbuffer->isComplete())
+        BLT_DEBUG("Created %dx%d G-buffer", width, height);
+    FBO::unbind();
+}
+
+void fp::deferred_renderer::deleteTargets() {
+    delete gbuffer;
+    delete albedo;
+    delete normal;
+    delete depth;
+}
+
+void fp::deferred_renderer::resize(int width, int height) {
+    if (width == getWidth() && height == getHeight())
+        return;
+    deleteTargets();
+    createTargets(width, height);
+}
+
+void fp::deferred_renderer::beginGeometry() const {
+    gbuffer->bind();
+    // cleared per attachment so the sky color set for the default framebuffer is left alone
+    const float zero[4] = {0, 0, 0, 0};
+    const float far = 1;
+    glClearBufferfv(GL_COLOR, 0, zero);
+    glClearBufferfv(GL_COLOR, 1, zero);
+    glClearBufferfv(GL_DEPTH, 0, &far);
+}
+
+void fp::deferred_renderer::endGeometry() {
+    FBO::unbind();
+}
+
+void fp::deferred_renderer::light() const {
+    lighting->use();
+    glActiveTexture(GL_TEXTURE0 + GBUFFER_ALBEDO_UNIT);
+    albedo->bind();
+    glActiveTexture(GL_TEXTURE0 + GBUFFER_NORMAL_UNIT);
+    normal->bind();
+    glActiveTexture(GL_TEXTURE0 + GBUFFER_DEPTH_UNIT);
+    depth->bind();
+    glActiveTexture(GL_TEXTURE0);
+    
+    // the pass writes the G-buffer depth itself (gl_FragDepth), the depth already in the framebuffer must not reject it
+    glDepthFunc(GL_ALWAYS);
+    glBindVertexArray(empty_vao);
+    glDrawArrays(GL_TRIANGLES, 0, 3);
+    glBindVertexArray(0);
+    glDepthFunc(GL_LESS);
+}
+
+fp::deferred_renderer::~deferred_renderer() {
+    deleteTargets();
+    glDeleteVertexArrays(1, &empty_vao);
+}
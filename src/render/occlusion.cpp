@@ -0,0 +1,264 @@
+/*
+ * Created by Brett on 19/10/26.
+ * Licensed under GNU General Public License V3.0
+ * See LICENSE file for license detail
+ */
+#include <render/occlusion.h>
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+
+#if defined(__SSE__) || defined(_M_X64)
+    #include <xmmintrin.h>
+    #define FP_OCCLUSION_SSE
+#endif
+
+static_assert(fp::OCCLUSION_WIDTH % 4 == 0, "rows are rasterized and tested 4 pixels at a time");
+
+// corners of a box, bit 0 picks max x, bit 1 max y and bit 2 max z
+static inline blt::vec3 corner(const blt::vec3& min, const blt::vec3& max, int i) {
+    return {(i & 1) ? max.x() : min.x(), (i & 2) ? max.y() : min.y(), (i & 4) ? max.z() : min.z()};
+}
+
+// the corners of each box face, counter-clockwise when seen from outside the box. Ordered the same as the face enum
+static const int FACE_CORNERS[6][4] = {
+        {1, 3, 7, 5},
+        {0, 4, 6, 2},
+        {2, 6, 7, 3},
+        {0, 1, 5, 4},
+        {4, 5, 7, 6},
+        {0, 2, 3, 1}
+};
+
+/**
+ * Andrew's monotone chain, only x and y are looked at
+ * @return number of points written to hull, counter-clockwise. Less than 3 if the points are on a line
+ */
+static int convexHull(const blt::vec3 corners[8], blt::vec3 hull[16]) {
+    blt::vec3 points[8];
+    std::copy(corners, corners + 8, points);
+    std::sort(points, points + 8, [](const blt::vec3& a, const blt::vec3& b) -> bool {
+        return a.x() < b.x() || (a.x() == b.x() && a.y() < b.y());
+    });
+    const auto cross = [](const blt::vec3& o, const blt::vec3& a, const blt::vec3& b) -> float {
+        return (a.x() - o.x()) * (b.y() - o.y()) - (a.y() - o.y()) * (b.x() - o.x());
+    };
+    int count = 0;
+    // lower half left to right, then the upper half back
+    for (int i = 0; i < 8; i++) {
+        while (count >= 2 && cross(hull[count - 2], hull[count - 1], points[i]) <= 0)
+            count--;
+        hull[count++] = points[i];
+    }
+    for (int i = 6, lower = count + 1; i >= 0; i--) {
+        while (count >= lower && cross(hull[count - 2], hull[count - 1], points[i]) <= 0)
+            count--;
+        hull[count++] = points[i];
+    }
+    // the first point was added again to close the loop
+    return count - 1;
+}
+
+fp::occlusion_buffer::occlusion_buffer(): depth(OCCLUSION_WIDTH * OCCLUSION_HEIGHT, FLT_MAX) {}
+
+blt::vec3 fp::occlusion_buffer::project(float x, float y, float z) const {
+    const float clip_x = pvm[0][0] * x + pvm[0][1] * y + pvm[0][2] * z + pvm[0][3];
+    const float clip_y = pvm[1][0] * x + pvm[1][1] * y + pvm[1][2] * z + pvm[1][3];
+    const float clip_w = pvm[3][0] * x + pvm[3][1] * y + pvm[3][2] * z + pvm[3][3];
+    return {(clip_x / clip_w * 0.5f + 0.5f) * OCCLUSION_WIDTH, (clip_y / clip_w * 0.5f + 0.5f) * OCCLUSION_HEIGHT, clip_w};
+}
+
+void fp::occlusion_buffer::begin(const blt::mat4x4& projection_view) {
+    for (int r = 0; r < 4; r++) {
+        for (int c = 0; c < 4; c++)
+            pvm[r][c] = projection_view.m(r, c);
+    }
+    std::fill(depth.begin(), depth.end(), FLT_MAX);
+    stats = {};
+}
+
+void fp::occlusion_buffer::rasterizePolygon(const blt::vec3* points, int count, const depth_plane* planes, int plane_count, float farthest) {
+    float min_x = FLT_MAX, min_y = FLT_MAX, max_x = -FLT_MAX, max_y = -FLT_MAX;
+    for (int i = 0; i < count; i++) {
+        min_x = std::min(min_x, points[i].x());
+        min_y = std::min(min_y, points[i].y());
+        max_x = std::max(max_x, points[i].x());
+        max_y = std::max(max_y, points[i].y());
+    }
+    const int x0 = std::max(0, (int) std::floor(min_x));
+    const int x1 = std::min(OCCLUSION_WIDTH - 1, (int) std::floor(max_x));
+    const int y0 = std::max(0, (int) std::floor(min_y));
+    const int y1 = std::min(OCCLUSION_HEIGHT - 1, (int) std::floor(max_y));
+    if (x0 > x1 || y0 > y1)
+        return;
+    stats.polygons++;
+    
+    // edge functions as A * x + B * y + C, positive on the inside of a counter-clockwise polygon.
+    // boxes are tested against every pixel they touch, so a pixel only counts as covered if all of it is inside. C is moved in by
+    // the most the edge function changes from a pixel's center to its corners, the center test then checks the corner furthest out
+    float edge_a[8], edge_b[8], edge_c[8];
+    for (int i = 0; i < count; i++) {
+        const auto& p = points[i];
+        const auto& q = points[(i + 1) % count];
+        edge_a[i] = p.y() - q.y();
+        edge_b[i] = q.x() - p.x();
+        edge_c[i] = (q.y() - p.y()) * p.x() - (q.x() - p.x()) * p.y() - 0.5f * (std::abs(edge_a[i]) + std::abs(edge_b[i]));
+    }
+    // the depth planes get the same treatment, moved to the pixel corner where the plane is farthest away
+    float plane_c[3];
+    for (int i = 0; i < plane_count; i++)
+        plane_c[i] = planes[i].c - 0.5f * (std::abs(planes[i].x) + std::abs(planes[i].y));
+    
+    // rows start on a multiple of 4, the extra pixels are outside the polygon's bounds and fail the edge tests
+    const int start_x = x0 & ~3;
+#ifdef FP_OCCLUSION_SSE
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 one = _mm_set1_ps(1.0f);
+    const __m128 max_depth = _mm_set1_ps(farthest);
+    const __m128 first_centers = _mm_setr_ps((float) start_x + 0.5f, (float) start_x + 1.5f, (float) start_x + 2.5f, (float) start_x + 3.5f);
+    __m128 step[8], edge_x[8], plane_step[3], plane_x[3];
+    for (int i = 0; i < count; i++) {
+        step[i] = _mm_set1_ps(edge_a[i] * 4);
+        // pixel centers of the first 4 pixels of a row
+        edge_x[i] = _mm_mul_ps(_mm_set1_ps(edge_a[i]), first_centers);
+    }
+    for (int i = 0; i < plane_count; i++) {
+        plane_step[i] = _mm_set1_ps(planes[i].x * 4);
+        plane_x[i] = _mm_mul_ps(_mm_set1_ps(planes[i].x), first_centers);
+    }
+#endif
+    for (int y = y0; y <= y1; y++) {
+        float* row = &depth[y * OCCLUSION_WIDTH];
+        const float center_y = (float) y + 0.5f;
+#ifdef FP_OCCLUSION_SSE
+        __m128 edges[8], inverse_depths[3];
+        for (int i = 0; i < count; i++)
+            edges[i] = _mm_add_ps(edge_x[i], _mm_set1_ps(edge_b[i] * center_y + edge_c[i]));
+        for (int i = 0; i < plane_count; i++)
+            inverse_depths[i] = _mm_add_ps(plane_x[i], _mm_set1_ps(planes[i].y * center_y + plane_c[i]));
+        for (int x = start_x; x <= x1; x += 4) {
+            __m128 inside = _mm_cmpge_ps(edges[0], zero);
+            for (int i = 1; i < count; i++)
+                inside = _mm_and_ps(inside, _mm_cmpge_ps(edges[i], zero));
+            // the depth the ray enters the box at is the farthest of the front faces' planes, never past the farthest corner
+            __m128 write_depth = zero;
+            for (int i = 0; i < plane_count; i++) {
+                const __m128 positive = _mm_cmpgt_ps(inverse_depths[i], zero);
+                const __m128 plane_depth = _mm_or_ps(_mm_and_ps(positive, _mm_div_ps(one, inverse_depths[i])), _mm_andnot_ps(positive, max_depth));
+                write_depth = _mm_max_ps(write_depth, plane_depth);
+            }
+            write_depth = _mm_min_ps(write_depth, max_depth);
+            const __m128 old = _mm_loadu_ps(row + x);
+            _mm_storeu_ps(row + x, _mm_or_ps(_mm_and_ps(inside, _mm_min_ps(old, write_depth)), _mm_andnot_ps(inside, old)));
+            for (int i = 0; i < count; i++)
+                edges[i] = _mm_add_ps(edges[i], step[i]);
+            for (int i = 0; i < plane_count; i++)
+                inverse_depths[i] = _mm_add_ps(inverse_depths[i], plane_step[i]);
+        }
+#else
+        for (int x = start_x; x <= x1; x++) {
+            const float center_x = (float) x + 0.5f;
+            bool inside = true;
+            for (int i = 0; i < count; i++)
+                inside &= edge_a[i] * center_x + edge_b[i] * center_y + edge_c[i] >= 0;
+            if (!inside)
+                continue;
+            // the depth the ray enters the box at is the farthest of the front faces' planes, never past the farthest corner
+            float write_depth = 0;
+            for (int i = 0; i < plane_count; i++) {
+                const float inverse_depth = planes[i].x * center_x + planes[i].y * center_y + plane_c[i];
+                write_depth = std::max(write_depth, inverse_depth > 0 ? 1.0f / inverse_depth : farthest);
+            }
+            row[x] = std::min(row[x], std::min(write_depth, farthest));
+        }
+#endif
+    }
+}
+
+void fp::occlusion_buffer::addOccluder(const blt::vec3& min, const blt::vec3& max) {
+    blt::vec3 projected[8];
+    float farthest = 0;
+    for (int i = 0; i < 8; i++) {
+        const auto p = corner(min, max, i);
+        projected[i] = project(p.x(), p.y(), p.z());
+        // clipping isn't worth it, the occluders right next to the camera can be skipped
+        if (projected[i].z() < OCCLUSION_NEAR)
+            return;
+        farthest = std::max(farthest, projected[i].z());
+    }
+    stats.occluders++;
+    
+    // 1 / depth is linear across the screen for any plane, which gives the depth of every front face at every pixel
+    depth_plane planes[3];
+    int plane_count = 0;
+    for (const auto& face : FACE_CORNERS) {
+        const auto& a = projected[face[0]];
+        const auto& b = projected[face[1]];
+        const auto& c = projected[face[3]];
+        const float ab_x = b.x() - a.x(), ab_y = b.y() - a.y();
+        const float ac_x = c.x() - a.x(), ac_y = c.y() - a.y();
+        const float area = ab_x * ac_y - ab_y * ac_x;
+        // faces pointing away from the camera wind clockwise on screen, edge on faces cover nothing
+        if (area <= 0 || plane_count == 3)
+            continue;
+        const float inverse_a = 1.0f / a.z(), inverse_ab = 1.0f / b.z() - inverse_a, inverse_ac = 1.0f / c.z() - inverse_a;
+        auto& plane = planes[plane_count++];
+        plane.x = (inverse_ab * ac_y - inverse_ac * ab_y) / area;
+        plane.y = (inverse_ac * ab_x - inverse_ab * ac_x) / area;
+        plane.c = inverse_a - plane.x * a.x() - plane.y * a.y();
+    }
+    
+    // the box's outline is drawn in one go. Split into faces or triangles, the pixels along the shared edges would only ever be
+    // partly covered by each piece and never written
+    blt::vec3 hull[16];
+    const int count = convexHull(projected, hull);
+    if (count >= 3)
+        rasterizePolygon(hull, count, planes, plane_count, farthest);
+}
+
+bool fp::occlusion_buffer::isVisible(const blt::vec3& min, const blt::vec3& max) {
+    stats.tested++;
+    float min_x = FLT_MAX, min_y = FLT_MAX, max_x = -FLT_MAX, max_y = -FLT_MAX, nearest = FLT_MAX;
+    for (int i = 0; i < 8; i++) {
+        const auto p = corner(min, max, i);
+        const auto projected = project(p.x(), p.y(), p.z());
+        // the box reaches behind the camera
+        if (projected.z() < OCCLUSION_NEAR)
+            return true;
+        min_x = std::min(min_x, projected.x());
+        min_y = std::min(min_y, projected.y());
+        max_x = std::max(max_x, projected.x());
+        max_y = std::max(max_y, projected.y());
+        nearest = std::min(nearest, projected.z());
+    }
+    if (max_x < 0 || max_y < 0 || min_x >= OCCLUSION_WIDTH || min_y >= OCCLUSION_HEIGHT) {
+        stats.outside++;
+        return false;
+    }
+    
+    // every pixel the box's screen rectangle touches must hold an occluder in front of the box
+    const int x0 = std::max(0, (int) std::floor(min_x)) & ~3;
+    const int x1 = std::min(OCCLUSION_WIDTH - 1, (int) std::floor(max_x));
+    const int y0 = std::max(0, (int) std::floor(min_y));
+    const int y1 = std::min(OCCLUSION_HEIGHT - 1, (int) std::floor(max_y));
+#ifdef FP_OCCLUSION_SSE
+    const __m128 box_depth = _mm_set1_ps(nearest);
+#endif
+    for (int y = y0; y <= y1; y++) {
+        const float* row = &depth[y * OCCLUSION_WIDTH];
+        // testing a few pixels past the rectangle's left edge can only make the box more visible
+        for (int x = x0; x <= x1; x += 4) {
+#ifdef FP_OCCLUSION_SSE
+            if (_mm_movemask_ps(_mm_cmpge_ps(_mm_loadu_ps(row + x), box_depth)))
+                return true;
+#else
+            for (int n = 0; n < 4; n++) {
+                if (row[x + n] >= nearest)
+                    return true;
+            }
+#endif
+        }
+    }
+    stats.occluded++;
+    return false;
+}
@@ -0,0 +1,121 @@
+/*
+ * Created by Brett on 19/10/26.
+ * Licensed under GNU General Public License V3.0
+ * See LICENSE file for license detail
+ */
+#include <render/occlusion_queries.h>
+#include <shaders/occlusion_box.vert>
+#include <shaders/occlusion_box.frag>
+#include <algorithm>
+
+void fp::chunk_query::poll(fp::query_pool& queries) {
+    // results from before the chunk was last culled are stale, it is drawn again until a fresh one comes back
+    if (last_frame + 1 != queries.frame)
+        visible_for = QUERY_HYSTERESIS;
+    last_frame = queries.frame;
+    
+    if (pending) {
+        GLuint available = 0;
+        glGetQueryObjectuiv(id, GL_QUERY_RESULT_AVAILABLE, &available);
+        if (available) {
+            GLuint passed = 0;
+            glGetQueryObjectuiv(id, GL_QUERY_RESULT, &passed);
+            pending = false;
+            visible_for = passed ? QUERY_HYSTERESIS : std::max(0, visible_for - 1);
+        }
+    }
+
+#ifdef FP_CONDITIONAL_RENDER
+    // the GPU knows the answer before we do, let it decide
+    conditional = !isVisible() && pending;
+    if (conditional)
+        queries.stats.conditional++;
+#endif
+}
+
+fp::chunk_query::~chunk_query() {
+    if (id)
+        pool->release(id);
+}
+
+fp::query_pool::query_pool(): box_shader(shader_occlusion_box_vert, shader_occlusion_box_frag) {
+    box_min = box_shader.getUniform("box_min");
+    box_max = box_shader.getUniform("box_max");
+    glGenVertexArrays(1, &empty_vao);
+}
+
+unsigned int fp::query_pool::acquire() {
+    if (free_queries.empty()) {
+        free_queries.resize(QUERY_BATCH);
+        glGenQueries(QUERY_BATCH, free_queries.data());
+    }
+    auto query = free_queries.back();
+    free_queries.pop_back();
+    stats.live++;
+    stats.pooled = free_queries.size();
+    return query;
+}
+
+void fp::query_pool::release(unsigned int query) {
+    // a query still in flight can be reused, starting it again just drops the old result
+    free_queries.push_back(query);
+    stats.live--;
+    stats.pooled = free_queries.size();
+}
+
+void fp::query_pool::beginFrame() {
+    frame++;
+    stats.issued = 0;
+    stats.hidden = 0;
+    stats.conditional = 0;
+}
+
+void fp::query_pool::beginBoxes() {
+    box_shader.use();
+    glBindVertexArray(empty_vao);
+    glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+    glDepthMask(GL_FALSE);
+    // the camera can be close enough for the front faces to be clipped, the back faces still have to be tested then
+    glDisable(GL_CULL_FACE);
+}
+
+void fp::query_pool::drawBox(fp::chunk_query& query, const blt::vec3& min, const blt::vec3& max) {
+    if (!query.id) {
+        query.pool = this;
+        query.id = acquire();
+    }
+    box_shader.setVec3(box_min, min);
+    box_shader.setVec3(box_max, max);
+    glBeginQuery(GL_ANY_SAMPLES_PASSED, query.id);
+    glDrawArrays(GL_TRIANGLES, 0, 36);
+    glEndQuery(GL_ANY_SAMPLES_PASSED);
+    query.pending = true;
+    stats.issued++;
+}
+
+void fp::query_pool::endBoxes() {
+    glEnable(GL_CULL_FACE);
+    glDepthMask(GL_TRUE);
+    glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+    glBindVertexArray(0);
+}
+
+void fp::query_pool::beginConditional(const fp::chunk_query& query) {
+#ifdef FP_CONDITIONAL_RENDER
+    if (query.conditional)
+        glBeginConditionalRender(query.id, GL_QUERY_NO_WAIT);
+#endif
+}
+
+void fp::query_pool::endConditional(const fp::chunk_query& query) {
+#ifdef FP_CONDITIONAL_RENDER
+    if (query.conditional)
+        glEndConditionalRender();
+#endif
+}
+
+fp::query_pool::~query_pool() {
+    // the chunks must already be gone, their queries are deleted with the rest of the pool
+    glDeleteQueries((GLsizei) free_queries.size(), free_queries.data());
+    glDeleteVertexArrays(1, &empty_vao);
+}
@@ -0,0 +1,208 @@
+/*
+ * Created by Brett on 19/10/26.
+ * Licensed under GNU General Public License V3.0
+ * See LICENSE file for license detail
+ */
+#include <render/texture_cache.h>
+#include <render/textures.h>
+#include <blt/std/logging.h>
+#include <fstream>
+#include <cstring>
+
+#if defined(__unix__) && !defined(__EMSCRIPTEN__)
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+    #include <fcntl.h>
+    #include <unistd.h>
+    #define FP_MMAP_SUPPORTED
+#endif
+
+namespace fp::texture {
+    
+    constexpr std::uint32_t CACHE_MAGIC = 0x43545046; // FPTC
+    // bump this whenever the layout of the file changes
+    constexpr std::uint32_t CACHE_VERSION = 1;
+    
+    struct cache_header {
+        std::uint32_t magic;
+        std::uint32_t version;
+        std::uint64_t key;
+        std::uint32_t texture_size;
+        std::uint32_t levels;
+        std::uint32_t layer_count;
+        std::uint32_t padding;
+    };
+    
+    static inline size_t alignTo16(size_t offset) {
+        return (offset + 15) & ~size_t(15);
+    }
+    
+    void palette_cache::computeKey(const std::vector<file_texture*>& sources) {
+        std::uint64_t hash = HASH_SEED;
+        hashBytes(hash, &CACHE_VERSION, sizeof(CACHE_VERSION));
+        hashBytes(hash, &m_TextureSize, sizeof(m_TextureSize));
+        hashBytes(hash, &m_Levels, sizeof(m_Levels));
+        
+        std::vector<char> buffer;
+        for (auto* source : sources) {
+            hashBytes(hash, source->getName().data(), source->getName().size());
+            hashBytes(hash, source->getPath().data(), source->getPath().size());
+            
+            std::ifstream file{source->getPath(), std::ios::binary | std::ios::ate};
+            if (!file) {
+                // a missing source can't be baked, but it shouldn't match an old cache either
+                hashBytes(hash, "missing", 7);
+                continue;
+            }
+            buffer.resize((size_t) file.tellg());
+            file.seekg(0);
+            file.read(buffer.data(), (std::streamsize) buffer.size());
+            hashBytes(hash, buffer.data(), buffer.size());
+        }
+        m_Key = hash;
+    }
+    
+    bool palette_cache::load() {
+        release();
+#ifdef __EMSCRIPTEN__
+        // assets are preloaded into a memory filesystem which doesn't persist, there is nothing to gain from a cache
+        return false;
+#else
+    #ifdef FP_MMAP_SUPPORTED
+        int fd = open(m_Path.c_str(), O_RDONLY);
+        if (fd < 0)
+            return false;
+        struct stat file_stat{};
+        if (fstat(fd, &file_stat) != 0 || file_stat.st_size < (off_t) sizeof(cache_header)) {
+            close(fd);
+            return false;
+        }
+        m_Size = (size_t) file_stat.st_size;
+        void* mapped = mmap(nullptr, m_Size, PROT_READ, MAP_PRIVATE, fd, 0);
+        close(fd);
+        if (mapped == MAP_FAILED)
+            return false;
+        m_Data = (unsigned char*) mapped;
+        m_Mapped = true;
+    #else
+        std::ifstream file{m_Path, std::ios::binary | std::ios::ate};
+        if (!file)
+            return false;
+        m_Size = (size_t) file.tellg();
+        if (m_Size < sizeof(cache_header))
+            return false;
+        file.seekg(0);
+        m_Data = new unsigned char[m_Size];
+        file.read((char*) m_Data, (std::streamsize) m_Size);
+    #endif
+        
+        cache_header header{};
+        std::memcpy(&header, m_Data, sizeof(header));
+        if (header.magic != CACHE_MAGIC || header.version != CACHE_VERSION || header.key != m_Key ||
+            header.texture_size != (std::uint32_t) m_TextureSize || header.levels != (std::uint32_t) m_Levels) {
+            BLT_INFO("Texture cache %s is stale, rebuilding", m_Path.c_str());
+            release();
+            return false;
+        }
+        
+        size_t offset = sizeof(cache_header);
+        for (std::uint32_t i = 0; i < header.layer_count; i++) {
+            std::uint32_t length = 0;
+            if (offset + sizeof(length) > m_Size) {
+                release();
+                return false;
+            }
+            std::memcpy(&length, m_Data + offset, sizeof(length));
+            offset += sizeof(length);
+            if (offset + length > m_Size) {
+                release();
+                return false;
+            }
+            m_Names.emplace_back((const char*) m_Data + offset, length);
+            offset += length;
+        }
+        
+        offset = alignTo16(offset);
+        size_t layer_size = 0;
+        for (int level = 0; level < m_Levels; level++)
+            layer_size += levelSize(m_TextureSize, level);
+        for (std::uint32_t i = 0; i < header.layer_count; i++) {
+            m_LayerOffsets.push_back(offset);
+            offset += layer_size;
+        }
+        // a truncated file is treated the same as a stale one
+        if (offset > m_Size) {
+            release();
+            return false;
+        }
+        
+        BLT_INFO("Loaded %d textures from cache %s", header.layer_count, m_Path.c_str());
+        return true;
+#endif
+    }
+    
+    void palette_cache::save(const std::vector<file_texture*>& textures) const {
+#ifdef __EMSCRIPTEN__
+        return;
+#endif
+        std::ofstream file{m_Path, std::ios::binary | std::ios::trunc};
+        if (!file) {
+            BLT_WARN("Unable to write texture cache %s", m_Path.c_str());
+            return;
+        }
+        cache_header header{CACHE_MAGIC, CACHE_VERSION, m_Key, (std::uint32_t) m_TextureSize, (std::uint32_t) m_Levels,
+                            (std::uint32_t) textures.size(), 0};
+        file.write((const char*) &header, sizeof(header));
+        size_t offset = sizeof(header);
+        
+        for (auto* t : textures) {
+            auto length = (std::uint32_t) t->getName().size();
+            file.write((const char*) &length, sizeof(length));
+            file.write(t->getName().data(), length);
+            offset += sizeof(length) + length;
+        }
+        
+        const char zeros[16]{};
+        file.write(zeros, (std::streamsize) (alignTo16(offset) - offset));
+        
+        for (auto* t : textures) {
+            for (int level = 0; level < m_Levels; level++) {
+                const auto* data = t->level(level);
+                // the palette already warned about it, bake what it uploaded instead
+                if (!data) {
+                    auto missing = file_texture::getMissingLevel(std::max(1, m_TextureSize >> level));
+                    file.write((const char*) missing.data(), (std::streamsize) levelSize(m_TextureSize, level));
+                    continue;
+                }
+                file.write((const char*) data, (std::streamsize) levelSize(m_TextureSize, level));
+            }
+        }
+        BLT_INFO("Wrote %d textures to cache %s", textures.size(), m_Path.c_str());
+    }
+    
+    const unsigned char* palette_cache::getLevel(int layer, int level) const {
+        auto offset = m_LayerOffsets[layer];
+        for (int i = 0; i < level; i++)
+            offset += levelSize(m_TextureSize, i);
+        return m_Data + offset;
+    }
+    
+    void palette_cache::release() {
+        if (m_Data) {
+#ifdef FP_MMAP_SUPPORTED
+            if (m_Mapped)
+                munmap(m_Data, m_Size);
+            else
+                delete[] m_Data;
+#else
+            delete[] m_Data;
+#endif
+        }
+        m_Data = nullptr;
+        m_Size = 0;
+        m_Mapped = false;
+        m_Names.clear();
+        m_LayerOffsets.clear();
+    }
+    
+}
@@ -8,11 +8,15 @@
 #include <render/window.h>
 #include <blt/math/averages.h>
 #include "render/camera.h"
+#include <util/frame_profiler.h>
+#include <world/world.h>
+#include <blt/std/format.h>
 
 namespace fp::debug {
     const float spacing = 5;
     
     bool enabled = false;
+    bool chunk_bounds = false;
     
     void drawAndIncrement(const std::string& text, float x, float& pos, graphics::font_size size = fp::graphics::FONT_14) {
         auto text_size = fp::graphics::getTextSize(text, size);
@@ -32,11 +36,22 @@ namespace fp::debug {
         enabled = !enabled;
     }
     
-    void render() {
+    bool showChunkBounds() {
+        return enabled && chunk_bounds;
+    }
+    
+    void render(fp::world& world) {
         if (fp::window::isKeyPressed(GLFW_KEY_F3) && fp::window::keyState())
             toggle();
         if (!enabled)
             return;
+        if (fp::window::isKeyPressed(GLFW_KEY_F4) && fp::window::keyState())
+            chunk_bounds = !chunk_bounds;
+        // places a lamp where the camera is, for trying out the point lights
+        if (fp::window::isKeyPressed(GLFW_KEY_L) && fp::window::keyState()) {
+            const auto& camera = fp::camera::getPosition();
+            world.setBlock({camera.x(), camera.y(), camera.z()}, fp::registry::LAMP);
+        }
         
         float left_y_pos = 10;
         float right_y_pos = 10;
@@ -61,5 +76,46 @@ namespace fp::debug {
         pos += std::to_string(camera_pos.z());
     
         drawAndIncrement(pos, x_offset * 2, left_y_pos);
+        
+        const auto& vaos = world.getVAOPoolStats();
+        drawAndIncrement("Chunk VAOs: " + std::to_string(vaos.live) + " live, " + std::to_string(vaos.pooled) + " pooled ("
+                         + blt::string::fromBytes(vaos.pooled_bytes) + ")", x_offset * 2, left_y_pos);
+        drawAndIncrement("VAO Pool: " + std::to_string(vaos.created) + " created, " + std::to_string(vaos.reused) + " reused, "
+                         + std::to_string(vaos.destroyed) + " destroyed", x_offset * 2, left_y_pos);
+        
+        const auto slabs = fp::block_storage::getSlabs().getStats();
+        drawAndIncrement("Block Arrays: " + std::to_string(slabs.live) + " / " + std::to_string(slabs.capacity) + " in "
+                         + std::to_string(slabs.slabs) + " slabs (" + std::to_string(slabs.huge_page_slabs) + " huge)", x_offset * 2, left_y_pos);
+        // meshes waiting on upload, this should drop back down once the camera stops
+        const auto mesh_blocks = fp::bump_arena::getBlocks().getStats();
+        drawAndIncrement("Mesh Blocks: " + std::to_string(mesh_blocks.live) + " / " + std::to_string(mesh_blocks.capacity) + " in "
+                         + std::to_string(mesh_blocks.slabs) + " slabs", x_offset * 2, left_y_pos);
+        
+        if (const auto* view = world.getViewController()) {
+            drawAndIncrement("View Distance: " + std::to_string(view->getRadius() * 2) + " (CPU " + std::to_string(view->getCPUTime()) + "ms, GPU "
+                             + std::to_string(view->getGPUTime()) + "ms, target " + std::to_string(view->getTarget()) + "ms)", x_offset * 2, left_y_pos);
+        }
+        if (const auto* clusters = world.getClusterStats()) {
+            drawAndIncrement("Point Lights: " + std::to_string(clusters->lights) + ", " + std::to_string(clusters->indices) + " indices (max "
+                             + std::to_string(clusters->max_per_cluster) + " per cluster, " + std::to_string(clusters->dropped) + " dropped)",
+                             x_offset * 2, left_y_pos);
+        }
+        if (const auto* occlusion = world.getOcclusionStats()) {
+            drawAndIncrement("Occlusion: " + std::to_string(occlusion->occluders) + " occluders (" + std::to_string(occlusion->polygons)
+                             + " polygons), " + std::to_string(occlusion->occluded + occlusion->outside) + " / " + std::to_string(occlusion->tested)
+                             + " culled (" + std::to_string(occlusion->outside) + " off screen)", x_offset * 2, left_y_pos);
+        }
+        if (const auto* graph = world.getVisibilityStats()) {
+            drawAndIncrement("Visibility Graph: " + std::to_string(graph->reached) + " reached, " + std::to_string(graph->culled) + " culled",
+                             x_offset * 2, left_y_pos);
+        }
+        if (const auto* queries = world.getQueryStats()) {
+            drawAndIncrement("Queries: " + std::to_string(queries->issued) + " issued, " + std::to_string(queries->hidden) + " hidden, "
+                             + std::to_string(queries->conditional) + " conditional (" + std::to_string(queries->live) + " live, "
+                             + std::to_string(queries->pooled) + " pooled)", x_offset * 2, left_y_pos);
+        }
+        
+        left_y_pos += spacing;
+        fp::frame_profiler::render(x_offset * 2, left_y_pos);
     }
 }
@@ -5,18 +5,22 @@
  */
 
 #include <render/ui/graphics.h>
-#include <render/ui/planes.h>
+#include <render/ui/debug_geometry.h>
 #include <blt/std/logging.h>
 #include <queue>
 #include <ft2build.h>
 #include FT_FREETYPE_H
 
-#include <unordered_map>
 #include <shaders/text.vert>
-#include <shaders/plane.vert>
+#include <shaders/debug.vert>
 #include <shaders/text.frag>
-#include <shaders/plane.frag>
+#include <shaders/debug.frag>
 #include <cmath>
+#include <cstring>
+#include <vector>
+#include <fstream>
+#include <cstdint>
+#include <render/texture_cache.h>
 
 namespace fp::graphics {
     
@@ -29,13 +33,28 @@ namespace fp::graphics {
     };
 
 // https://freetype.org/freetype2/docs/glyphs/glyph-metrics-3.svg
-    struct gl_character {
-        unsigned int textureID; // OpenGL texture ID that holds the character
-        int_vec2 size; // size of the character glyph
-        int_vec2 bearing; // offset to the top left of the glyph from the current cursor pos
-        unsigned int advance; // distance to the next glyph
+    struct sdf_character {
+        // distance field at SDF_BASE_SIZE, kept after upload so the cache can be written out
+        std::vector<unsigned char> pixels;
+        int_vec2 size{}; // size of the character glyph, including the spread around the outline
+        int_vec2 bearing{}; // offset to the top left of the glyph from the current cursor pos
+        unsigned int advance = 0; // distance to the next glyph
+        float uv_min_x = 0, uv_min_y = 0, uv_max_x = 0, uv_max_y = 0; // location of the glyph inside the atlas
+        // the distance field exists, either rasterized this run or loaded from the cache
+        bool generated = false;
+        // an upload was attempted, in_atlas is false if there was no room left for it
+        bool uploaded = false;
+        bool in_atlas = false;
     };
     
+    // one instance of the text quad, laid out to match attributes 1-3 of the text shader
+    struct glyph_instance {
+        float x, y, w, h;
+        float uv_min_x, uv_min_y, uv_max_x, uv_max_y;
+        blt::vec4 color;
+    };
+    static_assert(sizeof(glyph_instance) == sizeof(float) * 12, "glyph instances must be tightly packed to match the text VAO");
+    
     struct text_render_object {
         std::string text;
         float x = 0;
@@ -44,7 +63,7 @@ namespace fp::graphics {
         blt::vec4 color;
         // currently does nothing
         blt::vec4 backgroundColor;
-        // DO NOT USE SCALE UNLESS NECESSARY. Will distort font!
+        // multiplied with the font size, the glyphs are distance fields so any scale stays sharp
         float scale = 0;
         
         text_render_object() = default;
@@ -59,101 +78,304 @@ namespace fp::graphics {
     
     /** ---------{ Variables }--------- **/
     
-    std::unordered_map<font_size, std::unordered_map<char, gl_character>> character_conversion_map;
+    // every glyph is rendered once at this size, then scaled to whatever size is requested
+    constexpr int SDF_BASE_SIZE = 32;
+    // the atlas is only allocated once the first glyph is drawn
+    constexpr int ATLAS_SIZE = 512;
+    // space between glyphs so linear filtering doesn't bleed into the neighbours
+    constexpr int ATLAS_PADDING = 1;
+    
+    constexpr std::uint32_t FONT_CACHE_MAGIC = 0x43465046; // FPFC
+    // bump this whenever the layout of the file changes
+    constexpr std::uint32_t FONT_CACHE_VERSION = 1;
+    const std::string FONT_CACHE_PATH = "font_cache.bin";
+    
+    struct font_cache_header {
+        std::uint32_t magic;
+        std::uint32_t version;
+        std::uint64_t key;
+        std::uint32_t base_size;
+        std::uint32_t glyph_count;
+    };
+    
+    struct font_cache_glyph {
+        std::int32_t character;
+        std::int32_t width, height;
+        std::int32_t bearing_x, bearing_y;
+        std::uint32_t advance;
+    };
+    
+    // glyphs are looked up for every character drawn, so they are stored flat and indexed by the ascii character
+    sdf_character characters[128];
+    unsigned int atlas_texture = 0;
+    int atlas_x = ATLAS_PADDING, atlas_y = ATLAS_PADDING, atlas_shelf_height = 0;
+    
+    // freetype reads the face straight out of this memory, so it has to outlive the face
+    std::vector<unsigned char> font_data;
+    std::uint64_t font_key = 0;
+    // set when a glyph was generated which isn't in the cache file yet
+    bool font_cache_dirty = false;
+    bool font_loaded = false;
+    
     // every type of render-able should have its own queue.
     queue_t<text_render_object> text_render_queue;
-    queue_t<plane> plane_render_queue;
+    debug_batch debug_geometry;
     
     FT_Library ft;
     FT_Face monospaced_face;
     
     fp::shader* text_shader;
-    fp::shader* plane_shader;
+    fp::shader* debug_shader;
+    uniform_handle debug_screen_space;
     fp::VAO* quad_vao;
-    fp::VAO* plane_vao;
+    std::vector<glyph_instance> glyph_instances;
+    fp::VAO* debug_vao;
+    // every debug list appended into one array so it can be uploaded in one go
+    std::vector<debug_vertex> debug_upload;
     
     /** ---------{ Functions }--------- **/
     
-    void generateCharacters(font_size size) {
-        
-        FT_Set_Pixel_Sizes(monospaced_face, 0, size);
+    void loadFontCache() {
+#ifdef __EMSCRIPTEN__
+        // assets are preloaded into a memory filesystem which doesn't persist, there is nothing to gain from a cache
+        return;
+#endif
+        std::ifstream file{FONT_CACHE_PATH, std::ios::binary};
+        if (!file)
+            return;
+        font_cache_header header{};
+        if (!file.read((char*) &header, sizeof(header)) || header.magic != FONT_CACHE_MAGIC || header.version != FONT_CACHE_VERSION ||
+            header.key != font_key || header.base_size != SDF_BASE_SIZE) {
+            BLT_DEBUG("Font cache is stale, glyphs will be regenerated");
+            return;
+        }
+        for (unsigned int i = 0; i < header.glyph_count; i++) {
+            font_cache_glyph glyph{};
+            if (!file.read((char*) &glyph, sizeof(glyph)) || glyph.character < 0 || glyph.character >= 128 || glyph.width < 0 || glyph.height < 0) {
+                BLT_WARN("Font cache %s is truncated or corrupt!", FONT_CACHE_PATH.c_str());
+                return;
+            }
+            auto& c = characters[glyph.character];
+            c.pixels.resize(glyph.width * glyph.height);
+            if (!file.read((char*) c.pixels.data(), (std::streamsize) c.pixels.size())) {
+                BLT_WARN("Font cache %s is truncated or corrupt!", FONT_CACHE_PATH.c_str());
+                return;
+            }
+            c.size = {glyph.width, glyph.height};
+            c.bearing = {glyph.bearing_x, glyph.bearing_y};
+            c.advance = glyph.advance;
+            c.generated = true;
+        }
+        BLT_DEBUG("Loaded %d glyphs from the font cache", header.glyph_count);
+    }
+    
+    void saveFontCache() {
+#ifdef __EMSCRIPTEN__
+        return;
+#endif
+        if (!font_cache_dirty)
+            return;
+        std::vector<int> generated;
+        for (int i = 0; i < 128; i++) {
+            if (characters[i].generated)
+                generated.push_back(i);
+        }
+        std::ofstream file{FONT_CACHE_PATH, std::ios::binary | std::ios::trunc};
+        if (!file) {
+            BLT_WARN("Unable to write font cache %s", FONT_CACHE_PATH.c_str());
+            return;
+        }
+        font_cache_header header{FONT_CACHE_MAGIC, FONT_CACHE_VERSION, font_key, SDF_BASE_SIZE, (std::uint32_t) generated.size()};
+        file.write((const char*) &header, sizeof(header));
+        for (auto i : generated) {
+            const auto& c = characters[i];
+            font_cache_glyph glyph{i, c.size.x, c.size.y, c.bearing.x, c.bearing.y, c.advance};
+            file.write((const char*) &glyph, sizeof(glyph));
+            file.write((const char*) c.pixels.data(), (std::streamsize) c.pixels.size());
+        }
+    }
+    
+    /**
+     * Renders the distance field for a single character. Only called the first time a character is used.
+     */
+    void generateCharacter(int i) {
+        auto& c = characters[i];
+        c.generated = true;
+        // tell freetype to render the character as a signed distance field, 128 is the outline and larger values are inside the glyph
+        FT_Error error;
+        if ((error = FT_Load_Char(monospaced_face, i, FT_LOAD_DEFAULT)) || (error = FT_Render_Glyph(monospaced_face->glyph, FT_RENDER_MODE_SDF))) {
+            // characters without an outline, like space, can't be rendered but still have an advance
+            if (monospaced_face->glyph)
+                c.advance = (unsigned int) monospaced_face->glyph->advance.x;
+            BLT_TRACE("Unable to render character %d using the default monospaced font! (Error: %d)", i, error);
+            return;
+        }
+        auto glyph = monospaced_face->glyph;
+        auto bitmap = glyph->bitmap;
         
-        // TODO: merge into a 2d texture array
-        unsigned int textures[128];
-        glGenTextures(128, textures);
+        // the pitch can be larger than the width, copy row by row so the upload can use an alignment of 1
+        c.pixels.resize(bitmap.width * bitmap.rows);
+        for (unsigned int row = 0; row < bitmap.rows; row++)
+            std::memcpy(&c.pixels[row * bitmap.width], bitmap.buffer + row * bitmap.pitch, bitmap.width);
+        c.size = {(int) bitmap.width, (int) bitmap.rows};
+        c.bearing = {glyph->bitmap_left, glyph->bitmap_top};
+        c.advance = (unsigned int) glyph->advance.x;
+        font_cache_dirty = true;
+    }
+    
+    /**
+     * Places the character in the next free spot of the atlas using shelves (rows as tall as the tallest glyph placed in them)
+     */
+    void uploadCharacter(sdf_character& c) {
+        c.uploaded = true;
+        if (c.size.x <= 0 || c.size.y <= 0)
+            return;
         
-        // we only care about ascii characters [0, 128). I won't be rendering with anything other than them.
-        for (int i = 0; i < 128; i++) {
-            // tell freetype to render the character to a monochrome texture
-            FT_Error error;
-            if ((error = FT_Load_Char(monospaced_face, i, FT_LOAD_RENDER))) {
-                BLT_WARN("Unable to load character '%c' using the default monospaced font! (Error: %d)", i, error);
-                glDeleteTextures(1, &textures[i]);
-                continue;
-            }
-            auto glyph = monospaced_face->glyph;
-            auto bitmap = glyph->bitmap;
-            
-            glBindTexture(GL_TEXTURE_2D, textures[i]);
+        if (atlas_texture == 0) {
+            glGenTextures(1, &atlas_texture);
+            glBindTexture(GL_TEXTURE_2D, atlas_texture);
             // GL_RED isn't valid for webgl
 #ifdef __EMSCRIPTEN__
             constexpr GLint internal_format = GL_R8;
 #else
             constexpr GLint internal_format = GL_RED;
 #endif
-            // since the rendered texture is monochrome, there is no reason to allocate memory for more than one channel.
-            glTexImage2D(GL_TEXTURE_2D, 0, internal_format, (int) bitmap.width, (int) bitmap.rows, 0, GL_RED, GL_UNSIGNED_BYTE, bitmap.buffer);
+            // the padding between glyphs must be empty, which isn't guaranteed for uninitialized storage
+            std::vector<unsigned char> empty(ATLAS_SIZE * ATLAS_SIZE, 0);
+            glTexImage2D(GL_TEXTURE_2D, 0, internal_format, ATLAS_SIZE, ATLAS_SIZE, 0, GL_RED, GL_UNSIGNED_BYTE, empty.data());
             // set standard texture options. GL_CLAMP_TO_BORDER would be preferable but isn't in standard webgl
             glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
             glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-            // linear because we want nice smoothing if our font is resized
+            // linear filtering of the distance is what makes the edges smooth at every scale
             glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
             glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-            
-            character_conversion_map[size].insert(
-                    {(char) i, gl_character{
-                            textures[i],
-                            {(int) bitmap.width, (int) bitmap.rows},
-                            {glyph->bitmap_left, glyph->bitmap_top},
-                            (unsigned int) glyph->advance.x
-                    }}
-            );
         }
+        
+        if (atlas_x + c.size.x + ATLAS_PADDING > ATLAS_SIZE) {
+            atlas_y += atlas_shelf_height + ATLAS_PADDING;
+            atlas_x = ATLAS_PADDING;
+            atlas_shelf_height = 0;
+        }
+        if (atlas_y + c.size.y + ATLAS_PADDING > ATLAS_SIZE) {
+            BLT_WARN("Font atlas is full, the glyph will not be drawn!");
+            return;
+        }
+        
+        glBindTexture(GL_TEXTURE_2D, atlas_texture);
+        // gl requires an alignment of 4 by default. Glyphs can be any width so the alignment must be changed.
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+        glTexSubImage2D(GL_TEXTURE_2D, 0, atlas_x, atlas_y, c.size.x, c.size.y, GL_RED, GL_UNSIGNED_BYTE, c.pixels.data());
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+        
+        c.uv_min_x = (float) atlas_x / ATLAS_SIZE;
+        c.uv_min_y = (float) atlas_y / ATLAS_SIZE;
+        c.uv_max_x = (float) (atlas_x + c.size.x) / ATLAS_SIZE;
+        c.uv_max_y = (float) (atlas_y + c.size.y) / ATLAS_SIZE;
+        c.in_atlas = true;
+        
+        atlas_x += c.size.x + ATLAS_PADDING;
+        atlas_shelf_height = std::max(atlas_shelf_height, c.size.y);
     }
     
-    void init(renderer& renderer) {
+    /**
+     * @return the character, generating and uploading it first if this is the first time it has been used. Must be called on the GL thread
+     */
+    inline const sdf_character& getCharacter(char ch) {
+        auto i = ch & 127;
+        auto& c = characters[i];
+        if (!c.generated && font_loaded)
+            generateCharacter(i);
+        if (!c.uploaded)
+            uploadCharacter(c);
+        return c;
+    }
+    
+    void loadFont() {
+        // we need the bytes anyway to key the cache, so freetype loads the face from memory instead of opening the file a second time
+        std::ifstream file{"assets/fonts/JetBrains Mono.ttf", std::ios::binary | std::ios::ate};
+        if (!file) {
+            BLT_ERROR("Unable to load default monospaced (JetBrains Mono) font!");
+            std::abort();
+        }
+        font_data.resize((size_t) file.tellg());
+        file.seekg(0);
+        file.read((char*) font_data.data(), (std::streamsize) font_data.size());
+        
+        font_key = texture::HASH_SEED;
+        texture::hashBytes(font_key, &FONT_CACHE_VERSION, sizeof(FONT_CACHE_VERSION));
+        texture::hashBytes(font_key, &SDF_BASE_SIZE, sizeof(SDF_BASE_SIZE));
+        texture::hashBytes(font_key, font_data.data(), font_data.size());
+        loadFontCache();
+        
         if (FT_Init_FreeType(&ft)) {
             BLT_FATAL("Unable to init freetype library!");
             std::abort();
         }
-        if (FT_New_Face(ft, "assets/fonts/JetBrains Mono.ttf", 0, &monospaced_face)) {
+        if (FT_New_Memory_Face(ft, font_data.data(), (FT_Long) font_data.size(), 0, &monospaced_face)) {
             BLT_ERROR("Unable to load default monospaced (JetBrains Mono) font!");
             std::abort();
         }
+        FT_Set_Pixel_Sizes(monospaced_face, 0, SDF_BASE_SIZE);
+        // the face is kept alive, any character which isn't cached is rendered the first time it is drawn
+        font_loaded = true;
+    }
+    
+    void renderDebugGeometry() {
+        debug_upload.clear();
+        size_t starts[DEBUG_PRIMITIVE_COUNT][2];
+        for (int primitive = 0; primitive < DEBUG_PRIMITIVE_COUNT; primitive++) {
+            for (int depth = 0; depth < 2; depth++) {
+                auto& list = debug_geometry.vertices[primitive][depth];
+                starts[primitive][depth] = debug_upload.size();
+                debug_upload.insert(debug_upload.end(), list.begin(), list.end());
+            }
+        }
+        const auto screen_start = debug_upload.size();
+        debug_upload.insert(debug_upload.end(), debug_geometry.screen_lines.begin(), debug_geometry.screen_lines.end());
+        if (debug_upload.empty())
+            return;
         
-        // disable alignment restrictions. This might cause issues with WebGL! FIXME: if it does
-        // gl requires an alignment of 4. Since we are going to only use a single character of any width/height the alignment must be changed.
-        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
-        
-        generateCharacters(FONT_11);
-        generateCharacters(FONT_12);
-        generateCharacters(FONT_14);
-        generateCharacters(FONT_18);
-        generateCharacters(FONT_22);
-        generateCharacters(FONT_36);
-        generateCharacters(FONT_48);
-        generateCharacters(FONT_72);
-        
-        glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
-        
-        FT_Done_Face(monospaced_face);
-        FT_Done_FreeType(ft);
+        debug_shader->use();
+        debug_shader->setInt(debug_screen_space, 0);
+        debug_vao->getVBO(0)->update(debug_upload);
+        debug_vao->bind();
+        // planes and boxes have to be visible from both sides
+        glDisable(GL_CULL_FACE);
+        glEnable(GL_BLEND);
+        glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+        constexpr GLenum modes[DEBUG_PRIMITIVE_COUNT] = {GL_LINES, GL_TRIANGLES, GL_POINTS};
+        // depth tested geometry first, then everything that should be drawn on top
+        for (int depth = 1; depth >= 0; depth--) {
+            if (depth)
+                glEnable(GL_DEPTH_TEST);
+            else
+                glDisable(GL_DEPTH_TEST);
+            for (int primitive = 0; primitive < DEBUG_PRIMITIVE_COUNT; primitive++) {
+                auto count = debug_geometry.vertices[primitive][depth].size();
+                if (count > 0)
+                    glDrawArrays(modes[primitive], (GLint) starts[primitive][depth], (GLsizei) count);
+            }
+        }
+        if (!debug_geometry.screen_lines.empty()) {
+            debug_shader->setInt(debug_screen_space, 1);
+            glDrawArrays(GL_LINES, (GLint) screen_start, (GLsizei) debug_geometry.screen_lines.size());
+        }
+        glEnable(GL_DEPTH_TEST);
+        glDisable(GL_BLEND);
+        glEnable(GL_CULL_FACE);
+        debug_geometry.clear();
+    }
+    
+    void init(renderer& renderer) {
+        if (!font_loaded)
+            loadFont();
         
         // create the GL objects required to render texts
         text_shader = renderer.createShader(shader(shader_text_vert, shader_text_frag));
-        plane_shader = renderer.createShader(shader(shader_plane_vert, shader_plane_frag));
+        debug_shader = renderer.createShader(shader(shader_debug_vert, shader_debug_frag));
+        debug_screen_space = debug_shader->getUniform("screen_space");
         quad_vao = new VAO();
-        plane_vao = new VAO();
+        debug_vao = new VAO();
         
         float vertices[6 * 4] = {
                 // vertices     uvs
@@ -169,56 +391,47 @@ namespace fp::graphics {
         
         
         quad_vao->bindVBO(new VBO(ARRAY_BUFFER, vertices, sizeof(float) * 6 * 4), 0, 4);
-        // since we will be updating the plane VBO regularly, we should tell the driver of this fact
-        plane_vao->bindVBO(new VBO(ARRAY_BUFFER, nullptr, 0, DYNAMIC), 0, 3, GL_FLOAT, sizeof(float) * 3);
-        plane_vao->bindElementVBO(new VBO(ELEMENT_BUFFER, nullptr, 0, DYNAMIC));
+        // every glyph drawn this frame, uploaded once per frame
+        auto* instance_vbo = new VBO(ARRAY_BUFFER, nullptr, 0, DYNAMIC);
+        quad_vao->bindInstancedVBO(instance_vbo, 1, 4, GL_FLOAT, sizeof(glyph_instance), 0);
+        quad_vao->bindInstancedVBO(instance_vbo, 2, 4, GL_FLOAT, sizeof(glyph_instance), sizeof(float) * 4, true);
+        quad_vao->bindInstancedVBO(instance_vbo, 3, 4, GL_FLOAT, sizeof(glyph_instance), sizeof(float) * 8, true);
+        // since we will be updating the debug VBO every frame, we should tell the driver of this fact
+        auto* debug_vbo = new VBO(ARRAY_BUFFER, nullptr, 0, DYNAMIC);
+        debug_vao->bindVBO(debug_vbo, 0, 3, GL_FLOAT, sizeof(debug_vertex), 0);
+        debug_vao->bindVBO(debug_vbo, 1, 4, GL_FLOAT, sizeof(debug_vertex), sizeof(float) * 3, true);
+#ifndef __EMSCRIPTEN__
+        // desktop GL ignores gl_PointSize unless this is enabled, GLES always uses it
+        glEnable(GL_PROGRAM_POINT_SIZE);
+#endif
     }
     
     void cleanup() {
-        for (const auto& c : character_conversion_map)
-            for (const auto& t : c.second)
-                glDeleteTextures(1, &t.second.textureID);
+        saveFontCache();
+        if (font_loaded) {
+            FT_Done_Face(monospaced_face);
+            FT_Done_FreeType(ft);
+            font_loaded = false;
+        }
+        glDeleteTextures(1, &atlas_texture);
         delete (quad_vao);
-        delete (plane_vao);
+        delete (debug_vao);
     }
     
     void render() {
-        // generate planes
-        plane_shader->use();
-        plane_vao->bind();
-        glDisable(GL_CULL_FACE);
-        while (!plane_render_queue.empty()) {
-            auto& f = plane_render_queue.front();
-            
-            auto p = createFlatPlane(f.plane, 10);
-            plane_shader->setVec3("color", blt::vec3{1.0, 0.0, 0.0});
-            plane_vao->getVBO(0)->update(p->vertices);
-            plane_vao->getVBO(-1)->update(p->indices);
-            
-            plane_vao->bind();
-            plane_vao->getVBO(-1)->bind();
-            glEnableVertexAttribArray(0);
-            glDrawElements(GL_TRIANGLES, (int)p->indices.size(), GL_UNSIGNED_INT, nullptr);
-            glDisableVertexAttribArray(0);
-            
-            plane_render_queue.pop();
-        }
-        glEnable(GL_CULL_FACE);
+        renderDebugGeometry();
         
         // generate and render text
         glEnable(GL_BLEND);
         //glDisable(GL_CULL_FACE);
         glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
         
-        text_shader->use();
-        quad_vao->bind();
-        glEnableVertexAttribArray(0);
-        
+        // all text is built into a single list of quads and drawn with one instanced call
+        glyph_instances.clear();
         while (!text_render_queue.empty()) {
             const auto& text_object = text_render_queue.front();
-            
-            text_shader->setVec4("text_color", text_object.color);
-            glActiveTexture(GL_TEXTURE0);
+            // glyphs only exist at the base size, every requested size is a scale of it
+            const float scale = (float) text_object.size / SDF_BASE_SIZE * text_object.scale;
             
             // will be incremented by advance
             float cursor_x = text_object.x;
@@ -227,47 +440,94 @@ namespace fp::graphics {
             int max_height = 0;
             
             // but the offset must be the max height of the characters in the text otherwise the position of smaller chars like 'o' and 'e' will be off
-            for (const char c : text_object.text) {
-                const gl_character gl_char = character_conversion_map[text_object.size][c];
-                max_height = std::max(gl_char.size.y, max_height);
-            }
+            for (const char c : text_object.text)
+                max_height = std::max(getCharacter(c).size.y, max_height);
             
-            // TODO: use instancing to reduce number of draw calls (use signed distance fields when you make the switch)
-            // valve paper on the subject (signed distance fields):
-            // https://steamcdn-a.akamaihd.net/apps/valve/2007/SIGGRAPH2007_AlphaTestedMagnification.pdf
             for (const char c : text_object.text) {
-                const gl_character gl_char = character_conversion_map[text_object.size][c];
-                
-                blt::mat4x4 translation_matrix{};
+                const auto& sdf_char = getCharacter(c);
                 
-                auto w = (float) gl_char.size.x * text_object.scale;
-                auto h = (float) gl_char.size.y * text_object.scale;
+                auto w = (float) sdf_char.size.x * scale;
+                auto h = (float) sdf_char.size.y * scale;
                 
                 // move the glyph based on https://freetype.org/freetype2/docs/glyphs/glyph-metrics-3.svg
-                auto x = cursor_x + (float) gl_char.bearing.x * text_object.scale;
-                auto y = (float) max_height + text_object.y + (float) (-gl_char.bearing.y) * text_object.scale;
-                
-                translation_matrix.translate(x, y, 0);
-                translation_matrix.scale(w, h, 0);
+                auto x = cursor_x + (float) sdf_char.bearing.x * scale;
+                auto y = (float) max_height * scale + text_object.y + (float) (-sdf_char.bearing.y) * scale;
                 
-                text_shader->setMatrix("translation", translation_matrix);
-                
-                glBindTexture(GL_TEXTURE_2D, gl_char.textureID);
-                glDrawArrays(GL_TRIANGLES, 0, 6);
+                if (sdf_char.in_atlas)
+                    glyph_instances.push_back({x, y, w, h, sdf_char.uv_min_x, sdf_char.uv_min_y, sdf_char.uv_max_x, sdf_char.uv_max_y, text_object.color});
                 // advance is loaded in as 1/64th pixels
-                cursor_x += (float) (gl_char.advance / 64.0) * text_object.scale;
+                cursor_x += (float) (sdf_char.advance / 64.0) * scale;
             }
             
             text_render_queue.pop();
         }
         
-        glDisableVertexAttribArray(0);
+        if (!glyph_instances.empty()) {
+            text_shader->use();
+            quad_vao->getVBO(1)->update(glyph_instances);
+            quad_vao->bind();
+            glActiveTexture(GL_TEXTURE0);
+            glBindTexture(GL_TEXTURE_2D, atlas_texture);
+            glDrawArraysInstanced(GL_TRIANGLES, 0, 6, (int) glyph_instances.size());
+        }
         
         glDisable(GL_BLEND);
     }
     
-    void drawPlane(const blt::vec4& plane, const blt::vec3& color) {
-        plane_render_queue.push({plane, color});
+    void drawLine(const blt::vec3& from, const blt::vec3& to, const blt::vec4& color, bool depth_test) {
+        debug_geometry.push(DEBUG_LINES, depth_test, from, color);
+        debug_geometry.push(DEBUG_LINES, depth_test, to, color);
+    }
+    
+    void drawLine2D(float x1, float y1, float x2, float y2, const blt::vec4& color) {
+        debug_geometry.screen_lines.push_back({x1, y1, 0, color.x(), color.y(), color.z(), color[3]});
+        debug_geometry.screen_lines.push_back({x2, y2, 0, color.x(), color.y(), color.z(), color[3]});
+    }
+    
+    void drawAABB(const blt::vec3& min, const blt::vec3& max, const blt::vec4& color, bool depth_test) {
+        // 12 edges, 4 along each axis
+        for (int i = 0; i < 4; i++) {
+            auto a = (i & 1) ? max : min;
+            auto b = (i & 2) ? max : min;
+            drawLine({min.x(), a.y(), b.z()}, {max.x(), a.y(), b.z()}, color, depth_test);
+            drawLine({a.x(), min.y(), b.z()}, {a.x(), max.y(), b.z()}, color, depth_test);
+            drawLine({a.x(), b.y(), min.z()}, {a.x(), b.y(), max.z()}, color, depth_test);
+        }
+    }
+    
+    void drawPoint(const blt::vec3& pos, const blt::vec4& color, bool depth_test) {
+        debug_geometry.push(DEBUG_POINTS, depth_test, pos, color);
+    }
+    
+    void drawPlane(const blt::vec4& plane, const blt::vec3& color, float size, bool depth_test) {
+        // planes are stored as ax + by + cz + d = 0
+        blt::vec3 normal{plane.x(), plane.y(), plane.z()};
+        auto length = std::sqrt(normal.x() * normal.x() + normal.y() * normal.y() + normal.z() * normal.z());
+        if (length <= 0)
+            return;
+        normal = normal * (1.0f / length);
+        auto center = normal * (-plane[3] / length);
+        
+        // any vector not parallel to the normal can be used to build the basis of the plane
+        blt::vec3 helper = std::abs(normal.y()) < 0.99f ? blt::vec3{0, 1, 0} : blt::vec3{1, 0, 0};
+        blt::vec3 tangent{normal.y() * helper.z() - normal.z() * helper.y(),
+                          normal.z() * helper.x() - normal.x() * helper.z(),
+                          normal.x() * helper.y() - normal.y() * helper.x()};
+        auto tangent_length = std::sqrt(tangent.x() * tangent.x() + tangent.y() * tangent.y() + tangent.z() * tangent.z());
+        tangent = tangent * (size / tangent_length);
+        blt::vec3 bitangent{normal.y() * tangent.z() - normal.z() * tangent.y(),
+                            normal.z() * tangent.x() - normal.x() * tangent.z(),
+                            normal.x() * tangent.y() - normal.y() * tangent.x()};
+        
+        blt::vec4 plane_color{color.x(), color.y(), color.z(), 0.5};
+        const blt::vec3 corners[4] = {
+                center - tangent - bitangent,
+                center + tangent - bitangent,
+                center + tangent + bitangent,
+                center - tangent + bitangent
+        };
+        for (auto i : {3, 1, 0, 3, 2, 1})
+            debug_geometry.push(DEBUG_TRIANGLES, depth_test, corners[i], plane_color);
     }
     
     void drawText(const std::string& text, float x, float y, font_size size, const blt::vec4& color, const blt::vec4& backgroundColor, float scale) {
@@ -276,11 +536,12 @@ namespace fp::graphics {
     
     text_size getTextSize(const std::string& text, font_size size, float scale) {
         int w = 0, h = 0;
+        const float factor = (float) size / SDF_BASE_SIZE * scale;
         for (const char& c : text) {
-            const gl_character gl_char = character_conversion_map[size][c];
+            const auto& sdf_char = getCharacter(c);
             
-            auto local_w = (int)((float)gl_char.size.x * scale);
-            auto local_h = (int)((float)gl_char.size.y * scale);
+            auto local_w = (int)((float)sdf_char.size.x * factor);
+            auto local_h = (int)((float)sdf_char.size.y * factor);
             
             w = std::max(w, local_w);
             h = std::max(h, local_h);
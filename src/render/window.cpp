@@ -8,6 +8,7 @@
 #include <blt/std/logging.h>
 #include <blt/std/time.h>
 #include <unordered_map>
+#include <vector>
 
 #ifdef __EMSCRIPTEN__
     #include <emscripten.h>
@@ -25,6 +26,10 @@ bool mouse_pressed_frame = false;
 blt::mat4x4 perspectiveMatrix;
 blt::mat4x4 orthographicMatrix;
 float fov = 90;
+int window_width = 0;
+int window_height = 0;
+// render targets which have to match the framebuffer, see fp::window::addResizeListener()
+std::vector<std::function<void(int, int)>> resize_listeners;
 
 long lastFrame = blt::system::getCurrentTimeNanoseconds();
 long delta = 1;
@@ -97,6 +102,14 @@ inline void updateWindowViewport(int width, int height){
     // make sure we update the global perspective matrix otherwise our rendering is going to look off!
     fp::shader::updateProjectionMatrix(perspectiveMatrix);
     fp::shader::updateOrthographicMatrix(orthographicMatrix);
+    
+    // minimized windows report a 0x0 framebuffer, nothing can be sized to that
+    if (width <= 0 || height <= 0)
+        return;
+    window_width = width;
+    window_height = height;
+    for (const auto& listener : resize_listeners)
+        listener(width, height);
 }
 
 /**
@@ -201,6 +214,18 @@ const blt::mat4x4& fp::window::getPerspectiveMatrix() {
     return perspectiveMatrix;
 }
 
+int fp::window::getWidth() {
+    return window_width;
+}
+
+int fp::window::getHeight() {
+    return window_height;
+}
+
+void fp::window::addResizeListener(const std::function<void(int, int)>& listener) {
+    resize_listeners.push_back(listener);
+}
+
 bool fp::window::mouseState() {
     return mouse_pressed_frame;
 }
@@ -0,0 +1,338 @@
+/*
+ * Created by Brett on 19/10/26.
+ * Licensed under GNU General Public License V3.0
+ * See LICENSE file for license detail
+ */
+#include <util/frame_profiler.h>
+#include <render/ui/graphics.h>
+#include <render/ui/text.h>
+#include <render/gl.h>
+#include <blt/std/logging.h>
+#include <blt/std/time.h>
+#include <algorithm>
+#include <vector>
+#include <cstdio>
+#include <cstring>
+
+// WebGL only has timer queries through an extension which is disabled in most browsers
+#ifndef __EMSCRIPTEN__
+    #define FP_GPU_TIMERS
+#endif
+
+namespace fp::frame_profiler {
+    
+    struct cpu_record {
+        const char* name;
+        int depth;
+        long start;
+        long end;
+    };
+    
+    struct gpu_record {
+        const char* name;
+        double ms;
+    };
+    
+    struct frame_record {
+        // frame number this slot of the ring buffer currently holds, -1 if it has never been used
+        long number = -1;
+        long start = 0;
+        long end = 0;
+        std::vector<cpu_record> cpu;
+        std::vector<gpu_record> gpu;
+        // GPU queries started during the frame, its GPU time is only whole once gpu holds this many results
+        int gpu_issued = 0;
+    };
+    
+    frame_record frames[FRAME_HISTORY];
+    long frame_number = 0;
+    // indices into the current frame's cpu records of every scope which hasn't been popped yet
+    std::vector<size_t> open_scopes;
+    
+#ifdef FP_GPU_TIMERS
+    struct pending_query {
+        GLuint id;
+        const char* name;
+        long frame;
+    };
+    std::vector<GLuint> free_queries;
+    std::vector<pending_query> pending_queries;
+    // nested GPU scopes are folded into the outermost one
+    int gpu_depth = 0;
+#endif
+    
+    inline frame_record& current() {
+        return frames[frame_number % FRAME_HISTORY];
+    }
+    
+    /**
+     * Reads back every query the GPU has finished with. Never waits, anything not ready yet is checked again next frame
+     */
+    void collectQueries() {
+#ifdef FP_GPU_TIMERS
+        for (size_t i = 0; i < pending_queries.size();) {
+            auto q = pending_queries[i];
+            GLint available = 0;
+            glGetQueryObjectiv(q.id, GL_QUERY_RESULT_AVAILABLE, &available);
+            if (!available) {
+                i++;
+                continue;
+            }
+            GLuint64 elapsed = 0;
+            glGetQueryObjectui64v(q.id, GL_QUERY_RESULT, &elapsed);
+            auto& frame = frames[q.frame % FRAME_HISTORY];
+            // the slot might have been reused already if the result took longer than the whole history
+            if (frame.number == q.frame)
+                frame.gpu.push_back({q.name, (double) elapsed / 1000000.0});
+            free_queries.push_back(q.id);
+            pending_queries[i] = pending_queries.back();
+            pending_queries.pop_back();
+        }
+#endif
+    }
+    
+    void beginFrame() {
+        collectQueries();
+        auto& frame = current();
+        frame.number = frame_number;
+        frame.start = blt::system::getCurrentTimeNanoseconds();
+        frame.end = 0;
+        frame.cpu.clear();
+        frame.gpu.clear();
+        frame.gpu_issued = 0;
+        open_scopes.clear();
+    }
+    
+    void endFrame() {
+        while (!open_scopes.empty())
+            pop();
+        current().end = blt::system::getCurrentTimeNanoseconds();
+        frame_number++;
+    }
+    
+    void push(const char* name) {
+        auto& frame = current();
+        open_scopes.push_back(frame.cpu.size());
+        frame.cpu.push_back({name, (int) open_scopes.size() - 1, blt::system::getCurrentTimeNanoseconds(), 0});
+    }
+    
+    void pop() {
+        if (open_scopes.empty())
+            return;
+        current().cpu[open_scopes.back()].end = blt::system::getCurrentTimeNanoseconds();
+        open_scopes.pop_back();
+    }
+    
+    void beginGPU(const char* name) {
+#ifdef FP_GPU_TIMERS
+        if (gpu_depth++ > 0)
+            return;
+        GLuint id;
+        if (free_queries.empty()) {
+            glGenQueries(1, &id);
+        } else {
+            id = free_queries.back();
+            free_queries.pop_back();
+        }
+        glBeginQuery(GL_TIME_ELAPSED, id);
+        pending_queries.push_back({id, name, frame_number});
+        current().gpu_issued++;
+#endif
+    }
+    
+    void endGPU() {
+#ifdef FP_GPU_TIMERS
+        if (gpu_depth <= 0 || --gpu_depth > 0)
+            return;
+        glEndQuery(GL_TIME_ELAPSED);
+#endif
+    }
+    
+    struct scope_stats {
+        const char* name;
+        int depth;
+        double last;
+        double p50;
+        double p99;
+    };
+    
+    inline double percentile(const std::vector<double>& sorted, double p) {
+        if (sorted.empty())
+            return 0;
+        return sorted[std::min(sorted.size() - 1, (size_t) (p * (double) (sorted.size() - 1) + 0.5))];
+    }
+    
+    inline bool isComplete(const frame_record& frame) {
+        return frame.number >= 0 && frame.number < frame_number && frame.end > 0;
+    }
+    
+    /**
+     * GPU results arrive a few frames late and not all at once, a frame with only some of them would look cheaper than it was
+     * @return the newest frame with every GPU query resolved, null if there is none yet
+     */
+    inline const frame_record* latestGPUFrame() {
+        const frame_record* latest_gpu = nullptr;
+        for (const auto& frame : frames) {
+            if (isComplete(frame) && frame.gpu_issued > 0 && (int) frame.gpu.size() == frame.gpu_issued &&
+                (!latest_gpu || frame.number > latest_gpu->number))
+                latest_gpu = &frame;
+        }
+        return latest_gpu;
+    }
+    
+    /**
+     * Names can come from different translation units, where the same literal might live at a different address
+     */
+    inline bool sameName(const char* a, const char* b) {
+        return a == b || std::strcmp(a, b) == 0;
+    }
+    
+    /**
+     * @return total time of every record with this name in the frame, scopes can be entered more than once per frame
+     */
+    template<typename T, typename F>
+    inline double sumRecords(const std::vector<T>& records, const char* name, F duration) {
+        double total = 0;
+        for (const auto& r : records) {
+            if (sameName(r.name, name))
+                total += duration(r);
+        }
+        return total;
+    }
+    
+    template<typename T, typename F>
+    std::vector<scope_stats> computeStats(const std::vector<T>& latest, F duration) {
+        std::vector<scope_stats> stats;
+        std::vector<double> samples;
+        for (const auto& record : latest) {
+            // only the first record of a name gets a line
+            bool seen = std::any_of(stats.begin(), stats.end(), [&record](const scope_stats& s) { return sameName(s.name, record.name); });
+            if (seen)
+                continue;
+            samples.clear();
+            for (const auto& frame : frames) {
+                if (!isComplete(frame))
+                    continue;
+                if constexpr (std::is_same_v<T, cpu_record>)
+                    samples.push_back(sumRecords(frame.cpu, record.name, duration));
+                else
+                    samples.push_back(sumRecords(frame.gpu, record.name, duration));
+            }
+            std::sort(samples.begin(), samples.end());
+            int depth = 0;
+            if constexpr (std::is_same_v<T, cpu_record>)
+                depth = record.depth;
+            stats.push_back({record.name, depth, sumRecords(latest, record.name, duration), percentile(samples, 0.5), percentile(samples, 0.99)});
+        }
+        return stats;
+    }
+    
+    void drawLine(const std::string& text, float x, float& y) {
+        auto size = graphics::getTextSize(text, graphics::FONT_12);
+        graphics::drawText(text, x, y, graphics::FONT_12, {0.0, 0.0, 0.0, 1.0});
+        y += 4 + (float) size.h;
+    }
+    
+    void render(float x, float& y) {
+        const frame_record* latest = nullptr;
+        std::vector<double> frame_times;
+        for (const auto& frame : frames) {
+            if (!isComplete(frame))
+                continue;
+            frame_times.push_back((double) (frame.end - frame.start) / 1000000.0);
+            if (!latest || frame.number > latest->number)
+                latest = &frame;
+        }
+        if (!latest)
+            return;
+        std::sort(frame_times.begin(), frame_times.end());
+        
+        char line[256];
+        std::snprintf(line, sizeof(line), "Frame: %.2fms (p50 %.2fms, p99 %.2fms, max %.2fms over %d frames)",
+                      (double) (latest->end - latest->start) / 1000000.0, percentile(frame_times, 0.5), percentile(frame_times, 0.99),
+                      frame_times.back(), (int) frame_times.size());
+        drawLine(line, x, y);
+        
+        auto cpu_duration = [](const cpu_record& r) -> double { return (double) (r.end - r.start) / 1000000.0; };
+        for (const auto& s : computeStats(latest->cpu, cpu_duration)) {
+            std::snprintf(line, sizeof(line), "%s: %.2fms (p50 %.2fms, p99 %.2fms)", s.name, s.last, s.p50, s.p99);
+            drawLine(line, x + 10.0f * (float) (s.depth + 1), y);
+        }
+        
+        if (const auto* latest_gpu = latestGPUFrame()) {
+            auto gpu_duration = [](const gpu_record& r) -> double { return r.ms; };
+            for (const auto& s : computeStats(latest_gpu->gpu, gpu_duration)) {
+                std::snprintf(line, sizeof(line), "GPU %s: %.2fms (p50 %.2fms, p99 %.2fms)", s.name, s.last, s.p50, s.p99);
+                drawLine(line, x + 10.0f, y);
+            }
+        }
+        
+        // frame time graph, oldest on the left. Bars are green under 60 fps, yellow under 30 fps and red past that
+        constexpr float bar_width = 1;
+        constexpr float graph_height = 80;
+        // pixels per millisecond, 40ms fills the graph
+        constexpr float scale = graph_height / 40.0f;
+        y += 4;
+        const float bottom = y + graph_height;
+        for (int i = 0; i < FRAME_HISTORY; i++) {
+            const auto& frame = frames[(frame_number + i) % FRAME_HISTORY];
+            if (!isComplete(frame))
+                continue;
+            auto ms = (float) (frame.end - frame.start) / 1000000.0f;
+            blt::vec4 color = ms < 16.7f ? blt::vec4{0, 0.7, 0, 1} : ms < 33.4f ? blt::vec4{0.9, 0.7, 0, 1} : blt::vec4{0.9, 0, 0, 1};
+            auto bar_x = x + (float) i * bar_width;
+            graphics::drawLine2D(bar_x, bottom, bar_x, bottom - std::min(ms * scale, graph_height), color);
+        }
+        const auto graph_width = FRAME_HISTORY * bar_width;
+        graphics::drawLine2D(x, bottom - 16.7f * scale, x + graph_width, bottom - 16.7f * scale, {0, 0, 0, 0.5});
+        graphics::drawLine2D(x, bottom - 33.4f * scale, x + graph_width, bottom - 33.4f * scale, {0, 0, 0, 0.5});
+        graphics::drawLine2D(x, bottom, x + graph_width, bottom, {0, 0, 0, 1});
+        y = bottom + 4;
+    }
+    
+    inline const frame_record* lastComplete() {
+        if (frame_number == 0)
+            return nullptr;
+        const auto& frame = frames[(frame_number - 1) % FRAME_HISTORY];
+        return isComplete(frame) ? &frame : nullptr;
+    }
+    
+    double getLastFrameTime() {
+        const auto* frame = lastComplete();
+        return frame ? (double) (frame->end - frame->start) / 1000000.0 : 0;
+    }
+    
+    double getLastTime(const char* name) {
+        const auto* frame = lastComplete();
+        if (!frame)
+            return 0;
+        double total = 0;
+        for (const auto& r : frame->cpu) {
+            if (sameName(r.name, name))
+                total += (double) (r.end - r.start) / 1000000.0;
+        }
+        return total;
+    }
+    
+    double getLastGPUTime() {
+        const auto* latest_gpu = latestGPUFrame();
+        if (!latest_gpu)
+            return -1;
+        double total = 0;
+        for (const auto& r : latest_gpu->gpu)
+            total += r.ms;
+        return total;
+    }
+    
+    void cleanup() {
+#ifdef FP_GPU_TIMERS
+        for (const auto& q : pending_queries)
+            free_queries.push_back(q.id);
+        pending_queries.clear();
+        if (!free_queries.empty())
+            glDeleteQueries((GLsizei) free_queries.size(), free_queries.data());
+        free_queries.clear();
+#endif
+    }
+    
+}
@@ -0,0 +1,145 @@
+/*
+ * Created by Brett on 19/10/26.
+ * Licensed under GNU General Public License V3.0
+ * See LICENSE file for license detail
+ */
+#include <util/memory.h>
+#include <blt/std/logging.h>
+#include <cstdlib>
+#include <new>
+#include <algorithm>
+
+#include <cstdint>
+
+#ifdef __linux__
+    #include <sys/mman.h>
+#endif
+
+namespace fp {
+    
+#ifdef __linux__
+    constexpr size_t HUGE_PAGE_SIZE = 2 * 1024 * 1024;
+#endif
+    
+    slab_pool::slab_pool(size_t block_size, size_t blocks_per_slab): block_size(std::max(block_size, sizeof(void*))),
+                                                                      blocks_per_slab(blocks_per_slab) {}
+    
+    slab_pool::slab slab_pool::createSlab() {
+        const auto size = block_size * blocks_per_slab;
+#ifdef __linux__
+        if (use_huge_pages) {
+            auto* memory = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+            if (memory != MAP_FAILED)
+                return {memory, size, true, true};
+            // no huge pages are reserved, ask for transparent huge pages instead.
+            // the kernel only backs aligned ranges with them, so map a page extra and trim both ends down to an aligned range
+            memory = mmap(nullptr, size + HUGE_PAGE_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+            if (memory != MAP_FAILED) {
+                auto address = reinterpret_cast<std::uintptr_t>(memory);
+                auto aligned = (address + HUGE_PAGE_SIZE - 1) & ~(std::uintptr_t) (HUGE_PAGE_SIZE - 1);
+                if (aligned > address)
+                    munmap(memory, aligned - address);
+                if (address + HUGE_PAGE_SIZE > aligned)
+                    munmap(reinterpret_cast<void*>(aligned + size), address + HUGE_PAGE_SIZE - aligned);
+                memory = reinterpret_cast<void*>(aligned);
+                bool advised = madvise(memory, size, MADV_HUGEPAGE) == 0;
+                return {memory, size, true, advised};
+            }
+            BLT_WARN("Unable to map a %lu byte slab, falling back to the heap", size);
+        }
+#endif
+        auto* memory = std::malloc(size);
+        if (!memory)
+            throw std::bad_alloc();
+        return {memory, size, false, false};
+    }
+    
+    void* slab_pool::allocate() {
+        std::scoped_lock<std::mutex> lock(mutex);
+        if (!free_list) {
+            auto s = createSlab();
+            slabs.push_back(s);
+            // link the new blocks in order so they are handed out front to back
+            auto* bytes = static_cast<char*>(s.memory);
+            for (size_t i = blocks_per_slab; i > 0; i--) {
+                auto* block = bytes + (i - 1) * block_size;
+                *reinterpret_cast<void**>(block) = free_list;
+                free_list = block;
+            }
+        }
+        auto* block = free_list;
+        free_list = *reinterpret_cast<void**>(block);
+        live++;
+        return block;
+    }
+    
+    void slab_pool::deallocate(void* block) {
+        if (!block)
+            return;
+        std::scoped_lock<std::mutex> lock(mutex);
+        *reinterpret_cast<void**>(block) = free_list;
+        free_list = block;
+        live--;
+    }
+    
+    void slab_pool::setHugePages(bool enabled) {
+        std::scoped_lock<std::mutex> lock(mutex);
+        use_huge_pages = enabled;
+    }
+    
+    slab_pool_stats slab_pool::getStats() {
+        std::scoped_lock<std::mutex> lock(mutex);
+        slab_pool_stats stats;
+        stats.live = live;
+        stats.capacity = slabs.size() * blocks_per_slab;
+        stats.slabs = slabs.size();
+        for (const auto& s : slabs)
+            stats.huge_page_slabs += s.huge_pages;
+        return stats;
+    }
+    
+    slab_pool::~slab_pool() {
+        for (auto& s : slabs) {
+#ifdef __linux__
+            if (s.mapped) {
+                munmap(s.memory, s.size);
+                continue;
+            }
+#endif
+            std::free(s.memory);
+        }
+    }
+    
+    slab_pool& bump_arena::getBlocks() {
+        static slab_pool pool{BLOCK_SIZE, (2 * 1024 * 1024) / BLOCK_SIZE};
+        return pool;
+    }
+    
+    void* bump_arena::allocate(size_t bytes, size_t alignment) {
+        // malloc and the slabs are aligned for every fundamental type, which is all the meshes store
+        if (bytes > BLOCK_SIZE) {
+            auto* memory = static_cast<char*>(std::malloc(bytes));
+            if (!memory)
+                throw std::bad_alloc();
+            large.push_back(memory);
+            large_bytes += bytes;
+            return memory;
+        }
+        auto aligned = (offset + alignment - 1) / alignment * alignment;
+        if (aligned + bytes > BLOCK_SIZE) {
+            // the rest of the current block is wasted, it goes back to the pool with the arena
+            blocks.push_back(static_cast<char*>(getBlocks().allocate()));
+            aligned = 0;
+        }
+        offset = aligned + bytes;
+        return blocks.back() + aligned;
+    }
+    
+    bump_arena::~bump_arena() {
+        for (auto* b : blocks)
+            getBlocks().deallocate(b);
+        for (auto* l : large)
+            std::free(l);
+    }
+    
+}
@@ -16,6 +16,27 @@ void write_default_values(){
     properties["TEXTURE_SIZE"] = std::to_string(128);
     properties["FPS"] = std::to_string(60);
     properties["VIEW_DISTANCE"] = std::to_string(12);
+    // 1 to shrink the view distance when frames take longer than the FPS setting allows and grow it back up to VIEW_DISTANCE when they don't.
+    // Off by default, the GPU timings it reads are still being validated
+    properties["ADAPTIVE_VIEW_DISTANCE"] = std::to_string(0);
+    // the adaptive view distance never goes below this
+    properties["MIN_VIEW_DISTANCE"] = std::to_string(4);
+    // 1 to draw chunks with the vertex pulling renderer (4 bytes per face instead of ~40)
+    properties["FACE_RENDERER"] = std::to_string(0);
+    // radius in chunks around spawn which is generated on worker threads during startup
+    properties["PREGEN_DISTANCE"] = std::to_string(2);
+    // 1 to back the chunk block arrays with 2MiB huge pages (Linux only)
+    properties["HUGE_PAGES"] = std::to_string(0);
+    // 1 to light the world with the point lights of light producing blocks (clustered forward shading)
+    properties["CLUSTERED_LIGHTS"] = std::to_string(1);
+    // 1 to draw opaque chunks into a G-buffer and light them in one full screen pass (deferred shading)
+    properties["DEFERRED"] = std::to_string(0);
+    // 1 to skip chunks hidden behind the solid terrain around the camera (CPU occlusion culling)
+    properties["OCCLUSION_CULLING"] = std::to_string(1);
+    // 1 to skip chunks whose bounding box failed a GPU occlusion query last frame
+    properties["OCCLUSION_QUERIES"] = std::to_string(1);
+    // 1 to skip chunks the camera can't see into through the caves and open air of the chunks in between
+    properties["VISIBILITY_GRAPH"] = std::to_string(1);
 }
 
 void fp::settings::load(const std::string& file) {
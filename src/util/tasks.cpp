@@ -0,0 +1,88 @@
+/*
+ * Created by Brett on 19/10/26.
+ * Licensed under GNU General Public License V3.0
+ * See LICENSE file for license detail
+ */
+#include <util/tasks.h>
+#include <blt/std/logging.h>
+#include <blt/std/time.h>
+#include <thread>
+
+namespace fp {
+    
+    task_graph::task_id task_graph::addTask(
+            const std::string& name, task_thread thread, std::function<void()> func, const std::vector<task_id>& dependencies
+    ) {
+        auto id = (task_id) tasks.size();
+        tasks.push_back({name, thread, std::move(func), (int) dependencies.size()});
+        for (auto dependency : dependencies)
+            tasks[dependency].dependents.push_back(id);
+        return id;
+    }
+    
+    task_graph::task_id task_graph::take(bool main_thread, bool run_any) {
+        std::unique_lock<std::mutex> lock{task_mutex};
+        auto& own = ready[main_thread ? MAIN_THREAD : ANY_THREAD];
+        task_ready.wait(lock, [&]() -> bool {
+            return !own.empty() || (run_any && !ready[ANY_THREAD].empty()) || finished == (int) tasks.size();
+        });
+        auto& queue = !own.empty() ? own : ready[ANY_THREAD];
+        if (queue.empty())
+            return -1;
+        auto id = queue.front();
+        queue.pop();
+        return id;
+    }
+    
+    void task_graph::execute(task_graph::task_id id, bool main_thread) {
+        auto& t = tasks[id];
+        t.on_main = main_thread;
+        t.start = blt::system::getCurrentTimeNanoseconds();
+        t.func();
+        t.end = blt::system::getCurrentTimeNanoseconds();
+        
+        std::scoped_lock<std::mutex> lock{task_mutex};
+        finished++;
+        for (auto dependent : t.dependents) {
+            auto& d = tasks[dependent];
+            if (--d.remaining == 0)
+                ready[d.thread].push(dependent);
+        }
+        task_ready.notify_all();
+    }
+    
+    void task_graph::run(int worker_count) {
+        auto begin = blt::system::getCurrentTimeNanoseconds();
+        for (task_id id = 0; id < (task_id) tasks.size(); id++) {
+            if (tasks[id].remaining == 0)
+                ready[tasks[id].thread].push(id);
+        }
+        
+        std::vector<std::thread> workers;
+        for (int i = 0; i < worker_count; i++) {
+            workers.emplace_back([this]() -> void {
+                task_id id;
+                while ((id = take(false, true)) >= 0)
+                    execute(id, false);
+            });
+        }
+        
+        // the main thread only picks up worker tasks if there is nobody else to run them
+        task_id id;
+        while ((id = take(true, worker_count == 0)) >= 0)
+            execute(id, true);
+        
+        for (auto& worker : workers)
+            worker.join();
+        
+        auto total = blt::system::getCurrentTimeNanoseconds() - begin;
+        for (const auto& t : tasks) {
+            BLT_INFO("Startup task '%s' took %fms on the %s thread (started at %fms)", t.name.c_str(), (double) (t.end - t.start) / 1000000.0,
+                     t.on_main ? "main" : "worker", (double) (t.start - begin) / 1000000.0);
+        }
+        BLT_INFO("Startup finished in %fms using %d workers", (double) total / 1000000.0, worker_count);
+        tasks.clear();
+        finished = 0;
+    }
+    
+}
@@ -0,0 +1,29 @@
+/*
+ * Created by Brett on 19/10/26.
+ * Licensed under GNU General Public License V3.0
+ * See LICENSE file for license detail
+ */
+#include <world/registry.h>
+#include <utility>
+
+// the block half of the registry. Kept apart from registry.cpp so it can be linked without the texture palette (and with it GL)
+
+fp::registry::block_properties* blocks;
+
+fp::registry::block_properties& fp::registry::get(fp::block_type id) {
+    return blocks[id];
+}
+
+void fp::registry::registerBlock(fp::block_type id, fp::registry::block_properties properties) {
+    blocks[id] = std::move(properties);
+}
+
+void fp::registry::blockInit() {
+    //blocks = new phmap::flat_hash_map<fp::block_type, fp::registry::block_properties>();
+    blocks = new fp::registry::block_properties[256];
+}
+
+void fp::registry::blockCleanup() {
+    delete[] blocks;
+    blocks = nullptr;
+}
@@ -0,0 +1,313 @@
+/*
+ * Created by Brett on 19/10/26.
+ * Licensed under GNU General Public License V3.0
+ * See LICENSE file for license detail
+ */
+#include <world/chunk/generator.h>
+#include <world/light.h>
+#include "stb/stb_perlin.h"
+
+/**
+ * @return true if the face of block pointing at the neighbouring block has to be drawn
+ */
+static inline bool isFaceVisible(fp::block_type block, const fp::registry::block_properties& properties, fp::block_type neighbour) {
+    const auto neighbour_visibility = fp::registry::get(neighbour).visibility;
+    switch (properties.visibility) {
+        case fp::registry::OPAQUE:
+            return neighbour_visibility > fp::registry::OPAQUE;
+        case fp::registry::TRANSPARENT_TEXTURE:
+            // the faces between two cutout blocks are kept, they can be seen through the holes in the texture
+            return neighbour_visibility != fp::registry::OPAQUE;
+        case fp::registry::TRANSLUCENT:
+            // a body of water or glass has no faces inside of it
+            return neighbour_visibility != fp::registry::OPAQUE && neighbour != block;
+        default:
+            return false;
+    }
+}
+
+static inline fp::render_pass getRenderPass(fp::registry::block_visibility visibility) {
+    switch (visibility) {
+        case fp::registry::TRANSPARENT_TEXTURE:
+            return fp::CUTOUT_PASS;
+        case fp::registry::TRANSLUCENT:
+            return fp::TRANSLUCENT_PASS;
+        default:
+            return fp::SOLID_PASS;
+    }
+}
+
+static inline unsigned char getLight(const fp::light_storage* light, const fp::block_pos& pos) {
+    return light ? light->getLevel(pos) : fp::MAX_LIGHT;
+}
+
+inline void checkEdgeFace(
+        const fp::block_storage* local, const fp::block_storage* neighbour, const fp::light_storage* neighbour_light,
+        fp::mesh_storage* const meshes[fp::RENDER_PASS_COUNT], fp::face face,
+        const fp::block_pos& pos, const fp::block_pos& neighbour_pos
+) {
+    auto id = local->get(pos);
+    auto& block = fp::registry::get(id);
+    
+    if (block.visibility == fp::registry::TRANSPARENT)
+        return;
+    // a missing neighbour is past the edge of the ring, the face acts as a skirt covering the seam to the next LOD level
+    if (isFaceVisible(id, block, neighbour ? neighbour->get(neighbour_pos) : fp::registry::AIR))
+        meshes[getRenderPass(block.visibility)]->addFace(face, pos, block.textureIndex, getLight(neighbour_light, neighbour_pos));
+}
+
+void fp::generator::generateTerrain(fp::block_storage* storage, const fp::chunk_pos& pos, int lod) {
+    // LOD regions sample the noise once per coarse block, at the center of the blocks it covers
+    const int step = 1 << lod;
+    const int half_step = step / 2;
+    
+    // the surface height only depends on x and z, it is worked out once per column before the blocks are filled in storage order
+    float world_heights[CHUNK_SIZE][CHUNK_SIZE];
+    for (int i = 0; i < CHUNK_SIZE; i++) {
+        auto block_x = float((pos.x * CHUNK_SIZE + i) * step + half_step);
+        for (int k = 0; k < CHUNK_SIZE; k++) {
+            auto block_z = float((pos.z * CHUNK_SIZE + k) * step + half_step);
+            
+            auto noise1 = stb_perlin_ridge_noise3(
+                    block_x / 128.0f,
+                    8.1539123f,
+                    block_z / 128.0f, 2.0f, 0.5f, 1.0, 12.0f
+            );
+            
+            float noise_total = 1;
+            
+            for (int j = 1; j <= 8; j++)
+                noise_total += stb_perlin_noise3(block_x / 256.0f, block_z / 256.0f, (float)j * 5.213953f, 0, 0, 0) * (float)(j);
+            
+            noise_total /= 8;
+            
+            world_heights[i][k] = noise1 * noise_total * 128 + 64;
+        }
+    }
+    
+    for (int index = 0; index < CHUNK_BLOCK_COUNT; index++) {
+        const auto block = block_layout::position(index);
+        auto block_y = float((pos.y * CHUNK_SIZE + block.y) * step + half_step);
+        // blocks above the surface are always air, the cave noise isn't needed for them
+        if (block_y >= world_heights[block.x][block.z])
+            continue;
+        auto block_x = float((pos.x * CHUNK_SIZE + block.x) * step + half_step);
+        auto block_z = float((pos.z * CHUNK_SIZE + block.z) * step + half_step);
+        
+        float noise2 = stb_perlin_fbm_noise3(block_x / 32.0f, block_y / 32.0f, block_z / 32.0f, 2.0, 0.5, 5) + 0.75f;
+        
+        if (noise2 > 0)
+            storage->set(block, noise2 > 1 ? fp::registry::GRASS : fp::registry::STONE);
+    }
+}
+
+void fp::generator::generateMesh(
+        fp::mesh_storage* const meshes[RENDER_PASS_COUNT], const fp::block_storage* local, const fp::block_storage* const neighbours[6],
+        const fp::light_storage* light, const fp::light_storage* const neighbour_lights[6]
+) {
+    // an empty chunk can never produce faces
+    if (local->isEmpty())
+        return;
+    
+    // blocks are walked in storage order, so the neighbour along the fastest axis is usually in the same cache line
+    local->forEach([&](const block_pos& pos, block_type id) {
+        auto& block = fp::registry::get(id);
+        
+        if (block.visibility == registry::TRANSPARENT)
+            return;
+        
+        const int i = pos.x, j = pos.y, k = pos.z;
+        auto texture_index = block.textureIndex;
+        auto* mesh = meshes[getRenderPass(block.visibility)];
+        
+        // faces on the edge of the chunk depend on the neighbours, they are handled below
+        if (i > 0 && isFaceVisible(id, block, local->get({i - 1, j, k})))
+            mesh->addFace(X_NEG, pos, texture_index, getLight(light, {i - 1, j, k}));
+        if (i < CHUNK_SIZE - 1 && isFaceVisible(id, block, local->get({i + 1, j, k})))
+            mesh->addFace(X_POS, pos, texture_index, getLight(light, {i + 1, j, k}));
+        if (j > 0 && isFaceVisible(id, block, local->get({i, j - 1, k})))
+            mesh->addFace(Y_NEG, pos, texture_index, getLight(light, {i, j - 1, k}));
+        if (j < CHUNK_SIZE - 1 && isFaceVisible(id, block, local->get({i, j + 1, k})))
+            mesh->addFace(Y_POS, pos, texture_index, getLight(light, {i, j + 1, k}));
+        if (k > 0 && isFaceVisible(id, block, local->get({i, j, k - 1})))
+            mesh->addFace(Z_NEG, pos, texture_index, getLight(light, {i, j, k - 1}));
+        if (k < CHUNK_SIZE - 1 && isFaceVisible(id, block, local->get({i, j, k + 1})))
+            mesh->addFace(Z_POS, pos, texture_index, getLight(light, {i, j, k + 1}));
+    });
+    
+    const light_storage* edge_lights[6]{};
+    if (neighbour_lights) {
+        for (int i = 0; i < 6; i++)
+            edge_lights[i] = neighbour_lights[i];
+    }
+    
+    // one face of the chunk at a time, each walked in storage order. The neighbour's opposite face is stored the same way
+    for (int axis = 0; axis < 3; axis++) {
+        const auto positive = (face) (axis * 2);
+        const auto negative = (face) (axis * 2 + 1);
+        for (int i = 0; i < CHUNK_SIZE; i++) {
+            for (int j = 0; j < CHUNK_SIZE; j++) {
+                const auto low = getLayerPos(axis, 0, i, j);
+                const auto high = getLayerPos(axis, CHUNK_SIZE - 1, i, j);
+                checkEdgeFace(local, neighbours[negative], edge_lights[negative], meshes, negative, low, high);
+                checkEdgeFace(local, neighbours[positive], edge_lights[positive], meshes, positive, high, low);
+            }
+        }
+    }
+}
+
+void fp::generator::lightRegion(fp::light_storage* light, const fp::block_storage* local, const fp::block_storage* above, int lod) {
+    const auto is_opaque = [](const fp::block_storage* storage, const block_pos& pos) -> bool {
+        return fp::registry::get(storage->get(pos)).visibility == fp::registry::OPAQUE;
+    };
+    
+    bool open[CHUNK_SIZE][CHUNK_SIZE];
+    bool all_open = true;
+    for (int i = 0; i < CHUNK_SIZE; i++) {
+        for (int k = 0; k < CHUNK_SIZE; k++) {
+            open[i][k] = true;
+            if (above && !above->isEmpty()) {
+                for (int j = 0; j < CHUNK_SIZE && open[i][k]; j++)
+                    open[i][k] = !is_opaque(above, {i, j, k});
+            }
+            all_open &= open[i][k];
+        }
+    }
+    // open air under open sky, the array is never needed
+    if (local->isEmpty() && all_open) {
+        light->fillSky(MAX_LIGHT);
+        return;
+    }
+    
+    std::vector<block_pos> queue;
+    for (int i = 0; i < CHUNK_SIZE; i++) {
+        for (int k = 0; k < CHUNK_SIZE; k++) {
+            if (!open[i][k])
+                continue;
+            for (int j = CHUNK_SIZE - 1; j >= 0 && !is_opaque(local, {i, j, k}); j--) {
+                light->set({i, j, k}, SKY_LIGHT, MAX_LIGHT);
+                queue.push_back({i, j, k});
+            }
+        }
+    }
+    
+    const int falloff = 1 << lod;
+    for (size_t head = 0; head < queue.size(); head++) {
+        const auto pos = queue[head];
+        const int level = light->get(pos, SKY_LIGHT) - falloff;
+        if (level <= 0)
+            continue;
+        const block_pos neighbours[6] = {
+                {pos.x + 1, pos.y, pos.z}, {pos.x - 1, pos.y, pos.z}, {pos.x, pos.y + 1, pos.z},
+                {pos.x, pos.y - 1, pos.z}, {pos.x, pos.y, pos.z + 1}, {pos.x, pos.y, pos.z - 1}
+        };
+        for (const auto& next : neighbours) {
+            if (next.x < 0 || next.y < 0 || next.z < 0 || next.x >= CHUNK_SIZE || next.y >= CHUNK_SIZE || next.z >= CHUNK_SIZE)
+                continue;
+            if (is_opaque(local, next) || light->get(next, SKY_LIGHT) >= level)
+                continue;
+            light->set(next, SKY_LIGHT, level);
+            queue.push_back(next);
+        }
+    }
+}
+
+void fp::generator::findEmitters(const fp::block_storage* local, std::vector<block_pos>& emitters) {
+    emitters.clear();
+    if (local->isEmpty())
+        return;
+    local->forEach([&emitters](const block_pos& pos, block_type id) {
+        if (fp::registry::get(id).produces_light)
+            emitters.push_back(pos);
+    });
+}
+
+/**
+ * @return true if every block of the layer at index along the axis (0 x, 1 y, 2 z) is opaque
+ */
+static bool isLayerOpaque(const fp::block_storage* local, int axis, int index) {
+    for (int i = 0; i < CHUNK_SIZE; i++) {
+        for (int j = 0; j < CHUNK_SIZE; j++) {
+            if (fp::registry::get(local->get(fp::getLayerPos(axis, index, i, j))).visibility != fp::registry::OPAQUE)
+                return false;
+        }
+    }
+    return true;
+}
+
+void fp::generator::findOccluders(const fp::block_storage* local, std::vector<occluder_slab>& occluders) {
+    occluders.clear();
+    if (local->isEmpty())
+        return;
+    for (int axis = 0; axis < 3; axis++) {
+        int run_start = -1;
+        for (int index = 0; index <= CHUNK_SIZE; index++) {
+            if (index < CHUNK_SIZE && isLayerOpaque(local, axis, index)) {
+                if (run_start < 0)
+                    run_start = index;
+                continue;
+            }
+            if (run_start < 0)
+                continue;
+            // the other two axes always span the whole chunk
+            block_pos min{0, 0, 0};
+            block_pos max{CHUNK_SIZE - 1, CHUNK_SIZE - 1, CHUNK_SIZE - 1};
+            (axis == 0 ? min.x : axis == 1 ? min.y : min.z) = run_start;
+            (axis == 0 ? max.x : axis == 1 ? max.y : max.z) = index - 1;
+            occluders.push_back({min, max});
+            // the same solid chunk would be found along the other axes
+            if (run_start == 0 && index == CHUNK_SIZE)
+                return;
+            run_start = -1;
+        }
+    }
+}
+
+fp::generator::face_connections fp::generator::findConnections(const fp::block_storage* local) {
+    if (local->isEmpty())
+        return ALL_FACES_CONNECTED;
+    // indexed the same as the block array, see block_layout
+    std::vector<bool> visited(CHUNK_BLOCK_COUNT);
+    std::vector<int> stack;
+    face_connections connections = 0;
+    for (int start = 0; start < CHUNK_BLOCK_COUNT; start++) {
+        if (visited[start])
+            continue;
+        visited[start] = true;
+        if (!local->checkBlockVisibility(block_layout::position(start)))
+            continue;
+        
+        // every face one connected pocket of air touches can see every other face it touches
+        int touched = 0;
+        stack.push_back(start);
+        while (!stack.empty()) {
+            const int index = stack.back();
+            stack.pop_back();
+            const auto pos = block_layout::position(index);
+            touched |= (pos.x == CHUNK_SIZE - 1) << X_POS | (pos.x == 0) << X_NEG | (pos.y == CHUNK_SIZE - 1) << Y_POS | (pos.y == 0) << Y_NEG |
+                       (pos.z == CHUNK_SIZE - 1) << Z_POS | (pos.z == 0) << Z_NEG;
+            const block_pos neighbours[6] = {{pos.x + 1, pos.y, pos.z}, {pos.x - 1, pos.y, pos.z}, {pos.x, pos.y + 1, pos.z},
+                                             {pos.x, pos.y - 1, pos.z}, {pos.x, pos.y, pos.z + 1}, {pos.x, pos.y, pos.z - 1}};
+            for (const auto& neighbour : neighbours) {
+                // out of bounds blocks are never visible
+                if (!local->checkBlockVisibility(neighbour))
+                    continue;
+                const int neighbour_index = block_layout::index(neighbour.x, neighbour.y, neighbour.z);
+                if (visited[neighbour_index])
+                    continue;
+                visited[neighbour_index] = true;
+                stack.push_back(neighbour_index);
+            }
+        }
+        
+        for (int a = 0; a < 6; a++) {
+            for (int b = a + 1; b < 6; b++) {
+                if ((touched >> a & 1) && (touched >> b & 1))
+                    connections |= 1 << getConnectionBit((face) a, (face) b);
+            }
+        }
+        if (connections == ALL_FACES_CONNECTED)
+            break;
+    }
+    return connections;
+}
@@ -4,6 +4,7 @@
  * See LICENSE file for license detail
  */
 #include <world/chunk/storage.h>
+#include <algorithm>
 
 //volatile size_t total = 0;
 //
@@ -84,16 +85,72 @@ const fp::unpacked_vertex* face_decode[] = {
         z_negative_vertices
 };
 
-void fp::mesh_storage::addFace(fp::face face, const block_pos& pos, unsigned char texture_index) {
-    constexpr int texture_index_loc = 32 - 8;
-    constexpr int uv_index_loc = texture_index_loc - 2;
-    constexpr int x_coord_loc = uv_index_loc - 6;
-    constexpr int y_coord_loc = x_coord_loc - 6;
-    constexpr int z_coord_loc = y_coord_loc - 6;
+fp::slab_pool& fp::block_storage::getSlabs() {
+    constexpr size_t array_size = CHUNK_SIZE * CHUNK_SIZE * CHUNK_SIZE * sizeof(block_type);
+    static slab_pool pool{array_size, std::max((size_t) 1, (2 * 1024 * 1024) / array_size)};
+    return pool;
+}
+
+void fp::block_storage::downsample(const fp::block_storage& source, const fp::block_pos& offset) {
+    if (source.isEmpty())
+        return;
+    constexpr int half = CHUNK_SIZE / 2;
+    // cells are walked along the storage order's axes so the reads move through the source the way it is stored
+    int cell[3];
+    for (cell[block_layout::OUTER] = 0; cell[block_layout::OUTER] < half; cell[block_layout::OUTER]++) {
+        for (cell[block_layout::MIDDLE] = 0; cell[block_layout::MIDDLE] < half; cell[block_layout::MIDDLE]++) {
+            for (cell[block_layout::INNER] = 0; cell[block_layout::INNER] < half; cell[block_layout::INNER]++) {
+                const int i = cell[0], j = cell[1], k = cell[2];
+                block_type candidates[8];
+                int solid = 0;
+                for (int n = 0; n < 8; n++) {
+                    auto block = source.get({i * 2 + (n & 1), j * 2 + ((n >> 1) & 1), k * 2 + ((n >> 2) & 1)});
+                    if (fp::registry::get(block).visibility == fp::registry::OPAQUE)
+                        candidates[solid++] = block;
+                }
+                // ties stay solid, otherwise thin walls and floors vanish as soon as they reach the first ring
+                if (solid < 4)
+                    continue;
+                block_type best = candidates[0];
+                int best_count = 0;
+                for (int n = 0; n < solid; n++) {
+                    int count = 0;
+                    for (int m = 0; m < solid; m++)
+                        count += candidates[m] == candidates[n];
+                    if (count > best_count) {
+                        best_count = count;
+                        best = candidates[n];
+                    }
+                }
+                set({offset.x + i, offset.y + j, offset.z + k}, best);
+            }
+        }
+    }
+}
+
+fp::mesh_storage::mesh_storage(bool face_records, bool sortable):
+        vertices(arena_allocator<vertex>(arena)), use_face_records(face_records), keep_face_records(face_records || sortable),
+        faces{face_record_list(arena_allocator<face_record>(arena)), face_record_list(arena_allocator<face_record>(arena)),
+              face_record_list(arena_allocator<face_record>(arena)), face_record_list(arena_allocator<face_record>(arena)),
+              face_record_list(arena_allocator<face_record>(arena)), face_record_list(arena_allocator<face_record>(arena))},
+        indices{mesh_vector<unsigned int>(arena_allocator<unsigned int>(arena)), mesh_vector<unsigned int>(arena_allocator<unsigned int>(arena)),
+                mesh_vector<unsigned int>(arena_allocator<unsigned int>(arena)), mesh_vector<unsigned int>(arena_allocator<unsigned int>(arena)),
+                mesh_vector<unsigned int>(arena_allocator<unsigned int>(arena)), mesh_vector<unsigned int>(arena_allocator<unsigned int>(arena))} {}
+
+void fp::mesh_storage::addFace(fp::face face, const block_pos& pos, unsigned char texture_index, unsigned char light) {
+    if (keep_face_records) {
+        faces[face].push_back(
+                (pos.x << FACE_X_COORD_LOC) | (pos.y << FACE_Y_COORD_LOC) | (pos.z << FACE_Z_COORD_LOC) |
+                (face << FACE_DIRECTION_LOC) | ((texture_index & (MAX_CHUNK_TEXTURES - 1)) << FACE_TEXTURE_INDEX_LOC) | (light << FACE_LIGHT_LOC)
+        );
+    }
+    if (use_face_records)
+        return;
     
     const auto* face_vertices = face_decode[face];
     // negatives are odd numbered, positives are even.
     const auto& face_indices = face % 2 == 0 ? positive_indices : negative_indices;
+    auto& indices = this->indices[face];
     
     vertex translated_face_vertices[VTX_ARR_SIZE];
     
@@ -103,12 +160,13 @@ void fp::mesh_storage::addFace(fp::face face, const block_pos& pos, unsigned cha
         int uv_index = (int)(face_vertices[i].u + face_vertices[i].v * 2);
         
         int data = 0;
-        data = data | (texture_index << texture_index_loc);
+        data = data | ((texture_index & (MAX_CHUNK_TEXTURES - 1)) << VERTEX_TEXTURE_INDEX_LOC);
         
-        data = data | (uv_index << uv_index_loc);
-        data = data | ((pos.x + (face_vertices[i].x > 0 ? 1 : 0)) << x_coord_loc);
-        data = data | ((pos.y + (face_vertices[i].y > 0 ? 1 : 0)) << y_coord_loc);
-        data = data | ((pos.z + (face_vertices[i].z > 0 ? 1 : 0)) << z_coord_loc);
+        data = data | (uv_index << VERTEX_UV_LOC);
+        data = data | ((pos.x + (face_vertices[i].x > 0 ? 1 : 0)) << VERTEX_X_COORD_LOC);
+        data = data | ((pos.y + (face_vertices[i].y > 0 ? 1 : 0)) << VERTEX_Y_COORD_LOC);
+        data = data | ((pos.z + (face_vertices[i].z > 0 ? 1 : 0)) << VERTEX_Z_COORD_LOC);
+        data = data | (light << VERTEX_LIGHT_LOC);
         
         // the famous evil bit hack to convert types while maintaining the bits
         translated_face_vertices[i].data = *reinterpret_cast<float*>(&data);
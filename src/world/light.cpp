@@ -0,0 +1,397 @@
+/*
+ * Created by Brett on 19/10/26.
+ * Licensed under GNU General Public License V3.0
+ * See LICENSE file for license detail
+ */
+#include <world/light.h>
+
+// ordered the same as the face enum
+static const fp::block_pos neighbour_offsets[6] = {
+        {1, 0, 0}, {-1, 0, 0}, {0, 1, 0}, {0, -1, 0}, {0, 0, 1}, {0, 0, -1}
+};
+
+/**
+ * Flooring division from a world coord to a chunk coord. world.h has the same conversion, but it pulls in GL
+ */
+static inline int toChunk(int coord) {
+    return coord >= 0 ? coord / CHUNK_SIZE : -((-coord - 1) / CHUNK_SIZE) - 1;
+}
+
+static inline bool isOpaque(const fp::block_storage* blocks, const fp::block_pos& local) {
+    return fp::registry::get(blocks->get(local)).visibility == fp::registry::OPAQUE;
+}
+
+static inline bool isSamePos(const fp::chunk_pos& p1, const fp::chunk_pos& p2) {
+    return p1.x == p2.x && p1.y == p2.y && p1.z == p2.z;
+}
+
+/**
+ * Calls func with the local position of every block in the layer of the chunk touching this face
+ */
+template<typename F>
+static inline void forEachInLayer(fp::face face, F func) {
+    for (int i = 0; i < CHUNK_SIZE; i++) {
+        for (int j = 0; j < CHUNK_SIZE; j++) {
+            switch (face) {
+                case fp::X_POS:
+                    func(fp::block_pos{CHUNK_SIZE - 1, i, j});
+                    break;
+                case fp::X_NEG:
+                    func(fp::block_pos{0, i, j});
+                    break;
+                case fp::Y_POS:
+                    func(fp::block_pos{i, CHUNK_SIZE - 1, j});
+                    break;
+                case fp::Y_NEG:
+                    func(fp::block_pos{i, 0, j});
+                    break;
+                case fp::Z_POS:
+                    func(fp::block_pos{i, j, CHUNK_SIZE - 1});
+                    break;
+                default:
+                    func(fp::block_pos{i, j, 0});
+                    break;
+            }
+        }
+    }
+}
+
+fp::slab_pool& fp::light_storage::getSlabs() {
+    constexpr size_t array_size = CHUNK_SIZE * CHUNK_SIZE * CHUNK_SIZE;
+    static slab_pool pool{array_size, std::max((size_t) 1, (2 * 1024 * 1024) / array_size)};
+    return pool;
+}
+
+fp::light_engine::light_engine(bool threaded) {
+    if (threaded)
+        worker = new std::thread([this]() -> void { workerLoop(); });
+}
+
+fp::light_engine::light_chunk* fp::light_engine::findChunk(const fp::chunk_pos& pos) {
+    // propagation rarely leaves the chunk it is in, so the last chunk found is kept around
+    if (cached_chunk && isSamePos(cached_pos, pos))
+        return cached_chunk;
+    auto it = chunks.find(pos);
+    if (it == chunks.end())
+        return nullptr;
+    cached_pos = pos;
+    cached_chunk = &it->second;
+    return cached_chunk;
+}
+
+fp::light_engine::light_chunk* fp::light_engine::findBlock(const fp::block_pos& pos, fp::block_pos& local) {
+    const chunk_pos chunk{toChunk(pos.x), toChunk(pos.y), toChunk(pos.z)};
+    local = block_pos{pos.x - chunk.x * CHUNK_SIZE, pos.y - chunk.y * CHUNK_SIZE, pos.z - chunk.z * CHUNK_SIZE};
+    return findChunk(chunk);
+}
+
+void fp::light_engine::setLevel(
+        light_chunk* chunk, const fp::block_pos& pos, const fp::block_pos& local, fp::light_channel channel, int level
+) {
+    chunk->light->set(local, channel, level);
+    
+    const chunk_pos owner{toChunk(pos.x), toChunk(pos.y), toChunk(pos.z)};
+    const auto touch = [this](const chunk_pos& p) -> void {
+        if (touched.empty() || !isSamePos(touched.back(), p))
+            touched.push_back(p);
+    };
+    touch(owner);
+    // meshes sample the light just past their border, so the chunk next to a border block is out of date as well
+    if (local.x == 0)
+        touch({owner.x - 1, owner.y, owner.z});
+    else if (local.x == CHUNK_SIZE - 1)
+        touch({owner.x + 1, owner.y, owner.z});
+    if (local.y == 0)
+        touch({owner.x, owner.y - 1, owner.z});
+    else if (local.y == CHUNK_SIZE - 1)
+        touch({owner.x, owner.y + 1, owner.z});
+    if (local.z == 0)
+        touch({owner.x, owner.y, owner.z - 1});
+    else if (local.z == CHUNK_SIZE - 1)
+        touch({owner.x, owner.y, owner.z + 1});
+}
+
+int fp::light_engine::getSourceLevel(light_chunk* chunk, const fp::block_pos& pos, const fp::block_pos& local, fp::light_channel channel) {
+    if (channel == BLOCK_LIGHT)
+        return fp::registry::get(chunk->blocks->get(local)).produces_light ? MAX_LIGHT : 0;
+    if (local.y != CHUNK_SIZE - 1 || isOpaque(chunk->blocks, local))
+        return 0;
+    // nothing is known about the world above the loaded chunks, it is treated as open sky
+    block_pos above_local{0, 0, 0};
+    return findBlock({pos.x, pos.y + 1, pos.z}, above_local) ? 0 : MAX_LIGHT;
+}
+
+void fp::light_engine::propagate(fp::light_channel channel) {
+    for (size_t head = 0; head < add_queue.size(); head++) {
+        const auto pos = add_queue[head];
+        block_pos local{0, 0, 0};
+        auto* chunk = findBlock(pos, local);
+        if (!chunk)
+            continue;
+        const int level = chunk->light->get(local, channel);
+        if (level <= 1)
+            continue;
+        
+        for (int i = 0; i < 6; i++) {
+            const block_pos next{pos.x + neighbour_offsets[i].x, pos.y + neighbour_offsets[i].y, pos.z + neighbour_offsets[i].z};
+            block_pos next_local{0, 0, 0};
+            auto* next_chunk = findBlock(next, next_local);
+            // light stops at the edge of the loaded chunks, it flows in once the chunk is added
+            if (!next_chunk || isOpaque(next_chunk->blocks, next_local))
+                continue;
+            const int next_level = channel == SKY_LIGHT && i == Y_NEG && level == MAX_LIGHT ? MAX_LIGHT : level - 1;
+            if (next_chunk->light->get(next_local, channel) >= next_level)
+                continue;
+            setLevel(next_chunk, next, next_local, channel, next_level);
+            add_queue.push_back(next);
+        }
+    }
+    add_queue.clear();
+}
+
+void fp::light_engine::remove(fp::light_channel channel) {
+    for (size_t head = 0; head < removal_queue.size(); head++) {
+        const auto node = removal_queue[head];
+        
+        for (int i = 0; i < 6; i++) {
+            const block_pos next{node.pos.x + neighbour_offsets[i].x, node.pos.y + neighbour_offsets[i].y,
+                                 node.pos.z + neighbour_offsets[i].z};
+            block_pos next_local{0, 0, 0};
+            auto* next_chunk = findBlock(next, next_local);
+            if (!next_chunk)
+                continue;
+            const int next_level = next_chunk->light->get(next_local, channel);
+            if (next_level == 0)
+                continue;
+            
+            // anything dimmer than the removed light could have come from it. Anything else has its own source and will refill the hole
+            const bool dependant = next_level < node.level ||
+                                   (channel == SKY_LIGHT && i == Y_NEG && node.level == MAX_LIGHT && next_level == MAX_LIGHT);
+            if (!dependant) {
+                add_queue.push_back(next);
+                continue;
+            }
+            setLevel(next_chunk, next, next_local, channel, 0);
+            removal_queue.push_back({next, next_level});
+            
+            // emitters and open sky light themselves straight back up
+            const int source = getSourceLevel(next_chunk, next, next_local, channel);
+            if (source > 0) {
+                setLevel(next_chunk, next, next_local, channel, source);
+                add_queue.push_back(next);
+            }
+        }
+    }
+    removal_queue.clear();
+}
+
+void fp::light_engine::lightChunk(const light_job& job) {
+    const chunk_pos pos{job.pos.x, job.pos.y, job.pos.z};
+    // inserting can move every chunk in the map
+    cached_chunk = nullptr;
+    chunks[pos] = {job.blocks, job.light};
+    auto* chunk = findChunk(pos);
+    const block_pos origin{pos.x * CHUNK_SIZE, pos.y * CHUNK_SIZE, pos.z * CHUNK_SIZE};
+    
+    // a chunk of nothing but open sky never needs its own array. Its border still has to be queued so the sky spreads out of it
+    auto* above = findChunk({pos.x, pos.y + 1, pos.z});
+    bool open_sky = job.blocks->isEmpty();
+    if (open_sky && above) {
+        forEachInLayer(Y_NEG, [&open_sky, above](const block_pos& local) -> void {
+            open_sky &= above->light->get(local, SKY_LIGHT) == MAX_LIGHT;
+        });
+    }
+    
+    if (open_sky) {
+        job.light->fillSky(MAX_LIGHT);
+        for (int i = 0; i < 6; i++) {
+            forEachInLayer((face) i, [this, &origin](const block_pos& local) -> void {
+                add_queue.push_back({origin.x + local.x, origin.y + local.y, origin.z + local.z});
+            });
+        }
+    } else {
+        if (!above) {
+            forEachInLayer(Y_POS, [this, chunk, &origin](const block_pos& local) -> void {
+                const block_pos block{origin.x + local.x, origin.y + local.y, origin.z + local.z};
+                if (getSourceLevel(chunk, block, local, SKY_LIGHT) == 0)
+                    return;
+                setLevel(chunk, block, local, SKY_LIGHT, MAX_LIGHT);
+                add_queue.push_back(block);
+            });
+        }
+        if (!job.blocks->isEmpty()) {
+            for (int i = 0; i < CHUNK_SIZE; i++) {
+                for (int j = 0; j < CHUNK_SIZE; j++) {
+                    for (int k = 0; k < CHUNK_SIZE; k++) {
+                        if (!fp::registry::get(job.blocks->get({i, j, k})).produces_light)
+                            continue;
+                        const block_pos block{origin.x + i, origin.y + j, origin.z + k};
+                        setLevel(chunk, block, {i, j, k}, BLOCK_LIGHT, MAX_LIGHT);
+                        add_queue.push_back(block);
+                    }
+                }
+            }
+        }
+    }
+    
+    // light already in the loaded neighbours flows in over the shared faces
+    for (int i = 0; i < 6; i++) {
+        const auto& offset = neighbour_offsets[i];
+        if (!findChunk({pos.x + offset.x, pos.y + offset.y, pos.z + offset.z}))
+            continue;
+        forEachInLayer((face) i, [this, &origin, &offset](const block_pos& local) -> void {
+            add_queue.push_back({origin.x + local.x + offset.x, origin.y + local.y + offset.y, origin.z + local.z + offset.z});
+        });
+    }
+    
+    const std::vector<block_pos> seeds = add_queue;
+    propagate(SKY_LIGHT);
+    add_queue = seeds;
+    propagate(BLOCK_LIGHT);
+    
+    // the chunk below was lit as if it were under open sky. Wherever this chunk blocks the sky that light has to go
+    if (auto* below = findChunk({pos.x, pos.y - 1, pos.z})) {
+        forEachInLayer(Y_POS, [this, below, &origin, &job](const block_pos& local) -> void {
+            if (below->light->get(local, SKY_LIGHT) != MAX_LIGHT || job.light->get({local.x, 0, local.z}, SKY_LIGHT) == MAX_LIGHT)
+                return;
+            const block_pos block{origin.x + local.x, origin.y - 1, origin.z + local.z};
+            setLevel(below, block, local, SKY_LIGHT, 0);
+            removal_queue.push_back({block, MAX_LIGHT});
+        });
+        remove(SKY_LIGHT);
+        propagate(SKY_LIGHT);
+    }
+    
+    job.light->markReady();
+    // the neighbours' edge faces look into this chunk, they were meshed before it had any light
+    touched.push_back(pos);
+    for (const auto& offset : neighbour_offsets)
+        touched.push_back({pos.x + offset.x, pos.y + offset.y, pos.z + offset.z});
+}
+
+void fp::light_engine::updateBlock(const fp::block_pos& pos) {
+    block_pos local{0, 0, 0};
+    auto* chunk = findBlock(pos, local);
+    // chunks which aren't lit yet read the new block once they are
+    if (!chunk)
+        return;
+    
+    for (auto channel : {SKY_LIGHT, BLOCK_LIGHT}) {
+        // clear the block's old light along with everything which depended on it, then refill from whatever can still reach it
+        removal_queue.push_back({pos, chunk->light->get(local, channel)});
+        setLevel(chunk, pos, local, channel, 0);
+        remove(channel);
+        
+        const int source = getSourceLevel(chunk, pos, local, channel);
+        if (source > 0) {
+            setLevel(chunk, pos, local, channel, source);
+            add_queue.push_back(pos);
+        }
+        propagate(channel);
+    }
+}
+
+void fp::light_engine::processJob(const light_job& job) {
+    if (job.add_chunk)
+        lightChunk(job);
+    else
+        updateBlock(job.pos);
+    
+    std::scoped_lock<std::mutex> lock(job_mutex);
+    for (const auto& pos : touched)
+        changed.insert(pos);
+    touched.clear();
+}
+
+bool fp::light_engine::popJob(light_job& job) {
+    std::scoped_lock<std::mutex> lock(job_mutex);
+    if (jobs.empty())
+        return false;
+    job = jobs.front();
+    jobs.pop_front();
+    return true;
+}
+
+void fp::light_engine::workerLoop() {
+    while (true) {
+        {
+            std::unique_lock<std::mutex> lock(job_mutex);
+            job_condition.wait(lock, [this]() -> bool { return !running || !jobs.empty(); });
+            if (!running)
+                return;
+        }
+        // whoever is waiting on lock() is usually the render thread, it shouldn't have to wait behind the whole queue
+        while (waiting > 0)
+            std::this_thread::yield();
+        
+        std::scoped_lock<std::mutex> world_lock(world_mutex);
+        light_job job;
+        if (popJob(job))
+            processJob(job);
+    }
+}
+
+void fp::light_engine::addChunk(const fp::chunk_pos& pos, const fp::block_storage* blocks, fp::light_storage* light) {
+    {
+        std::scoped_lock<std::mutex> lock(job_mutex);
+        jobs.push_back({true, {pos.x, pos.y, pos.z}, blocks, light});
+    }
+    job_condition.notify_one();
+}
+
+void fp::light_engine::removeChunk(const fp::chunk_pos& pos) {
+    auto world_lock = lock();
+    {
+        std::scoped_lock<std::mutex> job_lock(job_mutex);
+        jobs.erase(std::remove_if(jobs.begin(), jobs.end(), [&pos](const light_job& job) -> bool {
+            return job.add_chunk && isSamePos({job.pos.x, job.pos.y, job.pos.z}, pos);
+        }), jobs.end());
+    }
+    chunks.erase(pos);
+    cached_chunk = nullptr;
+}
+
+void fp::light_engine::blockChanged(const fp::block_pos& pos) {
+    {
+        std::scoped_lock<std::mutex> lock(job_mutex);
+        jobs.push_back({false, pos});
+    }
+    job_condition.notify_one();
+}
+
+fp::chunk_pos_set fp::light_engine::takeChanged() {
+    chunk_pos_set result;
+    std::scoped_lock<std::mutex> lock(job_mutex);
+    result.swap(changed);
+    return result;
+}
+
+std::unique_lock<std::mutex> fp::light_engine::lock() {
+    waiting++;
+    std::unique_lock<std::mutex> world_lock(world_mutex);
+    waiting--;
+    return world_lock;
+}
+
+bool fp::light_engine::runJob() {
+    std::scoped_lock<std::mutex> world_lock(world_mutex);
+    light_job job;
+    if (!popJob(job))
+        return false;
+    processJob(job);
+    return true;
+}
+
+void fp::light_engine::stop() {
+    {
+        std::scoped_lock<std::mutex> lock(job_mutex);
+        running = false;
+        jobs.clear();
+    }
+    job_condition.notify_all();
+    if (worker) {
+        worker->join();
+        delete worker;
+        worker = nullptr;
+    }
+}
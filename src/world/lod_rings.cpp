@@ -0,0 +1,45 @@
+/*
+ * Created by Brett on 19/10/26.
+ * Licensed under GNU General Public License V3.0
+ * See LICENSE file for license detail
+ */
+#include <world/lod_rings.h>
+#include <algorithm>
+#include <cstdlib>
+
+/**
+ * @return the largest even number <= value / 2
+ */
+static inline int floorHalfToEven(int value) {
+    return fp::_static::chunk_to_region(value, 2) * 2;
+}
+
+bool fp::updateRingAnchors(fp::chunk_pos anchors[MAX_LOD_LEVEL + 1], const fp::chunk_pos& camera_chunk_pos, int radius, bool valid) {
+    const int hysteresis = getRingHysteresis(radius);
+    bool changed = false;
+    
+    for (int lod = 0; lod <= MAX_LOD_LEVEL; lod++) {
+        auto camera_region = _static::chunk_to_region(camera_chunk_pos, lod);
+        auto anchor = anchors[lod];
+        if (!valid || std::abs(camera_region.x - anchor.x) > hysteresis ||
+            std::abs(camera_region.y - anchor.y) > hysteresis || std::abs(camera_region.z - anchor.z) > hysteresis) {
+            // snap to the closest even region
+            anchor = {_static::chunk_to_region(camera_region.x + 1, 1) * 2,
+                      _static::chunk_to_region(camera_region.y + 1, 1) * 2,
+                      _static::chunk_to_region(camera_region.z + 1, 1) * 2};
+        }
+        // the finer ring [inner - radius, inner + radius) only fits inside [anchor * 2 - radius * 2, anchor * 2 + radius * 2)
+        // while |inner - anchor * 2| <= radius. The range always holds an even anchor since the radius is at least 2
+        if (lod > 0) {
+            const auto& inner = anchors[lod - 1];
+            anchor.x = std::clamp(anchor.x, -floorHalfToEven(radius - inner.x), floorHalfToEven(inner.x + radius));
+            anchor.y = std::clamp(anchor.y, -floorHalfToEven(radius - inner.y), floorHalfToEven(inner.y + radius));
+            anchor.z = std::clamp(anchor.z, -floorHalfToEven(radius - inner.z), floorHalfToEven(inner.z + radius));
+        }
+        if (!valid || anchor.x != anchors[lod].x || anchor.y != anchors[lod].y || anchor.z != anchors[lod].z) {
+            anchors[lod] = anchor;
+            changed = true;
+        }
+    }
+    return changed;
+}
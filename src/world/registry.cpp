@@ -4,34 +4,22 @@
  * See LICENSE file for license detail
  */
 #include <world/registry.h>
+#include <render/textures.h>
+#include <world/chunk/typedefs.h>
 #include <unordered_map>
 #include <phmap.h>
 #include <utility>
 #include <thread>
 #include <mutex>
 #include <queue>
-#include <condition_variable>
-
-fp::registry::block_properties* blocks;
+#include <algorithm>
 
 fp::texture::palette* base_palette;
 
 std::mutex palette_mutex {};
-std::mutex main_mutex {};
 std::mutex queue_mutex {};
-std::mutex completion_mutex {};
-std::condition_variable main_wait {};
-
-volatile unsigned int threads_left = 0;
 
 std::queue<fp::texture::file_texture*>* texture_queue;
-std::thread** texture_loader_threads;
-
-int thread_count = 0;
-
-fp::registry::block_properties& fp::registry::get(fp::block_type id) {
-    return blocks[id];
-}
 
 void fp::registry::registerTexture(fp::texture::file_texture* texture) {
     texture_queue->push(texture);
@@ -46,55 +34,77 @@ fp::texture::texture_index fp::registry::getTextureIndex(const std::string& name
     return base_palette->getTexture(name);
 }
 
-void fp::registry::registerBlock(fp::block_type id, fp::registry::block_properties properties) {
-    blocks[id] = std::move(properties);
-    // since this information doesn't change at runtime it can be safely stored
-    blocks[id].textureIndex = getTextureIndex(blocks[id].textureName);
+void fp::registry::resolveBlockTextures() {
+    // since this information doesn't change at runtime it can be safely stored.
+    // unregistered ids keep the default "Air" name, they stay on index 0 like they did before the palette existed
+    for (int id = 0; id < 256; id++) {
+        auto& block = get((block_type) id);
+        if (base_palette->hasTexture(block.textureName))
+            block.textureIndex = getTextureIndex(block.textureName);
+        // the chunk size decides how many bits the mesh has for texture indices, see chunk_dimensions
+        if (block.textureIndex >= MAX_CHUNK_TEXTURES)
+            BLT_WARN("Block %d uses texture %d but %d^3 chunks can only address %d textures", id, block.textureIndex, CHUNK_SIZE, MAX_CHUNK_TEXTURES);
+    }
 }
 
 void fp::registry::generateTexturePalette() {
-    for (int i = 0; i < thread_count; i++) {
-        texture_loader_threads[i]->join();
-        delete texture_loader_threads[i];
-    }
-    BLT_INFO("Finished loading all textures!");
-    delete texture_queue;
-    delete[] texture_loader_threads;
     base_palette->generateGLTexture();
     BLT_INFO("Palette generated!");
 }
 
 void fp::registry::setupTextureLoaderThreads(int count) {
-    BLT_DEBUG("Setting up texture loading threads (%d)", count);
-    thread_count = count;
-    texture_loader_threads = new std::thread*[count];
+    auto texture_size = std::stoi(fp::settings::get("TEXTURE_SIZE"));
+    auto levels = texture::palette::getMipmapLevels(texture_size);
     
-    threads_left = count;
+    // the cache is keyed on every queued source file, if it still matches there is nothing left to decode
+    std::vector<texture::file_texture*> sources;
+    for (auto copy = *texture_queue; !copy.empty(); copy.pop())
+        sources.push_back(copy.front());
+    auto* cache = new texture::palette_cache("texture_cache.bin", texture_size, levels);
+    cache->computeKey(sources);
+    if (cache->load()) {
+        base_palette->setCache(cache);
+        for (auto* source : sources)
+            delete source;
+        delete texture_queue;
+        texture_queue = nullptr;
+        return;
+    }
+    base_palette->setCache(cache);
     
-    for (int i = 0; i < count; i++){
-        texture_loader_threads[i] = new std::thread([](int thread_id) -> void {
-            while (!texture_queue->empty()) {
-                queue_mutex.lock();
-                auto& top = texture_queue->front();
-                texture_queue->pop();
-                queue_mutex.unlock();
+    // no point in starting threads which will never get a texture
+    count = std::max(1, std::min(count, (int) sources.size()));
+    BLT_DEBUG("Setting up texture loading threads (%d)", count);
+    std::vector<std::thread> texture_loader_threads;
     
-                auto texture_size = std::stoi(fp::settings::get("TEXTURE_SIZE"));
+    for (int i = 0; i < count; i++){
+        texture_loader_threads.emplace_back([texture_size, levels]() -> void {
+            while (true) {
+                texture::file_texture* top;
+                {
+                    // the empty check has to happen under the same lock as the pop, otherwise two threads can both see the last texture
+                    std::scoped_lock<std::mutex> lock(queue_mutex);
+                    if (texture_queue->empty())
+                        break;
+                    top = texture_queue->front();
+                    texture_queue->pop();
+                }
+                
                 auto t = texture::file_texture::resize(texture::file_texture::load(top), texture_size, texture_size);
+                t->generateMipmaps(levels);
                 
                 std::scoped_lock<std::mutex> lock(palette_mutex);
                 base_palette->registerTexture(t);
                 BLT_TRACE("Loaded file %s", t->getName().c_str());
             }
-            std::scoped_lock<std::mutex> lock{completion_mutex};
-            threads_left--;
-            BLT_TRACE("Loading thread finished %d more to go", threads_left);
-            main_wait.notify_one();
-        }, i);
+        });
     }
     
-    std::unique_lock<std::mutex> main_lock{main_mutex};
-    main_wait.wait(main_lock, []() -> bool { return threads_left <= 0; });
+    for (auto& thread : texture_loader_threads)
+        thread.join();
+    BLT_INFO("Finished loading all textures!");
+    delete texture_queue;
+    texture_queue = nullptr;
 }
 
 void fp::registry::textureInit() {
@@ -102,12 +112,21 @@ void fp::registry::textureInit() {
     base_palette = new texture::palette();
 }
 
-void fp::registry::cleanup() {
-    delete base_palette;
-    delete[] blocks;
+void fp::registry::registerDefaultTextures() {
+    textureInit();
+    
+    registerTexture(new texture::file_texture{"assets/textures/1676004600027876.jpg", "Stone"});
+    registerTexture(new texture::file_texture{"assets/textures/1668750351593692.jpg", "Dirt"});
+    registerTexture(new texture::file_texture{"assets/textures/1638777414645.jpg", "Dolph"});
+    registerTexture(new texture::file_texture{"assets/textures/1603423355849.jpg", "Sit"});
+    registerTexture(new texture::file_texture{"assets/textures/1603422678312.jpg", "Loser"});
+    registerTexture(new texture::file_texture{"assets/textures/1592244663459.png", "Frog"});
+    registerTexture(new texture::file_texture{"assets/textures/1592234267606.png", "Explode"});
+    
+    setupTextureLoaderThreads();
 }
 
-void fp::registry::blockInit() {
-    //blocks = new phmap::flat_hash_map<fp::block_type, fp::registry::block_properties>();
-    blocks = new fp::registry::block_properties[256];
+void fp::registry::cleanup() {
+    delete base_palette;
+    blockCleanup();
 }
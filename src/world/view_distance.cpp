@@ -0,0 +1,51 @@
+/*
+ * Created by Brett on 19/10/26.
+ * Licensed under GNU General Public License V3.0
+ * See LICENSE file for license detail
+ */
+#include <world/view_distance.h>
+#include <algorithm>
+
+/**
+ * The world rounds every radius up to an even one of at least 2 (see world::setViewRadius()), the limits have to match or the controller
+ * would step to radii the world can't apply
+ */
+static inline int toRingRadius(int radius) {
+    return std::max(2, (radius + 1) / 2 * 2);
+}
+
+fp::view_distance_controller::view_distance_controller(int min_radius, int max_radius, double target_ms):
+        min_radius(toRingRadius(min_radius)), max_radius(std::max(this->min_radius, toRingRadius(max_radius))), target_ms(target_ms) {
+    // start out as far as allowed, weaker machines drop down within a second or two
+    radius = this->max_radius;
+}
+
+bool fp::view_distance_controller::update(double frame_cpu_ms, double frame_gpu_ms) {
+    cpu_ms += (frame_cpu_ms - cpu_ms) * VIEW_SMOOTHING;
+    if (frame_gpu_ms < 0)
+        gpu_ms = -1;
+    else
+        gpu_ms = gpu_ms < 0 ? frame_gpu_ms : gpu_ms + (frame_gpu_ms - gpu_ms) * VIEW_SMOOTHING;
+    if (cooldown > 0) {
+        cooldown--;
+        return false;
+    }
+    
+    const double frame_ms = std::max(cpu_ms, gpu_ms);
+    frames_over = frame_ms > target_ms * VIEW_SHRINK_THRESHOLD ? frames_over + 1 : 0;
+    frames_under = frame_ms < target_ms * VIEW_GROW_THRESHOLD ? frames_under + 1 : 0;
+    
+    int new_radius = radius;
+    if (frames_over >= VIEW_SHRINK_FRAMES)
+        new_radius = std::max(min_radius, radius - 2);
+    else if (frames_under >= VIEW_GROW_FRAMES)
+        new_radius = std::min(max_radius, radius + 2);
+    if (new_radius == radius)
+        return false;
+    
+    radius = new_radius;
+    frames_over = 0;
+    frames_under = 0;
+    cooldown = VIEW_COOLDOWN_FRAMES;
+    return true;
+}
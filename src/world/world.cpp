@@ -4,30 +4,22 @@
  * See LICENSE file for license detail
  */
 #include <world/world.h>
+#include <world/chunk/generator.h>
+#include <util/settings.h>
 #include <blt/profiling/profiler.h>
 #include <blt/std/queue.h>
 #include <queue>
+#include <algorithm>
+#include <vector>
 #include <render/camera.h>
-#include "stb/stb_perlin.h"
+#include <render/ui/graphics.h>
+#include <render/ui/debug.h>
+#include <util/frame_profiler.h>
 #include <blt/std/format.h>
 #include <blt/math/math.h>
 #include <blt/math/log_util.h>
 
-inline void checkEdgeFace(
-        fp::block_storage* local, fp::block_storage* neighbour,
-        fp::mesh_storage* mesh, fp::face face,
-        const fp::block_pos& pos, const fp::block_pos& neighbour_pos
-) {
-    auto& block = fp::registry::get(local->get(pos));
-    
-    if (block.visibility == fp::registry::OPAQUE) {
-        if (fp::registry::get(neighbour->get(neighbour_pos)).visibility > fp::registry::OPAQUE) {
-            mesh->addFace(face, pos, block.textureIndex);
-        }
-    }
-}
-
-void fp::world::generateChunkMesh(chunk* chunk) {
+void fp::world::generateChunkMesh(chunk* chunk, std::unique_lock<std::mutex>& light_lock) {
     // don't re-mesh unless requested
     if (chunk->getDirtiness() != DIRTY)
         return;
@@ -36,196 +28,560 @@ void fp::world::generateChunkMesh(chunk* chunk) {
         return;
     
     chunk_neighbours neighbours{};
-    getNeighbours(chunk->getPos(), neighbours);
+    getNeighbours(chunk->getPos(), neighbours, chunk->getLOD());
     
-    // if none of the neighbours exist we cannot continue!
-    for (auto* neighbour : neighbours.neighbours) {
-        if (!neighbour)
+    // if any neighbour inside the ring doesn't exist yet we cannot continue!
+    for (int i = 0; i < 6; i++) {
+        if (!neighbours[i] && isInsideRing(_static::offset(chunk->getPos(), (face) i), chunk->getLOD()))
             return;
     }
     
-    BLT_START_INTERVAL("Chunk Mesh", "Storage");
-    
-    auto* mesh = new mesh_storage();
-    auto* local_storage = chunk->getBlockStorage();
-    auto* x_neg_storage = neighbours[X_NEG]->getBlockStorage();
-    auto* x_pos_storage = neighbours[X_POS]->getBlockStorage();
-    auto* y_neg_storage = neighbours[Y_NEG]->getBlockStorage();
-    auto* y_pos_storage = neighbours[Y_POS]->getBlockStorage();
-    auto* z_neg_storage = neighbours[Z_NEG]->getBlockStorage();
-    auto* z_pos_storage = neighbours[Z_POS]->getBlockStorage();
-    
-    BLT_END_INTERVAL("Chunk Mesh", "Storage");
-    BLT_START_INTERVAL("Chunk Mesh", "Internal");
-    
-    
-    for (int i = 0; i < CHUNK_SIZE; i++) {
-        for (int j = 0; j < CHUNK_SIZE; j++) {
-            for (int k = 0; k < CHUNK_SIZE; k++) {
-                auto& block = fp::registry::get(local_storage->get({i, j, k}));
-                
-                auto texture_index = block.textureIndex;
-                
-                // The main chunk mesh can handle opaque textures.
-                if (block.visibility == registry::OPAQUE) {
-                    if (local_storage->checkBlockVisibility({i - 1, j, k}))
-                        mesh->addFace(X_NEG, {i, j, k}, texture_index);
-                    if (local_storage->checkBlockVisibility({i + 1, j, k}))
-                        mesh->addFace(X_POS, {i, j, k}, texture_index);
-                    if (local_storage->checkBlockVisibility({i, j - 1, k}))
-                        mesh->addFace(Y_NEG, {i, j, k}, texture_index);
-                    if (local_storage->checkBlockVisibility({i, j + 1, k}))
-                        mesh->addFace(Y_POS, {i, j, k}, texture_index);
-                    if (local_storage->checkBlockVisibility({i, j, k - 1}))
-                        mesh->addFace(Z_NEG, {i, j, k}, texture_index);
-                    if (local_storage->checkBlockVisibility({i, j, k + 1}))
-                        mesh->addFace(Z_POS, {i, j, k}, texture_index);
-                }
-            }
+    // full resolution chunks wait for their light, and for the light of their neighbours to avoid meshing every chunk again once they're lit
+    const light_storage* neighbour_lights[6]{};
+    if (chunk->getLOD() == 0) {
+        if (!chunk->getLightStorage()->isReady())
+            return;
+        for (int i = 0; i < 6; i++) {
+            if (!neighbours[i])
+                continue;
+            neighbour_lights[i] = neighbours[i]->getLightStorage();
+            if (!neighbour_lights[i]->isReady())
+                return;
         }
-    }
-    BLT_END_INTERVAL("Chunk Mesh", "Internal");
-    BLT_START_INTERVAL("Chunk Mesh", "Partial");
-    
-    for (int i = 0; i < CHUNK_SIZE; i++) {
-        for (int j = 0; j < CHUNK_SIZE; j++) {
-            checkEdgeFace(
-                    local_storage, x_neg_storage, mesh, X_NEG, {0, i, j}, {CHUNK_SIZE - 1, i, j}
-            );
-            checkEdgeFace(
-                    local_storage, x_pos_storage, mesh, X_POS, {CHUNK_SIZE - 1, i, j}, {0, i, j}
-            );
-            
-            checkEdgeFace(
-                    local_storage, y_neg_storage, mesh, Y_NEG, {i, 0, j}, {i, CHUNK_SIZE - 1, j}
-            );
-            checkEdgeFace(
-                    local_storage, y_pos_storage, mesh, Y_POS, {i, CHUNK_SIZE - 1, j}, {i, 0, j}
-            );
-            
-            checkEdgeFace(
-                    local_storage, z_neg_storage, mesh, Z_NEG, {i, j, 0}, {i, j, CHUNK_SIZE - 1}
-            );
-            checkEdgeFace(
-                    local_storage, z_pos_storage, mesh, Z_POS, {i, j, CHUNK_SIZE - 1}, {i, j, 0}
-            );
+        if (!light_lock.owns_lock())
+            light_lock = lights.lock();
+    } else {
+        // the faces on the edge look into the neighbours, which are lit here too if they haven't been meshed yet
+        lightRegion(chunk);
+        for (int i = 0; i < 6; i++) {
+            if (!neighbours[i])
+                continue;
+            lightRegion(neighbours[i]);
+            neighbour_lights[i] = neighbours[i]->getLightStorage();
         }
     }
-    BLT_END_INTERVAL("Chunk Mesh", "Partial");
     
-    chunk->getMeshStorage() = mesh;
-    chunk->getStatus() = NONE;
-    chunk->markRefresh();
+    BLT_START_INTERVAL("Chunk Mesh", "Generate");
+    
+    // an empty chunk still needs (empty) meshes so the chunk is marked as ready
+    mesh_storage* meshes[RENDER_PASS_COUNT];
+    for (int i = 0; i < RENDER_PASS_COUNT; i++)
+        meshes[i] = new mesh_storage(chunk->usesFaceRecords(), i == TRANSLUCENT_PASS);
+    const block_storage* neighbour_storages[6];
+    for (int i = 0; i < 6; i++)
+        neighbour_storages[i] = neighbours[i] ? neighbours[i]->getBlockStorage() : nullptr;
+    generator::generateMesh(meshes, chunk->getBlockStorage(), neighbour_storages, chunk->getLightStorage(), neighbour_lights);
+    if (chunk->getLOD() == 0) {
+        generator::findEmitters(chunk->getBlockStorage(), chunk->getEmitters());
+        generator::findOccluders(chunk->getBlockStorage(), chunk->getOccluders());
+        chunk->getConnections() = generator::findConnections(chunk->getBlockStorage());
+    }
     
+    BLT_END_INTERVAL("Chunk Mesh", "Generate");
     
+    for (int i = 0; i < RENDER_PASS_COUNT; i++) {
+        delete chunk->getMeshStorage((render_pass) i);
+        chunk->getMeshStorage((render_pass) i) = meshes[i];
+    }
+    chunk->getStatus() = NONE;
+    chunk->markRefresh();
 }
 
-std::queue<fp::chunk_pos> chunks_to_generate{};
+// full resolution chunks this many chunks or fewer from the camera on every axis are rasterized as occluders
+constexpr int OCCLUDER_RADIUS = 3;
+
+/**
+ * World space bounds of a chunk or LOD region, blocks are centered on their coordinates
+ */
+static inline void getChunkBounds(const fp::chunk* c, blt::vec3& min, blt::vec3& max) {
+    const auto step = (float) (1 << c->getLOD());
+    const auto pos = c->getPos();
+    min = blt::vec3{(float) pos.x * CHUNK_SIZE * step - 0.5f, (float) pos.y * CHUNK_SIZE * step - 0.5f, (float) pos.z * CHUNK_SIZE * step - 0.5f};
+    const auto size = (float) CHUNK_SIZE * step;
+    max = min + blt::vec3{size, size, size};
+}
+
+/**
+ * Bounds the chunk's occlusion query box is drawn with, see QUERY_BOX_PADDING
+ */
+static inline void getQueryBounds(const fp::chunk* c, blt::vec3& min, blt::vec3& max) {
+    getChunkBounds(c, min, max);
+    const auto padding = fp::QUERY_BOX_PADDING * (float) (1 << c->getLOD());
+    min = min - blt::vec3{padding, padding, padding};
+    max = max + blt::vec3{padding, padding, padding};
+}
+
+// one queue per LOD level, the full resolution chunks are always generated first
+std::queue<fp::chunk_pos> chunks_to_generate[MAX_LOD_LEVEL + 1]{};
+// prevents the render loop from queuing the same region every frame while it waits on generation
+phmap::flat_hash_set<fp::chunk_pos, fp::_static::chunk_pos_hash, fp::_static::chunk_pos_equality> queued_chunks[MAX_LOD_LEVEL + 1]{};
+
+void fp::world::queueChunk(const fp::chunk_pos& pos, int lod) {
+    if (queued_chunks[lod].insert(pos).second)
+        chunks_to_generate[lod].push(pos);
+}
 
 void fp::world::update() {
     auto target_delta = 1000000000 / std::stoi(fp::settings::get("FPS"));
+
+#ifdef __EMSCRIPTEN__
+    // there is no light worker on the web, the jobs share the frame's spare time with chunk generation
+    while (fp::window::getCurrentDelta() < target_delta && lights.runJob());
+#endif
+    // chunks (and the chunks bordering them) whose light changed have to be meshed again
+    for (const auto& pos : lights.takeChanged()) {
+        auto* c = getChunk(pos);
+        if (!c)
+            continue;
+        c->markDirty();
+        c->setStatus(NEIGHBOUR_CREATE);
+    }
     
-    while (fp::window::getCurrentDelta() < target_delta) {
-        if (chunks_to_generate.empty())
-            break;
-        const auto& front = chunks_to_generate.front();
-        
-        insertChunk(generateChunk(front));
-        
-        chunks_to_generate.pop();
+    for (int lod = 0; lod <= MAX_LOD_LEVEL; lod++) {
+        auto& queue = chunks_to_generate[lod];
+        while (fp::window::getCurrentDelta() < target_delta) {
+            if (queue.empty())
+                break;
+            const auto front = queue.front();
+            queue.pop();
+            queued_chunks[lod].erase(front);
+            
+            // the rings might have moved on since this region was queued
+            if (isInsideRing(front, lod))
+                insertChunk(generateChunk(front, lod));
+        }
     }
 }
 
-void fp::world::render(fp::shader& shader) {
-    shader.use();
+bool fp::world::isInsideRing(const fp::chunk_pos& pos, int lod) const {
+    if (!_static::inside_ring_box(pos, ring_anchors[lod], ring_radius))
+        return false;
+    if (lod == 0)
+        return true;
+    // since the finer ring is aligned to this level's grid a region is either entirely inside of it or entirely outside
+    return !_static::inside_ring_box(chunk_pos{pos.x * 2, pos.y * 2, pos.z * 2}, ring_anchors[lod - 1], ring_radius);
+}
+
+void fp::world::lightRegion(fp::chunk* region) {
+    auto* light = region->getLightStorage();
+    if (light->isReady())
+        return;
+    auto* above = getChunk(_static::offset(region->getPos(), Y_POS), region->getLOD());
+    generator::lightRegion(light, region->getBlockStorage(), above ? above->getBlockStorage() : nullptr, region->getLOD());
+    light->markReady();
+}
+
+bool fp::world::areChildrenReady(const fp::chunk_pos& pos, int lod) {
+    for (int n = 0; n < 8; n++) {
+        auto* child = getChunk(chunk_pos{pos.x * 2 + (n & 1), pos.y * 2 + ((n >> 1) & 1), pos.z * 2 + ((n >> 2) & 1)}, lod - 1);
+        if (!child || child->getDirtiness() != OKAY)
+            return false;
+    }
+    return true;
+}
+
+void fp::world::updateRings(const fp::chunk_pos& camera_chunk_pos) {
+    bool changed = !rings_valid || view_radius != ring_radius;
+    ring_radius = view_radius;
+    changed |= updateRingAnchors(ring_anchors, camera_chunk_pos, ring_radius, rings_valid);
+    rings_valid = true;
     
+    if (!changed)
+        return;
+    
+    for (int lod = 0; lod <= MAX_LOD_LEVEL; lod++) {
+        auto& storage = getStorage(lod);
+        const auto& anchor = ring_anchors[lod];
+        std::vector<chunk_pos> evicted;
+        for (const auto& pair : storage) {
+            const auto& pos = pair.first;
+            // regions inside the hole are kept until the finer ring can replace them, see render()
+            if (!_static::inside_ring_box(pos, anchor, ring_radius))
+                evicted.push_back(pos);
+        }
+        // chunks leaving a ring always leave as a full 2x2x2 group, which is exactly what the next level needs to downsample from
+        if (lod < MAX_LOD_LEVEL) {
+            for (const auto& pos : evicted) {
+                auto parent = _static::chunk_to_region(pos, 1);
+                if (!isInsideRing(parent, lod + 1) || getChunk(parent, lod + 1))
+                    continue;
+                auto* parent_chunk = new chunk(parent, lod + 1, face_renderer);
+                if (downsampleChildren(parent_chunk)) {
+                    parent_chunk->markDirty();
+                    insertChunk(parent_chunk);
+                } else
+                    delete parent_chunk;
+            }
+        }
+        for (const auto& pos : evicted) {
+            if (lod == 0)
+                lights.removeChunk(pos);
+            delete getChunk(pos, lod);
+            storage.erase(pos);
+        }
+        // the seams have moved, so chunks which now border on another level need their skirts rebuilt
+        for (auto& pair : storage) {
+            if (!isInsideRing(pair.first, lod))
+                continue;
+            for (int i = 0; i < 6; i++) {
+                if (!isInsideRing(_static::offset(pair.first, (face) i), lod)) {
+                    pair.second->markDirty();
+                    pair.second->setStatus(NEIGHBOUR_CREATE);
+                    break;
+                }
+            }
+        }
+    }
+}
+
+void fp::world::render(fp::shader* const shaders[RENDER_PASS_COUNT], const fp::deferred_renderer* deferred) {
     if (fp::window::isKeyPressed(GLFW_KEY_F) && fp::window::keyState())
         fp::camera::isFrozen() ? fp::camera::unfreeze() : fp::camera::freeze();
     
+    if (view_controller) {
+        // waiting on vsync and the chunk generation filling the rest of the frame budget don't depend on the view distance
+        const auto cpu_time = fp::frame_profiler::getLastFrameTime() - fp::frame_profiler::getLastTime("Swap") -
+                              fp::frame_profiler::getLastTime("World Update");
+        if (view_controller->update(cpu_time, fp::frame_profiler::getLastGPUTime()))
+            setViewRadius(view_controller->getRadius());
+    }
+    
+    const auto& camera_pos = fp::camera::getPosition();
+    const block_pos camera_block{camera_pos.x(), camera_pos.y(), camera_pos.z()};
+    
     glActiveTexture(GL_TEXTURE0);
     glBindTexture(GL_TEXTURE_2D_ARRAY, fp::registry::getTextureID());
     
-    auto view_distance = std::stoi(fp::settings::get("VIEW_DISTANCE")) / 2;
-    
-    for (int i = -view_distance; i <= view_distance; i++) {
-        for (int j = -view_distance; j <= view_distance; j++) {
-            for (int k = -view_distance; k <= view_distance; k++) {
-                // get the chunks around the player's camera
-                const auto& pos = fp::camera::getPosition();
-                int x = (int) pos.x();
-                int y = (int) pos.y();
-                int z = (int) pos.z();
-                auto camera_chunk_pos = fp::_static::world_to_chunk({x, y, z});
-                chunk_pos adjusted_chunk_pos {camera_chunk_pos.x + i, // chunk x
-                                              camera_chunk_pos.y + j, // chunk y
-                                              camera_chunk_pos.z + k}; // chunk z
-                // queue a chunk for generation if it doesn't exist. A separate thread should handle the generation.
-                auto* chunk = this->getChunk(adjusted_chunk_pos);
-                if (!chunk) {
-                    chunks_to_generate.push(adjusted_chunk_pos);
-                    continue;
-                }
-                
-                // check for mesh updates
-                if (chunk->getDirtiness() > REFRESH) {
-                    generateChunkMesh(chunk);
-                } else if (chunk->getDirtiness() == REFRESH) {
-                    // 11436 vert, 137,232 bytes
-                    // 1908 vert, 11436 indices, 22896 + 45744 = 68,640 bytes
-                    chunk->updateChunkMesh();
+    // get the chunks around the player's camera
+    auto camera_chunk_pos = fp::_static::world_to_chunk(camera_block);
+    {
+        fp::frame_profiler::scope rings_scope{"Rings"};
+        updateRings(camera_chunk_pos);
+    }
+    graph_stats = {};
+    if (visibility_graph) {
+        fp::frame_profiler::scope graph_scope{"Visibility Graph"};
+        findReachableChunks(camera_chunk_pos);
+    }
+    
+    fp::frame_profiler::push("Collect & Mesh");
+    draw_list.clear();
+    point_lights.clear();
+    occluder_chunks.clear();
+    // held from the first full resolution mesh until every chunk has been collected, so the light engine isn't locked once per chunk
+    std::unique_lock<std::mutex> light_lock;
+    const bool show_bounds = fp::debug::showChunkBounds();
+    for (int lod = 0; lod <= MAX_LOD_LEVEL; lod++) {
+        auto& storage = getStorage(lod);
+        const auto& anchor = ring_anchors[lod];
+        for (int i = -ring_radius; i < ring_radius; i++) {
+            for (int j = -ring_radius; j < ring_radius; j++) {
+                for (int k = -ring_radius; k < ring_radius; k++) {
+                    chunk_pos adjusted_chunk_pos{anchor.x + i, // chunk x
+                                                 anchor.y + j, // chunk y
+                                                 anchor.z + k}; // chunk z
+                    auto* chunk = this->getChunk(adjusted_chunk_pos, lod);
+                    
+                    if (!isInsideRing(adjusted_chunk_pos, lod)) {
+                        // this region is covered by the finer ring. Keep drawing it until its replacement is ready to avoid popping holes
+                        if (!chunk)
+                            continue;
+                        if (areChildrenReady(adjusted_chunk_pos, lod)) {
+                            storage.erase(adjusted_chunk_pos);
+                            delete chunk;
+                            continue;
+                        }
+                    } else if (!chunk) {
+                        // queue a chunk for generation if it doesn't exist. A separate thread should handle the generation.
+                        queueChunk(adjusted_chunk_pos, lod);
+                        continue;
+                    }
+                    
+                    // check for mesh updates
+                    if (chunk->getDirtiness() > REFRESH) {
+                        generateChunkMesh(chunk, light_lock);
+                    } else if (chunk->getDirtiness() == REFRESH) {
+                        // 11436 vert, 137,232 bytes
+                        // 1908 vert, 11436 indices, 22896 + 45744 = 68,640 bytes
+                        chunk->updateChunkMesh(chunk_vaos);
+                    }
+                    
+                    if (occlusion_culling && lod == 0 && !chunk->getOccluders().empty() &&
+                        std::abs(adjusted_chunk_pos.x - camera_chunk_pos.x) <= OCCLUDER_RADIUS &&
+                        std::abs(adjusted_chunk_pos.y - camera_chunk_pos.y) <= OCCLUDER_RADIUS &&
+                        std::abs(adjusted_chunk_pos.z - camera_chunk_pos.z) <= OCCLUDER_RADIUS)
+                        occluder_chunks.push_back(chunk);
+                    
+                    // lights outside the frustum can still reach what's inside it, the clusters sort out which fragments they touch
+                    if (clustered_lights && lod == 0) {
+                        for (const auto& emitter : chunk->getEmitters()) {
+                            const blt::vec4 position{(float) (adjusted_chunk_pos.x * CHUNK_SIZE + emitter.x),
+                                                     (float) (adjusted_chunk_pos.y * CHUNK_SIZE + emitter.y),
+                                                     (float) (adjusted_chunk_pos.z * CHUNK_SIZE + emitter.z), (float) MAX_LIGHT};
+                            point_lights.push_back({position, blt::vec4{1.0f, 0.8f, 0.6f, 1.0f}});
+                        }
+                    }
+                    
+                    blt::vec3 bounds_min, bounds_max;
+                    getChunkBounds(chunk, bounds_min, bounds_max);
+                    
+                    bool inside = frustum::isBoxInsideFrustum(camera::getPVM(), bounds_min, bounds_max);
+                    if (inside && visibility_graph && lod == 0 && !reachable[getGraphIndex(adjusted_chunk_pos)]) {
+                        inside = false;
+                        if (chunk->isDrawable())
+                            graph_stats.culled++;
+                    }
+                    if (inside && chunk->isDrawable())
+                        draw_list.push_back(chunk);
+                    
+                    if (show_bounds) {
+                        // green is drawn, red was culled, yellow is still waiting on its mesh. Darker boxes are coarser LODs
+                        const auto shade = 1.0f - (float) lod / (MAX_LOD_LEVEL + 1);
+                        blt::vec4 color = chunk->getDirtiness() != OKAY ? blt::vec4{shade, shade, 0, 1} :
+                                          inside ? blt::vec4{0, shade, 0, 1} : blt::vec4{shade, 0, 0, 1};
+                        fp::graphics::drawAABB(bounds_min, bounds_max, color);
+                    }
                 }
-                
-                const auto p_min = blt::vec3{(float)i * CHUNK_SIZE, (float)j * CHUNK_SIZE, (float)k * CHUNK_SIZE};
-                const auto p_max = p_min + blt::vec3{CHUNK_SIZE, CHUNK_SIZE, CHUNK_SIZE};
-                
-                const auto& m = camera::getPVM();
-                
-                if (frustum::isInsideFrustum(m, p_min))
-                    chunk->render(shader);
             }
         }
     }
+    
+    if (light_lock.owns_lock())
+        light_lock.unlock();
+    fp::frame_profiler::pop();
+    
+    if (occlusion_culling) {
+        fp::frame_profiler::scope occlusion_scope{"Occlusion"};
+        occlusion.begin(fp::camera::getPVM());
+        for (auto* chunk : occluder_chunks) {
+            const auto pos = chunk->getPos();
+            // blocks are centered on their coordinates
+            const blt::vec3 origin{(float) pos.x * CHUNK_SIZE - 0.5f, (float) pos.y * CHUNK_SIZE - 0.5f, (float) pos.z * CHUNK_SIZE - 0.5f};
+            for (const auto& slab : chunk->getOccluders()) {
+                occlusion.addOccluder(origin + blt::vec3{(float) slab.min.x, (float) slab.min.y, (float) slab.min.z},
+                                      origin + blt::vec3{(float) slab.max.x + 1, (float) slab.max.y + 1, (float) slab.max.z + 1});
+            }
+        }
+        // a chunk's own slabs can never hide it, they always lie behind the nearest point of its bounds
+        draw_list.erase(std::remove_if(draw_list.begin(), draw_list.end(), [this](const chunk* c) -> bool {
+            blt::vec3 min, max;
+            getChunkBounds(c, min, max);
+            return !occlusion.isVisible(min, max);
+        }), draw_list.end());
+    }
+    
+    query_list.clear();
+    if (occlusion_queries) {
+        fp::frame_profiler::scope queries_scope{"Occlusion Queries"};
+        if (!queries)
+            queries = new query_pool();
+        queries->beginFrame();
+        draw_list.erase(std::remove_if(draw_list.begin(), draw_list.end(), [this, &camera_pos](chunk* c) -> bool {
+            auto& query = c->getQuery();
+            blt::vec3 min, max;
+            getQueryBounds(c, min, max);
+            // a box around the camera is clipped by the near plane and can't be tested
+            if (camera_pos.x() > min.x() - 1 && camera_pos.y() > min.y() - 1 && camera_pos.z() > min.z() - 1 &&
+                camera_pos.x() < max.x() + 1 && camera_pos.y() < max.y() + 1 && camera_pos.z() < max.z() + 1) {
+                query.markVisible();
+                return false;
+            }
+            query.poll(*queries);
+            if (!query.isPending())
+                query_list.push_back(c);
+            if (query.isVisible() || query.isConditional())
+                return false;
+            queries->countHidden();
+            return true;
+        }), draw_list.end());
+    }
+    
+    fp::frame_profiler::scope draw_scope{"Draw"};
+    // front to back lets the depth test throw away hidden fragments early, the translucent pass walks the same list backwards
+    const auto distance = [&camera_pos](const chunk* c) -> float {
+        const auto step = (float) (1 << c->getLOD());
+        const auto half = (float) CHUNK_SIZE * step * 0.5f;
+        const auto pos = c->getPos();
+        const blt::vec3 center{(float) pos.x * CHUNK_SIZE * step + half, (float) pos.y * CHUNK_SIZE * step + half,
+                               (float) pos.z * CHUNK_SIZE * step + half};
+        const auto d = center - camera_pos;
+        return d.x() * d.x() + d.y() * d.y() + d.z() * d.z();
+    };
+    std::sort(draw_list.begin(), draw_list.end(), [&distance](const chunk* a, const chunk* b) -> bool {
+        return distance(a) < distance(b);
+    });
+    
+    // every chunk's draw data is uploaded in one go, each draw then only has to select its range of the buffer
+    if (!draw_data)
+        draw_data = new draw_data_buffer<chunk_draw_data>();
+    draw_data->clear();
+    for (auto* chunk : draw_list)
+        draw_data->push(chunk->getDrawData());
+    draw_data->upload();
+    
+    if (clustered_lights) {
+        fp::frame_profiler::scope lights_scope{"Point Lights"};
+        // only the closest lights fit in the uniform block
+        if (point_lights.size() > MAX_POINT_LIGHTS) {
+            const auto light_distance = [&camera_pos](const point_light& light) -> float {
+                const auto dx = light.position.x() - camera_pos.x();
+                const auto dy = light.position.y() - camera_pos.y();
+                const auto dz = light.position.z() - camera_pos.z();
+                return dx * dx + dy * dy + dz * dz;
+            };
+            std::nth_element(point_lights.begin(), point_lights.begin() + MAX_POINT_LIGHTS, point_lights.end(),
+                             [&light_distance](const point_light& a, const point_light& b) -> bool {
+                                 return light_distance(a) < light_distance(b);
+                             });
+            point_lights.resize(MAX_POINT_LIGHTS);
+        }
+        if (!clusters)
+            clusters = new light_clusters();
+        clusters->update(point_lights);
+        clusters->bind();
+    }
+    
+    if (deferred)
+        deferred->beginGeometry();
+    for (int pass = SOLID_PASS; pass < TRANSLUCENT_PASS; pass++) {
+        fp::frame_profiler::gpu_scope pass_gpu_scope{pass == SOLID_PASS ? "Solid Pass" : "Cutout Pass"};
+        shaders[pass]->use();
+        for (size_t i = 0; i < draw_list.size(); i++) {
+            if (!draw_list[i]->hasPass((render_pass) pass))
+                continue;
+            draw_data->bind(i);
+            query_pool::beginConditional(draw_list[i]->getQuery());
+            draw_list[i]->render((render_pass) pass);
+            query_pool::endConditional(draw_list[i]->getQuery());
+        }
+    }
+    // the boxes are tested against the finished opaque depth, the results are read next frame
+    if (!query_list.empty()) {
+        fp::frame_profiler::scope boxes_scope{"Query Boxes"};
+        fp::frame_profiler::gpu_scope boxes_gpu_scope{"Query Boxes"};
+        queries->beginBoxes();
+        for (auto* chunk : query_list) {
+            blt::vec3 min, max;
+            getQueryBounds(chunk, min, max);
+            queries->drawBox(chunk->getQuery(), min, max);
+        }
+        query_pool::endBoxes();
+    }
+    if (deferred) {
+        deferred_renderer::endGeometry();
+        fp::frame_profiler::scope lighting_scope{"Deferred Lighting"};
+        fp::frame_profiler::gpu_scope lighting_gpu_scope{"Deferred Lighting"};
+        deferred->light();
+    }
+    
+    // translucent faces are blended over everything else. They are seen from both sides (looking out from under water) so culling is off
+    fp::frame_profiler::gpu_scope translucent_gpu_scope{"Translucent Pass"};
+    shaders[TRANSLUCENT_PASS]->use();
+    glEnable(GL_BLEND);
+    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+    glDepthMask(GL_FALSE);
+    glDisable(GL_CULL_FACE);
+    for (size_t i = draw_list.size(); i > 0; i--) {
+        auto* chunk = draw_list[i - 1];
+        if (!chunk->hasPass(TRANSLUCENT_PASS))
+            continue;
+        chunk->sortTranslucent(camera_pos);
+        draw_data->bind(i - 1);
+        query_pool::beginConditional(chunk->getQuery());
+        chunk->render(TRANSLUCENT_PASS);
+        query_pool::endConditional(chunk->getQuery());
+    }
+    glEnable(GL_CULL_FACE);
+    glDepthMask(GL_TRUE);
+    glDisable(GL_BLEND);
     //std::cout << "0,0,0 in frustum? " << view_frustum.pointInside(blt::vec3{0,0,0}) << "\n";
 }
 
-fp::chunk* fp::world::generateChunk(const fp::chunk_pos& pos) {
-    if (this->getChunk(pos))
+void fp::world::findReachableChunks(const fp::chunk_pos& camera_chunk_pos) {
+    const int size = ring_radius * 2;
+    const auto camera_index = getGraphIndex(camera_chunk_pos);
+    // the rings haven't caught up with the camera, nothing can be ruled out
+    if (camera_index < 0) {
+        reachable.assign((size_t) size * size * size, true);
+        return;
+    }
+    reachable.assign((size_t) size * size * size, false);
+    
+    struct graph_step {
+        chunk_pos pos;
+        // face of this chunk the search came in through, -1 for the camera's chunk which can see out of every face
+        int entered;
+        // bit per face direction taken to get here
+        int directions;
+    };
+    // anything further than this from a chunk's center along the view direction is outside of it
+    const auto chunk_radius = (float) CHUNK_SIZE * 0.87f;
+    const auto& view = fp::camera::getViewMatrix();
+    std::queue<graph_step> steps;
+    steps.push({camera_chunk_pos, -1, 0});
+    reachable[camera_index] = true;
+    while (!steps.empty()) {
+        const auto step = steps.front();
+        steps.pop();
+        graph_stats.reached++;
+        auto* chunk = getChunk(step.pos);
+        // chunks that don't exist yet can't be drawn, but might turn out to be open once they do
+        const auto connections = chunk ? chunk->getConnections() : generator::ALL_FACES_CONNECTED;
+        for (int f = 0; f < 6; f++) {
+            // faces are ordered in positive / negative pairs, never turning back keeps the search moving away from the camera
+            if (step.directions & (1 << (f ^ 1)))
+                continue;
+            if (step.entered >= 0 && !generator::areFacesConnected(connections, (face) step.entered, (face) f))
+                continue;
+            const auto next = _static::offset(step.pos, (face) f);
+            const auto next_index = getGraphIndex(next);
+            if (next_index < 0 || reachable[next_index])
+                continue;
+            const float center_x = (float) next.x * CHUNK_SIZE + CHUNK_SIZE / 2.0f - 0.5f;
+            const float center_y = (float) next.y * CHUNK_SIZE + CHUNK_SIZE / 2.0f - 0.5f;
+            const float center_z = (float) next.z * CHUNK_SIZE + CHUNK_SIZE / 2.0f - 0.5f;
+            // completely behind the camera, nothing past it is in view either
+            if (view.m(2, 0) * center_x + view.m(2, 1) * center_y + view.m(2, 2) * center_z + view.m(2, 3) > chunk_radius)
+                continue;
+            reachable[next_index] = true;
+            steps.push({next, f ^ 1, step.directions | (1 << f)});
+        }
+    }
+}
+
+bool fp::world::downsampleChildren(fp::chunk* chunk) {
+    if (chunk->getLOD() == 0)
+        return false;
+    const auto& pos = chunk->getPos();
+    fp::chunk* children[8];
+    for (int n = 0; n < 8; n++) {
+        children[n] = getChunk(chunk_pos{pos.x * 2 + (n & 1), pos.y * 2 + ((n >> 1) & 1), pos.z * 2 + ((n >> 2) & 1)}, chunk->getLOD() - 1);
+        if (!children[n])
+            return false;
+    }
+    for (int n = 0; n < 8; n++) {
+        chunk->getBlockStorage()->downsample(
+                *children[n]->getBlockStorage(),
+                {(n & 1) * CHUNK_SIZE / 2, ((n >> 1) & 1) * CHUNK_SIZE / 2, ((n >> 2) & 1) * CHUNK_SIZE / 2}
+        );
+    }
+    return true;
+}
+
+fp::chunk* fp::world::generateChunk(const fp::chunk_pos& pos, int lod) {
+    if (this->getChunk(pos, lod))
         return nullptr;
     BLT_START_INTERVAL("Chunk Generate", "Instantiate");
-    auto* c = new chunk(pos);
-    block_storage* storage = c->getBlockStorage();
+    auto* c = new chunk(pos, lod, face_renderer);
     
-    for (int i = 0; i < CHUNK_SIZE; i++) {
-        auto block_x = float(pos.x * CHUNK_SIZE + i);
-        for (int k = 0; k < CHUNK_SIZE; k++) {
-            auto block_z = float(pos.z * CHUNK_SIZE + k);
-            
-            auto noise1 = stb_perlin_ridge_noise3(
-                    block_x / 128.0f,
-                    8.1539123f,
-                    block_z / 128.0f, 2.0f, 0.5f, 1.0, 12.0f
-            );
-            
-            float noise_total = 1;
-            
-            for (int j = 1; j <= 8; j++)
-                noise_total += stb_perlin_noise3(block_x / 256.0f, block_z / 256.0f, (float)j * 5.213953f, 0, 0, 0) * (float)(j);
-            
-            noise_total /= 8;
-            
-            auto world_height = noise1 * noise_total * 128 + 64;
-            
-            for (int j = 0; j < CHUNK_SIZE; j++) {
-                auto block_y = float(pos.y * CHUNK_SIZE + j);
-                
-                float noise2 = stb_perlin_fbm_noise3(block_x / 32.0f, block_y / 32.0f, block_z / 32.0f, 2.0, 0.5, 5) + 0.75f;
-                
-                if (block_y < world_height && noise2 > 0)
-                    storage->set({i, j, k}, noise2 > 1 ? fp::registry::GRASS : fp::registry::STONE);
-            }
-        }
+    if (downsampleChildren(c)) {
+        c->markDirty();
+        BLT_END_INTERVAL("Chunk Generate", "Instantiate");
+        return c;
     }
     
+    generator::generateTerrain(c->getBlockStorage(), pos, lod);
+    
     c->markDirty();
     
     BLT_END_INTERVAL("Chunk Generate", "Instantiate");
@@ -233,40 +589,333 @@ fp::chunk* fp::world::generateChunk(const fp::chunk_pos& pos) {
     return c;
 }
 
+/**
+ * Creates a VAO laid out for one of the two chunk renderers, see chunk.vert
+ */
+static fp::VAO* createChunkVAO(bool face_records) {
+    auto* vao = new fp::VAO();
+    if (face_records) {
+        vao->bindInstancedVBO(new fp::VBO(fp::ARRAY_BUFFER, nullptr, 0, fp::DYNAMIC), 0, 1, GL_UNSIGNED_INT, sizeof(fp::face_record));
+        return vao;
+    }
+    auto vbo = new fp::VBO(fp::ARRAY_BUFFER, nullptr, 0, fp::DYNAMIC);
+    //auto data_size = 3 * sizeof(float) + 3 * sizeof(float);
+    //vao->bindVBO(vbo, 0, 3, GL_FLOAT, (int) data_size, 0);
+    //vao->bindVBO(vbo, 1, 3, GL_FLOAT, (int) data_size, 3 * sizeof(float), true);
+    vao->bindVBO(vbo, 0, 1, GL_FLOAT, sizeof(float), 0);
+    vao->bindElementVBO(new fp::VBO(fp::ELEMENT_BUFFER, nullptr, 0, fp::DYNAMIC));
+    return vao;
+}
+
+fp::world::world():
+        face_renderer(fp::settings::get("FACE_RENDERER") == "1"),
+        chunk_vaos([face_records = face_renderer]() -> VAO* { return createChunkVAO(face_records); }),
+#ifdef __EMSCRIPTEN__
+        // the thread pool is taken by the texture loader, light jobs are run from update() instead
+        lights(false),
+#else
+        lights(true),
+#endif
+        clustered_lights(fp::settings::get("CLUSTERED_LIGHTS") == "1"),
+        occlusion_culling(fp::settings::get("OCCLUSION_CULLING") == "1"),
+        occlusion_queries(fp::settings::get("OCCLUSION_QUERIES") == "1"),
+        visibility_graph(fp::settings::get("VISIBILITY_GRAPH") == "1") {
+    // VIEW_DISTANCE is the width of the full resolution ring, each LOD ring doubles it.
+    setViewRadius(std::stoi(fp::settings::get("VIEW_DISTANCE")) / 2);
+    if (fp::settings::get("ADAPTIVE_VIEW_DISTANCE") == "1") {
+        // VIEW_DISTANCE stays the upper limit, the far plane is sized for it
+        view_controller = new view_distance_controller(std::stoi(fp::settings::get("MIN_VIEW_DISTANCE")) / 2, view_radius,
+                                                       1000.0 / std::stoi(fp::settings::get("FPS")));
+        setViewRadius(view_controller->getRadius());
+    }
+}
+
+void fp::world::insertPregenerated(const fp::chunk_pos& pos, fp::block_storage* storage) {
+    if (this->getChunk(pos)) {
+        delete storage;
+        return;
+    }
+    auto* c = new chunk(pos, 0, face_renderer, storage);
+    c->markDirty();
+    insertChunk(c);
+}
+
 fp::world::~world() {
+    // the light worker must be done with the chunks before they are deleted
+    lights.stop();
+    delete draw_data;
+    delete clusters;
+    delete view_controller;
     BLT_PRINT_PROFILE("Chunk Mesh", blt::logging::BLT_TRACE, true);
     std::ofstream profile{"decomposition_chunk.csv"};
     BLT_WRITE_PROFILE(profile, "Chunk Mesh");
     for (auto& chunk : chunk_storage)
         delete (chunk.second);
+    for (auto& storage : lod_storage) {
+        for (auto& chunk : storage)
+            delete (chunk.second);
+    }
+    // the chunks hand their queries back to the pool as they are deleted
+    delete queries;
 }
 
-void fp::chunk::render(fp::shader& shader) {
-    if (render_size > 0) {
-        blt::mat4x4 translation{};
-        translation.translate((float) pos.x * CHUNK_SIZE,
-                              (float) pos.y * CHUNK_SIZE,
-                              (float) pos.z * CHUNK_SIZE
-        );
-        shader.setMatrix("translation", translation);
-        //blt::logging::trace << v << "\n";
-        // bind the chunk's VAO
-        chunk_vao->bind();
-        // despite binding the element buffer at creation time, this is required.
-        chunk_vao->getVBO(-1)->bind();
-        glEnableVertexAttribArray(0);
-        glEnableVertexAttribArray(1);
-        glEnableVertexAttribArray(2);
-        glDrawElements(GL_TRIANGLES, (int) render_size, GL_UNSIGNED_INT, nullptr);
-        glDisableVertexAttribArray(2);
-        glDisableVertexAttribArray(1);
-        glDisableVertexAttribArray(0);
+static fp::slab_pool& chunkSlabs() {
+    static fp::slab_pool pool{sizeof(fp::chunk), 256};
+    return pool;
+}
+
+void* fp::chunk::operator new(size_t size) {
+    if (size != sizeof(chunk))
+        return ::operator new(size);
+    return chunkSlabs().allocate();
+}
+
+void fp::chunk::operator delete(void* ptr, size_t size) {
+    if (size != sizeof(chunk)) {
+        ::operator delete(ptr);
+        return;
+    }
+    chunkSlabs().deallocate(ptr);
+}
+
+fp::chunk_draw_data fp::chunk::getDrawData() const {
+    const auto step = (float) (1 << lod);
+    // LOD blocks are shifted so their corners land on the full resolution block grid, keeping the seams between rings closed
+    return {blt::vec4{(float) pos.x * CHUNK_SIZE * step + (step - 1) * 0.5f,
+                      (float) pos.y * CHUNK_SIZE * step + (step - 1) * 0.5f,
+                      (float) pos.z * CHUNK_SIZE * step + (step - 1) * 0.5f,
+                      step}};
+}
+
+void fp::chunk::render(render_pass pass) {
+    auto* render_record = render_records[pass];
+    if (!render_record)
+        return;
+    auto& face_ranges = render_record->face_ranges;
+    const auto step = (float) (1 << lod);
+    const auto& camera_pos = fp::camera::getPosition();
+    // block centers sit on integer coords, so the chunk's faces all lie within [min, max]
+    const blt::vec3 p_min{(float) pos.x * CHUNK_SIZE * step - 0.5f, (float) pos.y * CHUNK_SIZE * step - 0.5f,
+                          (float) pos.z * CHUNK_SIZE * step - 0.5f};
+    const auto size = (float) CHUNK_SIZE * step;
+    
+    // a face can only be seen from the side its normal points to. Once the camera is past the chunk's bounds on an axis,
+    // every face pointing the other way along that axis is guaranteed to be back-facing.
+    bool visible[6];
+    visible[X_POS] = camera_pos.x() > p_min.x();
+    visible[X_NEG] = camera_pos.x() < p_min.x() + size;
+    visible[Y_POS] = camera_pos.y() > p_min.y();
+    visible[Y_NEG] = camera_pos.y() < p_min.y() + size;
+    visible[Z_POS] = camera_pos.z() > p_min.z();
+    visible[Z_NEG] = camera_pos.z() < p_min.z() + size;
+    // translucent faces are drawn from both sides, and in sorted order instead of grouped by direction
+    if (pass == TRANSLUCENT_PASS) {
+        for (bool& v : visible)
+            v = true;
+    }
+    
+    bool has_faces = false;
+    for (int i = 0; i < 6; i++)
+        has_faces |= visible[i] && face_ranges[i].count > 0;
+    if (!has_faces)
+        return;
+    
+    // bind the chunk's VAO
+    auto* chunk_vao = render_record->vao;
+    chunk_vao->bind();
+    if (face_records) {
+        // there is no base instance in GLES 3.0, so each range points the attribute at its first record instead
+        chunk_vao->getVBO(0)->bind();
+        for (int i = 0; i < 6; i++) {
+            if (!visible[i])
+                continue;
+            auto start = face_ranges[i].start;
+            auto count = face_ranges[i].count;
+            while (i + 1 < 6 && visible[i + 1])
+                count += face_ranges[++i].count;
+            if (count == 0)
+                continue;
+            glVertexAttribIPointer(0, 1, GL_UNSIGNED_INT, sizeof(face_record), (void*) (start * sizeof(face_record)));
+            glDrawArraysInstanced(GL_TRIANGLES, 0, 6, (int) count);
+        }
+        return;
+    }
+    // despite binding the element buffer at creation time, this is required.
+    chunk_vao->getVBO(-1)->bind();
+    glEnableVertexAttribArray(0);
+    glEnableVertexAttribArray(1);
+    glEnableVertexAttribArray(2);
+    // the ranges are stored back to back, so neighbouring visible directions are merged into a single draw
+    for (int i = 0; i < 6; i++) {
+        if (!visible[i])
+            continue;
+        auto start = face_ranges[i].start;
+        auto count = face_ranges[i].count;
+        while (i + 1 < 6 && visible[i + 1])
+            count += face_ranges[++i].count;
+        if (count > 0)
+            glDrawElements(GL_TRIANGLES, (int) count, GL_UNSIGNED_INT, (void*) (start * sizeof(unsigned int)));
+    }
+    glDisableVertexAttribArray(2);
+    glDisableVertexAttribArray(1);
+    glDisableVertexAttribArray(0);
+}
+
+/**
+ * @return the center of the face in chunk local block coords, doubled so they stay integers
+ */
+static inline blt::vec3 getFaceCenter(fp::face_record record) {
+    constexpr unsigned int coord_mask = CHUNK_SIZE - 1;
+    const auto face = (record >> fp::FACE_DIRECTION_LOC) & 0x7u;
+    blt::vec3 center{(float) (((record >> fp::FACE_X_COORD_LOC) & coord_mask) * 2 + 1),
+                     (float) (((record >> fp::FACE_Y_COORD_LOC) & coord_mask) * 2 + 1),
+                     (float) (((record >> fp::FACE_Z_COORD_LOC) & coord_mask) * 2 + 1)};
+    // positive faces are even, negative faces are odd. Either way the face sits half a block (1 doubled unit) from the block center
+    const float offset = face % 2 == 0 ? 1.0f : -1.0f;
+    switch (face / 2) {
+        case 0:
+            return {center.x() + offset, center.y(), center.z()};
+        case 1:
+            return {center.x(), center.y() + offset, center.z()};
+        default:
+            return {center.x(), center.y(), center.z() + offset};
+    }
+}
+
+/**
+ * Writes the faces of the order into out, farthest first
+ * @param key returns how far away a face center is, larger is drawn first
+ */
+template<typename F>
+static void sortFaces(const fp::translucent_order& order, std::vector<unsigned int>& out, F key) {
+    std::vector<std::pair<float, unsigned int>> sorted;
+    sorted.reserve(order.keys.size());
+    for (unsigned int i = 0; i < order.keys.size(); i++)
+        sorted.emplace_back(key(getFaceCenter(order.keys[i])), i);
+    std::stable_sort(sorted.begin(), sorted.end(), [](const auto& a, const auto& b) -> bool {
+        return a.first > b.first;
+    });
+    out.clear();
+    out.reserve(order.faces.size());
+    for (const auto& face : sorted) {
+        auto begin = order.faces.begin() + (long) face.second * order.stride;
+        out.insert(out.end(), begin, begin + order.stride);
+    }
+}
+
+void fp::chunk::sortTranslucent(const blt::vec3& camera_pos) {
+    auto* record = render_records[TRANSLUCENT_PASS];
+    if (!record || !record->order)
+        return;
+    auto& order = *record->order;
+    
+    // camera in the same doubled chunk local coords as the face centers
+    const auto draw_data = getDrawData();
+    const auto step = draw_data.offset.w();
+    const blt::vec3 eye{(camera_pos.x() - draw_data.offset.x()) / step * 2 + 1,
+                        (camera_pos.y() - draw_data.offset.y()) / step * 2 + 1,
+                        (camera_pos.z() - draw_data.offset.z()) / step * 2 + 1};
+    constexpr float doubled_size = CHUNK_SIZE * 2;
+    const bool inside = eye.x() >= 0 && eye.x() < doubled_size && eye.y() >= 0 && eye.y() < doubled_size && eye.z() >= 0 &&
+                        eye.z() < doubled_size;
+    
+    std::vector<unsigned int> inside_order;
+    std::vector<unsigned int>* faces;
+    if (inside) {
+        // every block boundary is a face plane, the order can only change once the camera crosses one of them
+        const long cell = (long) (eye.x() / 2) + ((long) (eye.y() / 2) + (long) (eye.z() / 2) * CHUNK_SIZE) * CHUNK_SIZE;
+        const long key = translucent_order::OCTANT_COUNT + cell;
+        if (order.current == key)
+            return;
+        order.current = key;
+        sortFaces(order, inside_order, [&eye](const blt::vec3& center) -> float {
+            const auto d = center - eye;
+            return d.x() * d.x() + d.y() * d.y() + d.z() * d.z();
+        });
+        faces = &inside_order;
+    } else {
+        const int octant = (eye.x() > CHUNK_SIZE ? 1 : 0) | (eye.y() > CHUNK_SIZE ? 2 : 0) | (eye.z() > CHUNK_SIZE ? 4 : 0);
+        if (order.current == octant)
+            return;
+        order.current = octant;
+        faces = &order.octants[octant];
+        if (faces->empty()) {
+            // from far away along the octant's diagonal the faces furthest back have the smallest projection onto it
+            const blt::vec3 direction{octant & 1 ? 1.0f : -1.0f, octant & 2 ? 1.0f : -1.0f, octant & 4 ? 1.0f : -1.0f};
+            sortFaces(order, *faces, [&direction](const blt::vec3& center) -> float {
+                return -(center.x() * direction.x() + center.y() * direction.y() + center.z() * direction.z());
+            });
+        }
     }
+    record->vao->getVBO(face_records ? 0 : -1)->update(*faces);
 }
 
-void fp::chunk::updateChunkMesh() {
+/**
+ * Uploads one pass's mesh into its render record, creating or releasing the record as needed
+ */
+static void uploadPass(
+        fp::mesh_storage* mesh, fp::chunk_render_record*& render_record, fp::vao_pool& pool, bool face_records, fp::render_pass pass,
+        const fp::chunk_pos& pos
+) {
+    using namespace fp;
+    if (mesh->isEmpty()) {
+        // nothing to draw, the GL objects (if this pass ever had faces) can go
+        delete render_record;
+        render_record = nullptr;
+        return;
+    }
+    
+    if (!render_record) {
+        const auto capacity = face_records ? mesh->getFaceCount() * sizeof(face_record) :
+                              mesh->getVertices().size() * sizeof(vertex) + mesh->getIndexCount() * sizeof(unsigned int);
+        render_record = new chunk_render_record(pool, (int) capacity);
+    }
+    auto& face_ranges = render_record->face_ranges;
+    auto* chunk_vao = render_record->vao;
+    
+    // translucent faces keep a CPU copy so they can be re-ordered later. The order is refreshed on the first sortTranslucent()
+    translucent_order* order = nullptr;
+    delete render_record->order;
+    render_record->order = nullptr;
+    if (pass == TRANSLUCENT_PASS) {
+        order = render_record->order = new translucent_order();
+        order->stride = face_records ? 1 : 6;
+        for (int i = 0; i < 6; i++) {
+            auto& direction = mesh->getFaces((face) i);
+            order->keys.insert(order->keys.end(), direction.begin(), direction.end());
+        }
+    }
+    
+    if (face_records) {
+        face_record_list records{arena_allocator<face_record>(mesh->getArena())};
+        for (int i = 0; i < 6; i++) {
+            auto& direction = mesh->getFaces((face) i);
+            face_ranges[i] = {(unsigned int) records.size(), (unsigned int) direction.size()};
+            records.insert(records.end(), direction.begin(), direction.end());
+        }
+        if (order)
+            order->faces.assign(records.begin(), records.end());
+        
+        BLT_DEBUG(
+                "Chunk [%d, %d, %d] mesh updated with %d faces taking %s bytes!",
+                pos.x, pos.y, pos.z, records.size(),
+                blt::string::fromBytes(records.size() * sizeof(face_record)).c_str());
+        
+        chunk_vao->getVBO(0)->update(records);
+        return;
+    }
+    
     auto& vertices = mesh->getVertices();
-    auto& indices = mesh->getIndices();
+    
+    mesh_vector<unsigned int> indices{arena_allocator<unsigned int>(mesh->getArena())};
+    indices.reserve(mesh->getIndexCount());
+    for (int i = 0; i < 6; i++) {
+        auto& direction = mesh->getIndices((face) i);
+        face_ranges[i] = {(unsigned int) indices.size(), (unsigned int) direction.size()};
+        indices.insert(indices.end(), direction.begin(), direction.end());
+    }
+    if (order)
+        order->faces.assign(indices.begin(), indices.end());
     
     BLT_DEBUG(
             "Chunk [%d, %d, %d] mesh updated with %d vertices and %d indices taking (%s, %s) bytes!",
@@ -278,10 +927,14 @@ void fp::chunk::updateChunkMesh() {
     // upload the new vertices to the GPU
     chunk_vao->getVBO(0)->update(vertices);
     chunk_vao->getVBO(-1)->update(indices);
-    render_size = indices.size();
-    
-    // delete the local chunk mesh memory, since we no longer need to store it.
-    delete (mesh);
-    mesh = nullptr;
+}
+
+void fp::chunk::updateChunkMesh(vao_pool& pool) {
+    for (int i = 0; i < RENDER_PASS_COUNT; i++) {
+        uploadPass(meshes[i], render_records[i], pool, face_records, (render_pass) i, pos);
+        // delete the local chunk mesh memory, since we no longer need to store it.
+        delete meshes[i];
+        meshes[i] = nullptr;
+    }
     dirtiness = OKAY;
 }